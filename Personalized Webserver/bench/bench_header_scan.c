@@ -0,0 +1,144 @@
+/**
+ * Microbenchmark for the header terminator scan. Reports the throughput of
+ * each implementation, in bytes per cycle, on realistic browser request
+ * headers, and how much the incremental scan saves when a header arrives over
+ * several reads.
+ *
+ * Build without sanitizers for meaningful numbers:
+ *     make NO_ASAN=true bench
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "header_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+// what Chrome sends for a page load
+const char *BROWSER_HEADER =
+    "GET /bin/game.html HTTP/1.1\r\n"
+    "Host: labradoodle.caltech.edu:4242\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"macOS\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "\r\n";
+
+#define COOKIE_LEN 3000
+#define ITERATIONS 200000
+#define READ_SIZE 64
+
+typedef const char *(*scan_fn_t)(const char *buf, size_t len);
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void) {
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+// keeps the compiler from optimizing the scans away
+static volatile uintptr_t sink;
+
+static void bench_impl(const char *name, scan_fn_t scan, const char *header, size_t len) {
+    if (!header_scan_supported(name)) {
+        printf("  %-8s unsupported on this CPU\n", name);
+        return;
+    }
+    uint64_t start_ns = now_ns();
+    uint64_t start_cycles = now_cycles();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        sink += (uintptr_t) scan(header, len);
+    }
+    uint64_t cycles = now_cycles() - start_cycles;
+    uint64_t ns = now_ns() - start_ns;
+    double bytes = (double) len * ITERATIONS;
+    printf("  %-8s %6.2f bytes/cycle  %6.2f GB/s\n", name, bytes / cycles, bytes / ns);
+}
+
+static void bench_header(const char *title, const char *header) {
+    size_t len = strlen(header);
+    printf("%s (%zu bytes):\n", title, len);
+    bench_impl("scalar", header_scan_terminator_scalar, header, len);
+    bench_impl("sse2", header_scan_terminator_sse2, header, len);
+    bench_impl("avx2", header_scan_terminator_avx2, header, len);
+}
+
+/**
+ * Scans a header which arrives READ_SIZE bytes at a time, either rescanning
+ * everything received after every read (as the server used to) or resuming
+ * where the last scan stopped.
+ */
+static void bench_reads(const char *header) {
+    size_t len = strlen(header);
+    uint64_t rescan_cycles = 0;
+    uint64_t resume_cycles = 0;
+    for (size_t i = 0; i < ITERATIONS / 10; i++) {
+        uint64_t start = now_cycles();
+        for (size_t received = READ_SIZE; ; received += READ_SIZE) {
+            size_t avail = received < len ? received : len;
+            const char *end = header_scan_terminator(header, avail);
+            sink += (uintptr_t) end;
+            if (end != NULL) break;
+        }
+        rescan_cycles += now_cycles() - start;
+
+        start = now_cycles();
+        size_t scanned = 0;
+        for (size_t received = READ_SIZE; ; received += READ_SIZE) {
+            size_t avail = received < len ? received : len;
+            const char *end = header_scan_terminator_from(header, avail, &scanned);
+            sink += (uintptr_t) end;
+            if (end != NULL) break;
+        }
+        resume_cycles += now_cycles() - start;
+    }
+    printf("%zu byte header in %d byte reads (%s):\n", len, READ_SIZE, header_scan_impl());
+    printf("  rescan   %8.1f cycles/header\n", (double) rescan_cycles / (ITERATIONS / 10));
+    printf("  resume   %8.1f cycles/header\n", (double) resume_cycles / (ITERATIONS / 10));
+}
+
+int main(void) {
+    // the same request with a large cookie, as a logged-in browser would send
+    size_t browser_len = strlen(BROWSER_HEADER);
+    char *cookie_header = malloc(browser_len + COOKIE_LEN + 16);
+    size_t used = browser_len - 2;
+    memcpy(cookie_header, BROWSER_HEADER, used);
+    used += sprintf(cookie_header + used, "Cookie: ");
+    for (size_t i = 0; i < COOKIE_LEN; i++) {
+        cookie_header[used++] = "abcdefghijklmnopqrstuvwxyz0123456789=;"[i % 38];
+    }
+    strcpy(cookie_header + used, "\r\n\r\n");
+
+    printf("dispatching to %s\n\n", header_scan_impl());
+    bench_header("browser request", BROWSER_HEADER);
+    bench_header("browser request with cookies", cookie_header);
+    printf("\n");
+    bench_reads(cookie_header);
+
+    free(cookie_header);
+    return 0;
+}
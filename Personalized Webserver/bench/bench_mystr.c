@@ -0,0 +1,86 @@
+/**
+ * Microbenchmark for the string kernels behind mystr.h. Reports the throughput
+ * of each implementation, in bytes per cycle, for finding a separator, comparing
+ * without regard to case and measuring a token, on strings the size of
+ * realistic header names and values.
+ *
+ * Build without sanitizers for meaningful numbers:
+ *     make NO_ASAN=true bench
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mystr.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+// an Accept value, searched for a separator that isn't in it
+const char *VALUE =
+    "text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,"
+    "application/signed-exchange;v=b3;q=0.7";
+// header names, in two cases, and long enough for a block or two
+const char *NAME_LOWER = "sec-ch-ua-platform-version-and-upgrade-insecure-requests";
+const char *NAME_MIXED = "Sec-CH-UA-Platform-Version-And-Upgrade-Insecure-Requests";
+
+#define ITERATIONS 1000000
+
+const char *IMPLS[] = {"scalar", "sse2", "avx2"};
+
+static uint64_t now_cycles(void) {
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// keeps the compiler from optimizing the kernels away
+static volatile size_t sink;
+
+static void report(const char *kernel, size_t len, uint64_t cycles) {
+    printf("    %-20s %6.2f bytes/cycle\n", kernel, (double) len * ITERATIONS / cycles);
+}
+
+static void bench_impl(const char *impl) {
+    if (!mystr_set_impl(impl)) {
+        printf("  %-8s unsupported on this CPU\n", impl);
+        return;
+    }
+    printf("  %s:\n", impl);
+    size_t value_len = strlen(VALUE);
+    size_t name_len = strlen(NAME_LOWER);
+
+    uint64_t start = now_cycles();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        sink += mystr_find_any(VALUE, value_len, "\"\\");
+    }
+    report("mystr_find_any", value_len, now_cycles() - start);
+
+    start = now_cycles();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        sink += mystr_equal_nocase(NAME_LOWER, NAME_MIXED, name_len);
+    }
+    report("mystr_equal_nocase", name_len, now_cycles() - start);
+
+    start = now_cycles();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        sink += mystr_token_length(NAME_MIXED, name_len);
+    }
+    report("mystr_token_length", name_len, now_cycles() - start);
+}
+
+int main(void) {
+    printf("string kernels (dispatched to %s):\n", mystr_impl());
+    for (size_t i = 0; i < sizeof(IMPLS) / sizeof(IMPLS[0]); i++) {
+        bench_impl(IMPLS[i]);
+    }
+    return 0;
+}
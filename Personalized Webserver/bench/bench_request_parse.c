@@ -0,0 +1,103 @@
+/**
+ * Microbenchmark for request parsing. Compares the zero-copy view parser with
+ * `request_parse`, which copies the view into a request, and with the
+ * split-based parser it replaced, on a realistic browser request header.
+ *
+ * Build without sanitizers for meaningful numbers:
+ *     make NO_ASAN=true bench
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <time.h>
+
+#include "http_request.h"
+#include "mystr.h"
+
+// what Chrome sends for a page load
+const char *BROWSER_HEADER =
+    "GET /bin/game.html HTTP/1.1\r\n"
+    "Host: labradoodle.caltech.edu:4242\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"macOS\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "\r\n";
+
+#define ITERATIONS 200000
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// keeps the compiler from optimizing the parses away
+static volatile size_t sink;
+
+/**
+ * The parser before request views: split into lines, split each line on
+ * spaces, and copy every piece out (twice for the request line).
+ */
+static request_t *legacy_parse(const char *contents) {
+    strarray_t *line = mystr_split(contents, '\n');
+    strarray_t *first_line = mystr_split(line->data[0], ' ');
+    char *version = strndup(first_line->data[2], strlen(first_line->data[2]) - 1);
+    request_t *req = request_init(first_line->data[0], first_line->data[1], version);
+    free(version);
+    strarray_free(first_line);
+    for (size_t i = 1; i < line->length - 1; i++) {
+        strarray_t *key_line = mystr_split(line->data[i], ' ');
+        char *key = strndup(key_line->data[0], strlen(key_line->data[0]) - 1);
+        char *value = strndup(key_line->data[1], strlen(key_line->data[1]) - 1);
+        header_map_add(req->headers, key, strlen(key), value, strlen(value));
+        free(key);
+        free(value);
+        strarray_free(key_line);
+    }
+    strarray_free(line);
+    return req;
+}
+
+static void bench_view(const char *header, size_t len) {
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        request_view_t view;
+        bool valid = request_view_parse(header, len, &view);
+        assert(valid);
+        sink += view.num_headers + request_view_header(&view, "Host")->len;
+        request_view_free(&view);
+    }
+    printf("  %-20s %8.1f ns/request\n", "request_view_parse", (double) (now_ns() - start) / ITERATIONS);
+}
+
+static void bench_request(const char *name, request_t *(*parse)(const char *), const char *header) {
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        request_t *req = parse(header);
+        sink += strlen(request_header(req, "Host"));
+        request_free(req);
+    }
+    printf("  %-20s %8.1f ns/request\n", name, (double) (now_ns() - start) / ITERATIONS);
+}
+
+int main(void) {
+    size_t len = strlen(BROWSER_HEADER);
+    printf("browser request (%zu bytes):\n", len);
+    bench_view(BROWSER_HEADER, len);
+    bench_request("request_parse", request_parse, BROWSER_HEADER);
+    bench_request("split-based parse", legacy_parse, BROWSER_HEADER);
+    return 0;
+}
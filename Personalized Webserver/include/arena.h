@@ -0,0 +1,59 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stddef.h>
+
+/**
+ * A bump allocator for memory that all dies at once, e.g., everything made
+ * while serving one request: the request itself, its headers, and the
+ * response.
+ *
+ * Allocating takes a pointer bump out of the arena's current chunk, and
+ * nothing is freed on its own; instead `arena_reset` releases everything at
+ * once and keeps the chunks for next time. An arena that is reset after each
+ * request therefore stops calling malloc once it has grown to the size of the
+ * largest request it has served.
+ *
+ * Allocations bigger than a chunk get a block of their own, which is freed,
+ * rather than kept, on reset.
+ */
+typedef struct arena arena_t;
+
+/**
+ * The chunk size used by the server's per-connection arenas, enough for a
+ * typical request and its response.
+ */
+#define ARENA_DEFAULT_CHUNK_SIZE 4096
+
+/**
+ * Creates an empty arena which allocates from chunks of `chunk_size` bytes.
+ * No chunk is allocated until the first allocation. The arena must be freed
+ * with `arena_free`.
+ */
+arena_t *arena_init(size_t chunk_size);
+
+/**
+ * Returns `size` bytes from the arena, aligned for any type. The memory is
+ * uninitialized and stays valid until the arena is reset or freed; it must not
+ * be passed to `free`.
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * Copies the `len` bytes at `str` into the arena, followed by a
+ * null-terminator.
+ */
+char *arena_strndup(arena_t *arena, const char *str, size_t len);
+
+/**
+ * Releases everything allocated from the arena, keeping its chunks to be
+ * allocated from again.
+ */
+void arena_reset(arena_t *arena);
+
+/**
+ * Frees the arena, its chunks, and so everything allocated from it.
+ */
+void arena_free(arena_t *arena);
+
+#endif /* __ARENA_H */
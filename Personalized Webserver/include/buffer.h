@@ -0,0 +1,83 @@
+#ifndef __BUFFER_H
+#define __BUFFER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * An immutable, reference-counted block of bytes, e.g., a cached response
+ * body, which can be handed out to any number of responses (on any number of
+ * threads) at once without being copied: each holds a reference, and the
+ * bytes are freed once the last one is dropped.
+ *
+ * A buffer's bytes are either on the heap, mapped from a file, or a slice of
+ * another buffer, which keeps the buffer it is a slice of alive. Either way
+ * they never change once the buffer is made, so no locking is needed to read
+ * them.
+ *
+ * ```
+ * buffer_t *body = buffer_copy("Hello, world!", 13);
+ * buffer_t *world = buffer_slice(body, 7, 5);
+ * buffer_release(body);
+ * assert(memcmp(buffer_data(world), "world", 5) == 0);
+ * buffer_release(world);
+ * ```
+ */
+typedef struct buffer buffer_t;
+
+/**
+ * Returns a new buffer holding a copy of the `len` bytes at `data`, with one
+ * reference, held by the caller.
+ */
+buffer_t *buffer_copy(const char *data, size_t len);
+
+/**
+ * Returns a new buffer holding the `len` bytes at `data`, which must have
+ * been allocated with malloc, with one reference, held by the caller. Takes
+ * ownership of `data`, which must not be changed from then on, and is freed
+ * along with the buffer.
+ */
+buffer_t *buffer_wrap(char *data, size_t len);
+
+/**
+ * Returns a new buffer holding the contents of the file open at `fd`, mapped
+ * (read-only) rather than read into memory, so that its pages are shared with
+ * the page cache. `fd` is borrowed: it can be closed right away.
+ *
+ * The file must not be changed (e.g., truncated) while it is mapped.
+ *
+ * Returns NULL, with errno set, if the file can't be mapped.
+ */
+buffer_t *buffer_map_file(int fd);
+
+/**
+ * Returns a new buffer for the `len` bytes of `parent` from `offset`, which
+ * must be within it, without copying them. The slice holds a reference on
+ * `parent` (or whatever `parent` is a slice of) until it is freed.
+ */
+buffer_t *buffer_slice(buffer_t *parent, size_t offset, size_t len);
+
+/**
+ * Takes another reference on `buffer`, for whoever the caller hands it to,
+ * and returns it. Safe to call from any thread.
+ */
+buffer_t *buffer_retain(buffer_t *buffer);
+
+/**
+ * Drops a reference on `buffer`, freeing it (unmapping its file or releasing
+ * its parent, if any) once there are none left. Safe to call from any thread.
+ */
+void buffer_release(buffer_t *buffer);
+
+/**
+ * Returns a pointer to the buffer's bytes, which stay valid for as long as a
+ * reference on it is held.
+ */
+const char *buffer_data(const buffer_t *buffer);
+
+/**
+ * Returns the number of bytes in the buffer.
+ */
+size_t buffer_len(const buffer_t *buffer);
+
+#endif /* __BUFFER_H */
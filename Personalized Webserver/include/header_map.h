@@ -0,0 +1,105 @@
+#ifndef __HEADER_MAP_H
+#define __HEADER_MAP_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "known_headers.h"
+
+/**
+ * A table of a request's headers, looked up by name without regard to case
+ * (as HTTP requires), e.g., "content-length" finds "Content-Length".
+ *
+ * A name may have several values (e.g., a header sent on several lines), all
+ * of which are kept, in the order they were added.
+ *
+ * Headers are stored in one flat array, in order, along with their hashes,
+ * and names are found through an open-addressing index into it, so adding and
+ * looking up a header take constant time, however many there are. The known
+ * headers (see `known_header_t`) skip the index: each has a fixed slot,
+ * found with a perfect hash of its name, or directly by its ID.
+ */
+typedef struct header_map header_map_t;
+
+/**
+ * Creates an empty header map, in `arena` unless it is NULL, in which case it
+ * must be freed with `header_map_free`. A map in an arena, along with
+ * everything added to it, is released with the arena.
+ */
+header_map_t *header_map_init(arena_t *arena);
+
+/**
+ * Frees a header map made on the heap, and the copies of the names and values
+ * in it. Does nothing for a map in an arena.
+ */
+void header_map_free(header_map_t *map);
+
+/**
+ * Adds a header, copying the `name_len` bytes at `name` and the `value_len`
+ * bytes at `value` into the map. If the name is already present (in any case),
+ * the value is added to its values, after those already there.
+ */
+void header_map_add(header_map_t *map, const char *name, size_t name_len, const char *value, size_t value_len);
+
+/**
+ * Like `header_map_add`, for a header whose name is already known to be `id`
+ * (e.g., because the parser looked it up), or HEADER_UNKNOWN, so that it
+ * doesn't have to be looked up again.
+ */
+void header_map_add_known(header_map_t *map, known_header_t id, const char *name, size_t name_len, const char *value,
+                          size_t value_len);
+
+/**
+ * Returns the last value added for `name`, matched case-insensitively, or NULL
+ * if there is none. The value is a null-terminated string owned by the map.
+ *
+ * ```
+ * header_map_t *map = header_map_init(NULL);
+ * header_map_add(map, "Accept", 6, "text/html", 9);
+ * header_map_add(map, "accept", 6, "text/plain", 10);
+ * assert(strcmp(header_map_get(map, "ACCEPT"), "text/plain") == 0);
+ * assert(header_map_count(map, "Accept") == 2);
+ * header_map_free(map);
+ * ```
+ */
+const char *header_map_get(const header_map_t *map, const char *name);
+
+/**
+ * Like `header_map_get`, for a known header, which is found by its ID alone
+ * without looking at its name, e.g.,
+ * `header_map_get_known(map, HEADER_CONTENT_LENGTH)`.
+ */
+const char *header_map_get_known(const header_map_t *map, known_header_t id);
+
+/**
+ * Returns how many values `name` has.
+ */
+size_t header_map_count(const header_map_t *map, const char *name);
+
+/**
+ * Iterates over the values of `name`, in the order they were added. `*cursor`
+ * should be 0 to start with, and is advanced by each call. Returns NULL once
+ * there are no more values.
+ *
+ * ```
+ * size_t cursor = 0;
+ * const char *value;
+ * while ((value = header_map_next_value(map, "Accept", &cursor)) != NULL) {
+ *     puts(value);
+ * }
+ * ```
+ */
+const char *header_map_next_value(const header_map_t *map, const char *name, size_t *cursor);
+
+/**
+ * Returns the number of headers in the map, counting each value of a name.
+ */
+size_t header_map_size(const header_map_t *map);
+
+/**
+ * Returns the value of the `i`th header added to the map, storing its name
+ * (as it was added) in `name`, for iterating over all of them in order.
+ * `i` must be less than `header_map_size(map)`.
+ */
+const char *header_map_entry(const header_map_t *map, size_t i, const char **name);
+
+#endif /* __HEADER_MAP_H */
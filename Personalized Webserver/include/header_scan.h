@@ -0,0 +1,88 @@
+#ifndef __HEADER_SCAN_H
+#define __HEADER_SCAN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Finds the "\r\n\r\n" that ends an HTTP header in the `len` bytes at `buf`.
+ *
+ * Returns a pointer just past the terminator (i.e., to the first byte after
+ * the header), or NULL if `buf` doesn't contain one.
+ *
+ * This dispatches, once, to the fastest implementation the CPU supports: AVX2,
+ * SSE2, or a portable scalar loop.
+ *
+ * ```
+ * const char *header = "GET / HTTP/1.1\r\nHost: x\r\n\r\nleftover";
+ * assert(header_scan_terminator(header, strlen(header)) == header + 27);
+ * assert(header_scan_terminator(header, 20) == NULL);
+ * ```
+ */
+const char *header_scan_terminator(const char *buf, size_t len);
+
+/**
+ * Like `header_scan_terminator`, but resumes a scan of a buffer that has grown
+ * since it was last searched. `*scanned` is the number of bytes at the front
+ * of `buf` known not to contain the start of a terminator, and should be 0 for
+ * a fresh buffer. When no terminator is found, it is advanced so that the next
+ * call only looks at the new bytes (and the last three old ones).
+ *
+ * Each byte of a header is therefore only examined about once, however many
+ * reads it arrives in.
+ */
+const char *header_scan_terminator_from(const char *buf, size_t len, size_t *scanned);
+
+/**
+ * Returns the number of bytes at the front of the `len` bytes at `buf` which
+ * may appear in a header value, i.e., the index of the first control character
+ * other than a tab (e.g., the '\r' ending the value), or `len` if there is
+ * none.
+ *
+ * This and `header_scan_token` scan 16 bytes at a time with SSE2 where it is
+ * available (which it always is on x86-64), so that the request parser skips
+ * over the bulk of a header in blocks.
+ *
+ * ```
+ * const char *value = "text/html; q=0.9\t\r\nHost: x";
+ * assert(header_scan_text(value, strlen(value)) == 17);
+ * ```
+ */
+size_t header_scan_text(const char *buf, size_t len);
+
+/**
+ * Returns the number of bytes at the front of the `len` bytes at `buf` which
+ * may appear in a token (e.g., a method, a path, or a header name), i.e., the
+ * index of the first space, control character, or `stop`, or `len` if there
+ * is none. Pass '\0' as `stop` to only stop at the former.
+ *
+ * ```
+ * const char *line = "Content-Length: 42\r\n";
+ * assert(header_scan_token(line, strlen(line), ':') == 14);
+ * assert(header_scan_token(line, strlen(line), '\0') == 15);
+ * ```
+ */
+size_t header_scan_token(const char *buf, size_t len, char stop);
+
+/**
+ * The individual implementations behind `header_scan_terminator`, exposed for
+ * tests and benchmarks. The SIMD ones must only be called when
+ * `header_scan_supported` says the CPU has the instructions they need.
+ */
+const char *header_scan_terminator_scalar(const char *buf, size_t len);
+const char *header_scan_terminator_sse2(const char *buf, size_t len);
+const char *header_scan_terminator_avx2(const char *buf, size_t len);
+
+/**
+ * Returns whether the named implementation ("scalar", "sse2" or "avx2") can
+ * run on this CPU.
+ */
+bool header_scan_supported(const char *impl);
+
+/**
+ * Returns the name of the implementation `header_scan_terminator` dispatches
+ * to.
+ */
+const char *header_scan_impl(void);
+
+#endif /* __HEADER_SCAN_H */
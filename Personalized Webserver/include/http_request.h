@@ -1,26 +1,167 @@
 #ifndef __HTTP_REQUEST_H
 #define __HTTP_REQUEST_H
 
-#include "ll.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "header_map.h"
+#include "known_headers.h"
+#include "arena.h"
+#include "request_body.h"
+#include "http_response.h"
+
+/**
+ * The number of headers a `request_view_t` holds without allocating.
+ */
+#define REQUEST_VIEW_INLINE_HEADERS 32
+
+/**
+ * The number of headers a `request_parser_t` keeps track of without
+ * allocating.
+ */
+#define REQUEST_PARSER_INLINE_HEADERS 16
+
+/**
+ * A string that isn't copied out of the buffer it was found in: the `len` bytes
+ * at `ptr`, which are not null-terminated. It is only valid for as long as the
+ * buffer is.
+ */
+typedef struct str_view {
+    const char *ptr;
+    size_t len;
+} str_view_t;
+
+/**
+ * A header line, as views of its name and of its value (with the whitespace
+ * around the value trimmed), and which known header it is, if any.
+ */
+typedef struct header_view {
+    str_view_t name;
+    str_view_t value;
+    known_header_t id;
+} header_view_t;
+
+/**
+ * A parsed request header whose fields are all views into the buffer it was
+ * parsed from, e.g., the connection's input buffer, so that parsing doesn't
+ * copy or allocate anything.
+ * 
+ * The request target is split at its first '?' into `path` and `query`, both
+ * still percent-encoded. `query.ptr` is NULL if there was no '?'.
+ * 
+ * `headers` holds `num_headers` headers in the order they were sent. It points
+ * into the view itself unless there are more than REQUEST_VIEW_INLINE_HEADERS
+ * of them, so a view must not be copied, and must be freed with
+ * `request_view_free` in case they spilled onto the heap.
+ */
+typedef struct request_view {
+    str_view_t method;
+    str_view_t path;
+    str_view_t query;
+    str_view_t http_version;
+    size_t num_headers;
+    header_view_t *headers;
+    size_t headers_capacity;
+    header_view_t inline_headers[REQUEST_VIEW_INLINE_HEADERS];
+} request_view_t;
+
+/**
+ * How far `request_parser_feed` got.
+ */
+typedef enum parse_status {
+    PARSE_INCOMPLETE, // the header doesn't end in the bytes fed so far
+    PARSE_COMPLETE,   // the whole header has been parsed
+    PARSE_ERROR,      // the header is malformed, see the parser's `error`
+} parse_status_t;
+
+/**
+ * Where a header line's name and value are, as offsets from the start of the
+ * request, and which known header it is, if any.
+ */
+typedef struct header_span {
+    uint32_t name_start;
+    uint32_t name_len;
+    uint32_t value_start;
+    uint32_t value_len;
+    known_header_t id;
+} header_span_t;
+
+/**
+ * An incremental parser for a request header, for when the header arrives a
+ * piece at a time. Each call to `request_parser_feed` only looks at the bytes
+ * that arrived since the last, so every byte is examined exactly once however
+ * the header is split up, and nothing is copied: the parser only remembers
+ * where things are, as offsets, so the buffer may move between calls (e.g.,
+ * when it grows).
+ * 
+ * Once it fails, `error` is the status code to answer with. The other fields
+ * are private. A parser holds its first REQUEST_PARSER_INLINE_HEADERS headers
+ * itself, so it must not be copied, and must be freed with
+ * `request_parser_free`.
+ */
+typedef struct request_parser {
+    response_code_t error;
+    unsigned state;
+    uint32_t offset;
+    uint32_t method_len;
+    uint32_t path_start;
+    uint32_t path_len;
+    uint32_t query_start;
+    uint32_t query_len;
+    uint32_t version_start;
+    uint32_t version_len;
+    header_span_t current;
+    uint32_t num_headers;
+    uint32_t headers_capacity;
+    header_span_t *headers;
+    header_span_t inline_headers[REQUEST_PARSER_INLINE_HEADERS];
+} request_parser_t;
 
 /**
  * Struct representing an HTTP request.
  * 
- * The `method`, `http_version`, and `path` fields are heap-allocated strings
- * that are owned by the struct and are freed by `request_free`.
+ * The `method`, `http_version`, and `path` fields are strings that are owned by
+ * the struct. They are stored in the same allocation as the struct itself and
+ * are freed along with it by `request_free`.
+ * 
+ * `path` and `query` are the request target split at its first '?', exactly
+ * as they were sent, i.e., still percent-encoded; `query` is NULL if there was
+ * no '?'. `request_path` decodes the path, and `request_query_param` looks up
+ * query parameters, both only when asked and without touching the heap.
+ * 
+ * The `headers` is a map of the request's headers, looked up by name without
+ * regard to case (see `request_header`), also freed by `request_free`. The
+ * known headers, e.g., Content-Length, have fixed slots in it which
+ * `request_known_header` reads directly; only the rest are hashed.
+ * 
+ * `body` is the request's body, which handlers read incrementally with
+ * `request_body_read`, or NULL if the request doesn't have one. It is owned by
+ * the struct and freed by `request_free`.
  * 
- * The `headers` is a linked list dictionary of headers, also freed by
- * `request_free`.
+ * A request made by `request_from_view_arena` lives in `arena` instead, along
+ * with its strings and headers, and only its body is freed by `request_free`.
+ * Handlers may allocate whatever else only lasts until their response has
+ * been sent (e.g., the response itself, but not a streamed response's state)
+ * from the same arena. `arena` is NULL for a request on the heap.
  */
 typedef struct {
     char *method;
     char *http_version;
     char *path;
-    ll_map_t *headers;
+    char *query;
+    header_map_t *headers;
+    request_body_t *body;
+    arena_t *arena;
+    // private: the decoded path, once `request_path` has been called, and
+    // where decoded strings go for a request on the heap
+    const char *decoded_path;
+    arena_t *decode_arena;
 } request_t;
 
 /**
  * Initializes a new request struct with the given method, path, and HTTP version.
+ * A '?' in `path` starts the request's query, as it would in a request line.
  * 
  * The `method`, `http_version`, and `path` strings are COPIED into the struct,
  * so the caller still owns the original strings and must free them once they
@@ -48,15 +189,17 @@ typedef struct {
  * free(path);
  * free(http_version);
  * 
- * The `headers` field is initialized as an empty linked list dictionary.
+ * The `headers` field is initialized as an empty header map, and `body` as
+ * NULL.
  */
 request_t *request_init(const char *method, const char *path, const char *http_version);
 
 /**
  * Frees the given request struct and all the strings inside it.
  * 
- * The `method`, `http_version`, and `path` strings are freed using free, and
- * the `headers` linked list dictionary is freed using `ll_free`.
+ * The `method`, `http_version`, and `path` strings are freed with the struct, the
+ * `headers` map using `header_map_free`, and the body (if any) using
+ * `request_body_free`.
  * 
  * ```
  * request_t *req = request_init("GET", "/index.html", "HTTP/1.1");
@@ -66,21 +209,240 @@ request_t *request_init(const char *method, const char *path, const char *http_v
 void request_free(request_t *req);
 
 /**
- * Parses an HTTP request from the given string contents, creating a new request
- * struct.
+ * Returns the value of the request's header `name`, matched case-insensitively,
+ * or NULL if it wasn't sent. Of a header sent more than once, returns the last
+ * value; `header_map_next_value` gives all of them.
+ * 
+ * ```
+ * request_t *req = request_parse("GET / HTTP/1.1\r\nHost: example.com\r\n\r\n");
+ * assert(strcmp(request_header(req, "host"), "example.com") == 0);
+ * request_free(req);
+ * ```
+ */
+const char *request_header(const request_t *req, const char *name);
+
+/**
+ * Like `request_header`, for a known header, which is found by its ID without
+ * looking at any names.
+ *
+ * ```
+ * request_t *req = request_parse("GET / HTTP/1.1\r\nContent-Length: 5\r\n\r\n");
+ * assert(strcmp(request_known_header(req, HEADER_CONTENT_LENGTH), "5") == 0);
+ * assert(request_known_header(req, HEADER_HOST) == NULL);
+ * request_free(req);
+ * ```
+ */
+const char *request_known_header(const request_t *req, known_header_t id);
+
+/**
+ * Returns the request's path with its percent-encoding decoded, e.g., "/my
+ * file.txt" for "/my%20file.txt", or NULL if the encoding is invalid (a '%'
+ * not followed by two hex digits, or an encoded null byte).
+ * 
+ * A path without any '%' is returned as is, and any other is only decoded
+ * the first time it is asked for, into the request's arena (or memory freed
+ * with the request, for one on the heap).
+ */
+const char *request_path(request_t *req);
+
+/**
+ * Returns the decoded value of the first query parameter whose decoded name
+ * is `name`, e.g., "a b" for "b" in "/search?a=1&b=a+b", or NULL if there is
+ * none (or its value is encoded invalidly). A parameter without an '=' has the
+ * value "". Names are matched exactly, including case.
+ * 
+ * Only the parameter found is decoded, into the same memory as
+ * `request_path` uses.
+ * 
+ * ```
+ * request_t *req = request_init("GET", "/search?q=cat%20pics&page=2", "HTTP/1.1");
+ * assert(strcmp(req->path, "/search") == 0);
+ * assert(strcmp(request_query_param(req, "q"), "cat pics") == 0);
+ * assert(request_query_param(req, "sort") == NULL);
+ * request_free(req);
+ * ```
+ */
+const char *request_query_param(request_t *req, const char *name);
+
+/**
+ * A decoded query parameter.
+ */
+typedef struct query_param {
+    const char *name;
+    const char *value;
+} query_param_t;
+
+/**
+ * Decodes all of the request's query parameters, in order, for handlers that
+ * want them all at once, storing how many there are in `count`. Parameters
+ * that are encoded invalidly are left out. The returned array is in the same
+ * memory as `request_path` uses, and is decoded again by each call.
+ */
+query_param_t *request_query_params(request_t *req, size_t *count);
+
+/**
+ * Iterates over the parameters in a query string (e.g., a request's `query`)
+ * without decoding or copying anything. Initialize one with `query_iter_init`.
+ */
+typedef struct query_iter {
+    const char *next;
+} query_iter_t;
+
+/**
+ * Starts iterating over the parameters in `query`, which may be NULL for no
+ * parameters. The query is borrowed and must outlive the iterator.
+ */
+void query_iter_init(query_iter_t *iter, const char *query);
+
+/**
+ * Moves to the next parameter in the query, storing views of its name and
+ * value, still encoded, in `name` and `value`, and returns true, or returns
+ * false if there are no more. Parameters are separated by '&', and empty ones
+ * are skipped.
+ * 
+ * ```
+ * query_iter_t iter;
+ * query_iter_init(&iter, "a=1&&b");
+ * str_view_t name, value;
+ * assert(query_iter_next(&iter, &name, &value) && name.len == 1 && value.len == 1);
+ * assert(query_iter_next(&iter, &name, &value) && name.ptr[0] == 'b' && value.len == 0);
+ * assert(!query_iter_next(&iter, &name, &value));
+ * ```
+ */
+bool query_iter_next(query_iter_t *iter, str_view_t *name, str_view_t *value);
+
+/**
+ * Decodes the percent-encoding in the `len` bytes at `src` into `dst`, which
+ * must have room for `len` bytes (decoding never makes a string longer), and
+ * returns the decoded length. If `form` is true, '+' is decoded as a space, as
+ * in query strings. Returns -1 if the encoding is invalid: a '%' not followed
+ * by two hex digits, or one that decodes to a null byte. `dst` is not
+ * null-terminated.
+ */
+ssize_t url_decode(char *dst, const char *src, size_t len, bool form);
+
+/**
+ * Initializes a parser for a new request.
+ */
+void request_parser_init(request_parser_t *parser);
+
+/**
+ * Continues parsing a request header, `buf` being everything received of it
+ * so far: the same bytes as were passed last time (though perhaps moved),
+ * followed by `len` minus however many that was new ones.
+ * 
+ * Returns PARSE_INCOMPLETE until the empty line that ends the header has been
+ * fed, and then PARSE_COMPLETE, after which `request_parser_length` and
+ * `request_parser_view` describe the header. Returns PARSE_ERROR as soon as
+ * the header is found to be malformed (see `request_view_parse` for what is
+ * expected), setting the parser's `error`. Once it has returned anything but
+ * PARSE_INCOMPLETE, it must not be fed again.
+ * 
+ * ```
+ * const char *header = "GET / HTTP/1.1\r\nHost: x\r\n\r\n";
+ * request_parser_t parser;
+ * request_parser_init(&parser);
+ * assert(request_parser_feed(&parser, header, 20) == PARSE_INCOMPLETE);
+ * assert(request_parser_feed(&parser, header, strlen(header)) == PARSE_COMPLETE);
+ * assert(request_parser_length(&parser) == strlen(header));
+ * request_parser_free(&parser);
+ * ```
+ */
+parse_status_t request_parser_feed(request_parser_t *parser, const char *buf, size_t len);
+
+/**
+ * Returns the length of a complete header, including the empty line at its
+ * end. Anything after it (e.g., the body) was left alone.
+ */
+size_t request_parser_length(const request_parser_t *parser);
+
+/**
+ * Fills `view` with views into `buf` of a complete header, `buf` being the
+ * header as last fed to the parser. The view must be freed with
+ * `request_view_free`.
+ */
+void request_parser_view(const request_parser_t *parser, const char *buf, request_view_t *view);
+
+/**
+ * Frees the headers a parser had to store on the heap, if any. The parser
+ * itself is not freed, and may be initialized again for the next request.
+ */
+void request_parser_free(request_parser_t *parser);
+
+/**
+ * Parses the request header in the `len` bytes at `contents` into `view`, in a
+ * single pass and without copying: the method, path, version and headers are
+ * all views into `contents`, which must outlive the view. Each header is
+ * tagged with its `known_header_t` as its name is parsed.
+ * 
+ * The first line should contain the method, path, and HTTP version separated
+ * by single spaces. Each following line should be a header, i.e., a name and
+ * value separated by a colon, and the header ends at the first empty line or
+ * at the end of `contents`. Lines end with '\r\n' (or a bare '\n'). Control
+ * characters other than tabs in header values are not allowed.
+ * 
+ * Returns false if the header is malformed. Either way, the view must be freed
+ * with `request_view_free`.
  * 
- * The function expects the contents to be a valid HTTP request with headers
- * separated by '\r\n'. The first line should contain the method, path, and
- * HTTP version separated by spaces. The headers should be key-value pairs
- * separated by a colon and a space.
+ * ```
+ * const char *header = "GET /cat HTTP/1.1\r\nHost: x\r\n\r\n";
+ * request_view_t view;
+ * assert(request_view_parse(header, strlen(header), &view));
+ * assert(view.path.len == 4 && memcmp(view.path.ptr, "/cat", 4) == 0);
+ * assert(request_view_header(&view, "host")->len == 1);
+ * request_view_free(&view);
+ * ```
+ */
+bool request_view_parse(const char *contents, size_t len, request_view_t *view);
+
+/**
+ * Returns the value of the first header called `name`, which is matched
+ * case-insensitively, or NULL if there is none. The returned view is owned by
+ * `view`.
+ */
+const str_view_t *request_view_header(const request_view_t *view, const char *name);
+
+/**
+ * Like `request_view_header`, for a known header, which the parser has
+ * already tagged with its ID, so that no names are compared.
+ */
+const str_view_t *request_view_known_header(const request_view_t *view, known_header_t id);
+
+/**
+ * Frees the headers of a view if they had to be stored on the heap. The view
+ * itself and the buffer it points into are not freed.
+ */
+void request_view_free(request_view_t *view);
+
+/**
+ * Creates a request struct holding copies of everything in `view`, e.g., to
+ * hand to a route handler once the view's buffer is going to be reused.
+ * Headers sent more than once keep all their values.
  * 
- * It should be terminated by an additional '\r\n' after the headers.
+ * The returned request should be freed using `request_free`.
+ */
+request_t *request_from_view(const request_view_t *view);
+
+/**
+ * Like `request_from_view`, but makes the request, its strings, and its
+ * headers in `arena`, so that it costs no calls to malloc and is released with
+ * the arena. `request_free` must still be called, for the body.
+ */
+request_t *request_from_view_arena(const request_view_t *view, arena_t *arena);
+
+/**
+ * Parses an HTTP request from the given string contents, creating a new request
+ * struct. This is `request_view_parse` followed by `request_from_view`; see the
+ * former for the format expected.
  * 
  * The contents string is borrowed and not touched or modified by this function 
  * and so it freeing it, if necessary, is the callers responsibility.
  * 
- * The returned request should be freed using `request_free` when it is no
- * longer needed.
+ * Only the header is parsed; the body, if any, is attached afterwards by
+ * whoever reads it from the connection.
+ * 
+ * Returns NULL if the request is malformed. Otherwise, the returned request
+ * should be freed using `request_free` when it is no longer needed.
  */
 request_t *request_parse(const char *contents);
 
@@ -2,6 +2,11 @@
 #define __HTTP_RESPONSE_H
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+#include "arena.h"
+#include "buffer.h"
 
 /**
  * An enumeration of supported HTTP response codes.
@@ -9,10 +14,12 @@
  * See https://developer.mozilla.org/en-US/docs/Web/HTTP/Status for more details.
  */
 typedef enum response_code {
-    HTTP_OK = 200,          // brief: OK
-    HTTP_BAD_REQUEST = 400, // brief: Bad Request
-    HTTP_FORBIDDEN = 403,   // brief: Forbidden
-    HTTP_NOT_FOUND = 404,   // brief: Not Found
+    HTTP_OK = 200,                        // brief: OK
+    HTTP_BAD_REQUEST = 400,               // brief: Bad Request
+    HTTP_FORBIDDEN = 403,                 // brief: Forbidden
+    HTTP_NOT_FOUND = 404,                 // brief: Not Found
+    HTTP_PAYLOAD_TOO_LARGE = 413,         // brief: Payload Too Large
+    HTTP_HEADER_FIELDS_TOO_LARGE = 431,   // brief: Request Header Fields Too Large
 } response_code_t;
 
 /**
@@ -28,24 +35,148 @@ typedef enum mime_type {
     MIME_OCTET_STREAM, // application/octet-stream
 } mime_type_t;
 
+/**
+ * Who a block's contents belong to, and so what `bytes_free` does with them.
+ */
+typedef enum bytes_kind {
+    BYTES_OWNED,    // `data` was malloc'd and is freed with the block
+    BYTES_BORROWED, // `data` outlives the block (e.g., a literal, or in an arena)
+    BYTES_FILE,     // the contents are in the file open at `fd`, which is closed
+    BYTES_SHARED,   // `data` is kept alive by a reference on `owner`
+} bytes_kind_t;
+
+/**
+ * A block of bytes. Blocks can be chained through `next` to form a response
+ * made of several segments (e.g., a formatted header followed by a body) which
+ * are sent back to back without being copied into one buffer.
+ * 
+ * A block is either in memory, at `data`, or, if `fd` is not -1, file-backed,
+ * in which case its contents are the `len` bytes of the file starting at
+ * `offset` and `data` is NULL. File-backed blocks are sent straight from the
+ * page cache with sendfile. `kind` says who the contents belong to.
+ * 
+ * A block with a non-NULL `stream` is a streamed response (see
+ * `response_type_format_stream`), whose contents are produced while it is
+ * being sent; its `len` is 0 and `data` is NULL. Likewise, one with a non-NULL
+ * `response` carries a built response (see `response_finish`), which is only
+ * formatted once it is sent.
+ * 
+ * A block made by one of the `_arena` functions has `arena` set, and its
+ * struct belongs to the arena rather than to the block: `bytes_free` leaves
+ * it be (though it still releases the contents, if they are the block's).
+ */
 typedef struct bytes {
     size_t len;
     char *data;
+    struct bytes *next;
+    int fd;
+    off_t offset;
+    struct response_stream *stream;
+    struct response *response;
+    arena_t *arena;
+    bytes_kind_t kind;
+    // for BYTES_SHARED, the reference-counted owner of `data`, and how to
+    // take another reference on it (if it can be; may be NULL) and drop one
+    void (*retain)(void *owner);
+    void (*release)(void *owner);
+    void *owner;
 } bytes_t;
 
+/**
+ * The body of a streamed response, which is produced a piece at a time as the
+ * previous pieces are sent, rather than formatted in full up front.
+ */
+typedef struct response_stream response_stream_t;
+
+/**
+ * Produces the next piece of a streamed response's body by calling
+ * `response_stream_write` on `stream` (any number of times), given the `state`
+ * the stream was created with.
+ * 
+ * Returns true if there is more to come, in which case it is called again
+ * once what it wrote has been sent, or false once the body is complete.
+ * 
+ * Producers are called on the server's event loop, so they must not block.
+ */
+typedef bool (*stream_producer_t)(response_stream_t *stream, void *state);
+
 /**
  * Returns an owned bytes struct which should be freed with bytes_free made from
- * data and len. 
+ * data and len. Its `next` segment is NULL.
  * 
  * Takes ownership of `data`.
  */
 bytes_t *bytes_init(size_t len, char *data);
 
 /**
- * Frees a heap-allocated `bytes_t` struct and its associated data.
+ * Like `bytes_init`, but makes the struct in `arena`, and borrows `data`,
+ * which must outlive it (e.g., because it is also in the arena, or a literal).
+ * The same as `bytes_init` if `arena` is NULL.
+ */
+bytes_t *bytes_init_arena(arena_t *arena, size_t len, char *data);
+
+/**
+ * Returns a bytes struct, in `arena` unless it is NULL, which borrows `data`
+ * whether or not there is an arena, e.g., a body which is a literal or a global
+ * and so can be sent to every client without being copied or freed.
+ */
+bytes_t *bytes_init_borrowed(arena_t *arena, size_t len, const char *data);
+
+/**
+ * Returns a bytes struct, in `arena` unless it is NULL, for `len` bytes at
+ * `data` which are kept alive by a reference on `owner` that the caller holds
+ * and hands over to the block. The block drops the reference, by calling
+ * `release(owner)`, once it is freed.
+ * 
+ * If `retain` isn't NULL, it takes another reference on `owner`, which the
+ * server uses to keep the bytes alive until they are sent, rather than copying
+ * whatever of them the client isn't ready for.
+ */
+bytes_t *bytes_init_shared(arena_t *arena, size_t len, const char *data, void (*retain)(void *),
+                           void (*release)(void *), void *owner);
+
+/**
+ * Returns a bytes struct, in `arena` unless it is NULL, for the contents of
+ * `buffer`, on which it takes a reference of its own (dropped when it is
+ * freed), so that the same buffer can be sent to any number of clients at
+ * once without being copied.
+ */
+bytes_t *bytes_init_buffer(arena_t *arena, buffer_t *buffer);
+
+/**
+ * Returns an owned, file-backed bytes struct for the `len` bytes of the file
+ * open at `fd` starting at `offset`.
+ * 
+ * Takes ownership of `fd`, which is closed by `bytes_free`.
+ */
+bytes_t *bytes_init_file(int fd, off_t offset, size_t len);
+
+/**
+ * Like `bytes_init_file`, but makes the struct in `arena` (unless it is NULL).
+ * The file is still closed by `bytes_free`.
+ */
+bytes_t *bytes_init_file_arena(arena_t *arena, int fd, off_t offset, size_t len);
+
+/**
+ * Frees a heap-allocated `bytes_t` struct and its associated data (or file),
+ * along with every segment chained after it. What happens to the data depends
+ * on the block's `kind`: it is freed if owned, left alone if borrowed, closed
+ * if it is a file and released if shared.
  */
 void bytes_free(bytes_t *bytes);
 
+/**
+ * Sets the time, in seconds since the epoch, given by the Date header of the
+ * responses formatted on the calling thread from now on.
+ *
+ * Every response carries Date and Server headers, which are kept formatted
+ * (once per second at most) per thread, so that adding them costs one copy.
+ * The server calls this from each worker's event-loop tick; a thread which
+ * never calls it instead checks the clock as it formats each response. Tests
+ * can call it to pin the date.
+ */
+void response_date_refresh(time_t now);
+
 /**
  * Returns an owned response for a given code and body.
  * 
@@ -56,11 +187,14 @@ void bytes_free(bytes_t *bytes);
  * If `type` refers to a "text/" MIME type, then `body` must be a pointer to a
  * null-terminated string (i.e., it should be a `char *`). In this case the
  * returned bytes' data field will be a pointer to a null-terminated string.
- * The `len` field will be the *byte* length of the string, including the null-
- * terminator.
+ * 
+ * The `len` field is always the number of bytes to send on the wire, i.e., the
+ * headers plus `Content-Length` bytes of body. It does not count the null-
+ * terminator, which is never sent since it would be read as the start of the
+ * next response on a persistent connection.
  * 
  * If `type` refers any other MIME type, then `body` must be be a pointer to a
- * `bytes_t` (i.e., it should be `bytes_t *`).
+ * `bytes_t` (i.e., it should be `bytes_t *`) held in memory.
  * 
  * The response is formatted as 
  * [HTTP Version] [Response code] [Response brief]\r\n
@@ -72,10 +206,192 @@ void bytes_free(bytes_t *bytes);
  * 
  * This function only supports HTTP/1.1 for version and outputs only the headers
  * Content-Type: [type]
+ * Date: [the current time, see `response_date_refresh`]
+ * Server: Personalized-Server
  * Content-Length: [length]
  * 
  * The human readable [Response briefs] are those documented in `response_code_t`.
  */
 bytes_t *response_type_format(response_code_t code, mime_type_t type, bytes_t *body);
 
+/**
+ * Like `response_type_format`, but formats the response in `arena` (e.g., the
+ * request's), so that it costs no calls to malloc. The same as
+ * `response_type_format` if `arena` is NULL.
+ */
+bytes_t *response_type_format_arena(arena_t *arena, response_code_t code, mime_type_t type, bytes_t *body);
+
+/**
+ * Like `response_type_format`, but only formats the status line and headers,
+ * and chains `body` after them as the response's second segment instead of
+ * copying it in. Takes ownership of `body`, which may be NULL for an empty
+ * body or file-backed; it is freed along with the response by `bytes_free`.
+ * 
+ * Use this for large bodies (e.g., files), where the copy would cost more than
+ * the response is worth.
+ */
+bytes_t *response_type_format_iov(response_code_t code, mime_type_t type, bytes_t *body);
+
+/**
+ * Like `response_type_format_iov`, but formats the headers in `arena` (unless
+ * it is NULL). `body` is still owned by the response.
+ */
+bytes_t *response_type_format_iov_arena(arena_t *arena, response_code_t code, mime_type_t type, bytes_t *body);
+
+/**
+ * Returns an owned response whose body is streamed: rather than being known up
+ * front, it is produced by calling `produce` with `state` over and over, each
+ * time the previous piece has been sent, until it returns false. Peak memory
+ * is therefore bounded by the size of one piece, not of the whole response,
+ * and the client starts receiving the body as soon as it is produced.
+ * 
+ * The status line and headers are sent right away. The body is sent with
+ * `Transfer-Encoding: chunked` to HTTP/1.1 clients, each write becoming one
+ * chunk, and as is, ended by closing the connection, to older ones.
+ * 
+ * `state` is owned by the response and freed with `state_free` (unless it is
+ * NULL) by `bytes_free`, whether or not the body was produced in full.
+ * 
+ * ```
+ * bool count_to_three(response_stream_t *stream, void *state) {
+ *     int *n = state;
+ *     *n += 1;
+ *     response_stream_write(stream, *n == 1 ? "1" : *n == 2 ? "2" : "3", 1);
+ *     return *n < 3;
+ * }
+ * 
+ * bytes_t *count_handler(request_t *req) {
+ *     int *n = calloc(1, sizeof(int));
+ *     return response_type_format_stream(HTTP_OK, MIME_PLAIN, count_to_three, n, free);
+ * }
+ * ```
+ */
+bytes_t *response_type_format_stream(response_code_t code, mime_type_t type, stream_producer_t produce, void *state, void (*state_free)(void *));
+
+/**
+ * Appends `len` bytes at `data` to the body of a streamed response, from its
+ * producer. `data` is borrowed (copied). Writes of zero bytes are ignored.
+ */
+void response_stream_write(response_stream_t *stream, const char *data, size_t len);
+
+/**
+ * Formats the status line and headers of a streamed response, choosing how its
+ * body is framed: with chunked transfer encoding if `chunked` is true, or
+ * otherwise as is, with `Connection: close`.
+ * 
+ * Used by the server, which must call this before `response_stream_next`.
+ */
+bytes_t *response_stream_header(response_stream_t *stream, bool chunked);
+
+/**
+ * Calls the stream's producer once and returns everything it wrote, framed for
+ * the wire, as an owned bytes. Sets `*done` once the producer has finished, in
+ * which case the returned bytes also end the body; the stream must not be
+ * advanced after that.
+ * 
+ * Used by the server, whenever the previous piece has been sent.
+ */
+bytes_t *response_stream_next(response_stream_t *stream, bool *done);
+
+/**
+ * A response being built up by a handler: a status, a Content-Type, any other
+ * headers the handler wants to send (e.g., Cache-Control), and a body made of
+ * any number of segments, each of which may be owned, borrowed, file-backed or
+ * shared (see `bytes_kind_t`). Nothing is formatted until the server sends the
+ * response, so the body is never copied, and the server can still add headers
+ * of its own (e.g., Connection).
+ * 
+ * ```
+ * bytes_t *hello_handler(request_t *req) {
+ *     response_t *resp = response_init(req->arena, HTTP_OK, MIME_HTML);
+ *     response_add_header(resp, "Cache-Control", "max-age=3600");
+ *     response_add_body_borrowed(resp, "Hello, world!", 13);
+ *     return response_finish(resp);
+ * }
+ * ```
+ */
+typedef struct response response_t;
+
+/**
+ * Starts building a response with the given status and Content-Type, in
+ * `arena` (e.g., the request's) unless it is NULL, in which case it is made on
+ * the heap. A response in an arena, along with its headers and the structs of
+ * its body segments, goes away with the arena, so it must be sent first.
+ * 
+ * Will crash via abort on an unsupported status code or type.
+ */
+response_t *response_init(arena_t *arena, response_code_t code, mime_type_t type);
+
+/**
+ * Adds the header `name: value` to the response, after those already added,
+ * copying both. The server sets Content-Type and Content-Length itself, so
+ * they shouldn't be added.
+ * 
+ * Returns false, adding nothing, if `name` isn't a valid header name or
+ * `value` contains a line break (which would let it inject headers of its
+ * own).
+ */
+bool response_add_header(response_t *resp, const char *name, const char *value);
+
+/**
+ * Appends `segment` (and any segments chained after it) to the response's
+ * body, taking ownership of it. It must not be a streamed response or carry a
+ * built one.
+ */
+void response_add_body(response_t *resp, bytes_t *segment);
+
+/**
+ * Appends the `len` bytes at `data`, which must outlive the response (e.g., a
+ * literal or a global), to the body without copying them.
+ */
+void response_add_body_borrowed(response_t *resp, const char *data, size_t len);
+
+/**
+ * Appends a copy of the `len` bytes at `data` (e.g., on the handler's stack)
+ * to the body, made in the response's arena if it has one.
+ */
+void response_add_body_copy(response_t *resp, const char *data, size_t len);
+
+/**
+ * Appends the `len` bytes of the file open at `fd` starting at `offset` to the
+ * body, taking ownership of `fd`. They are sent straight from the page cache.
+ */
+void response_add_body_file(response_t *resp, int fd, off_t offset, size_t len);
+
+/**
+ * Appends the contents of `buffer` to the body, without copying them, taking a
+ * reference on it (the caller keeps its own).
+ */
+void response_add_body_buffer(response_t *resp, buffer_t *buffer);
+
+/**
+ * Returns the number of bytes in the response's body so far.
+ */
+size_t response_body_length(const response_t *resp);
+
+/**
+ * Finishes building a response, returning a bytes struct (of no length) which
+ * carries it, for a handler to return. Takes ownership of `resp`, which is
+ * freed along with the bytes by `bytes_free` if it is never sent.
+ */
+bytes_t *response_finish(response_t *resp);
+
+/**
+ * Formats the status line and headers of the response `bytes` carries, if it
+ * carries one (see `response_finish`), and returns it ready to send: the
+ * header followed by the body's segments. The header is formatted in the
+ * response's arena if it has one. Frees `bytes` (but not the segments), and
+ * takes ownership of the response, which the returned bytes replace.
+ * 
+ * Any other bytes are returned as they are.
+ * 
+ * Used by the server, when it sends the response.
+ */
+bytes_t *response_serialize(bytes_t *bytes);
+
+/**
+ * Frees a response that was never finished, along with its body.
+ */
+void response_free(response_t *resp);
+
 #endif // __HTTP_RESPONSE_H
@@ -0,0 +1,66 @@
+#ifndef __HTTP_SERVER_H
+#define __HTTP_SERVER_H
+#include "router.h"
+#include "network_util.h"
+
+/**
+ * An HTTP server which accepts clients on a listening socket and serves all of
+ * them from a single event loop, dispatching each request through a router.
+ */
+typedef struct http_server http_server_t;
+
+/**
+ * Settings shared by every server (and worker) started with them.
+ */
+typedef struct http_server_options {
+    // event loop backend, see `nu_loop_init`
+    nu_backend_t backend;
+    // bytes of responses queued for a client beyond which the server stops
+    // reading its requests until they have been sent
+    size_t output_high_water;
+    // request bodies larger than this many bytes are spilled to a temporary
+    // file instead of being kept in memory (see `request_body_init`); the
+    // largest body accepted is set per route (see `router_set_max_body`)
+    size_t body_memory_limit;
+} http_server_options_t;
+
+/**
+ * Returns the default options: the epoll backend, a 1 MiB high-water mark, and
+ * bodies spilled to disk past 64 KiB.
+ */
+http_server_options_t http_server_default_options(void);
+
+/**
+ * Creates a server listening on `port` which answers requests using `router`,
+ * configured by `options`.
+ *
+ * The router is borrowed and must outlive the server.
+ *
+ * Returns NULL if the port could not be bound.
+ */
+http_server_t *http_server_init(int port, router_t *router, const http_server_options_t *options);
+
+/**
+ * Serves clients on the calling thread. This function only returns if the
+ * event loop fails.
+ */
+void http_server_run(http_server_t *server);
+
+/**
+ * Serves `port` with `num_workers` threads, each with its own listener (bound
+ * with SO_REUSEPORT so the kernel balances connections between them), its own
+ * event loop, and its own copy of `router`, all configured by `options`. The calling thread is
+ * one of the workers. Handlers may therefore be called concurrently and must
+ * be thread-safe.
+ *
+ * The router is borrowed. Returns -1 if the listeners could not be set up;
+ * otherwise only returns if the workers' event loops fail.
+ */
+int http_server_run_workers(int port, router_t *router, size_t num_workers, const http_server_options_t *options);
+
+/**
+ * Closes the listening socket and frees the server. The router is not freed.
+ */
+void http_server_free(http_server_t *server);
+
+#endif // __HTTP_SERVER_H
@@ -0,0 +1,72 @@
+#ifndef __KNOWN_HEADERS_H
+#define __KNOWN_HEADERS_H
+
+#include <stddef.h>
+
+/**
+ * The headers the server (or a typical handler) looks up by name, as
+ * X(id, name, first, last), `first` and `last` being the name's first and last
+ * letters in lowercase, from which its perfect hash is computed.
+ *
+ * Adding a header here is all it takes to make it known, as long as its hash
+ * doesn't collide with another's; the compiler warns about that (the table's
+ * initializer overrides an entry), and so does test_known_headers (in
+ * test_header_map).
+ */
+#define KNOWN_HEADERS(X)                                   \
+    X(HOST, "Host", 'h', 't')                              \
+    X(CONNECTION, "Connection", 'c', 'n')                  \
+    X(CONTENT_LENGTH, "Content-Length", 'c', 'h')          \
+    X(CONTENT_TYPE, "Content-Type", 'c', 'e')              \
+    X(TRANSFER_ENCODING, "Transfer-Encoding", 't', 'g')    \
+    X(EXPECT, "Expect", 'e', 't')                          \
+    X(ACCEPT, "Accept", 'a', 't')                          \
+    X(ACCEPT_ENCODING, "Accept-Encoding", 'a', 'g')        \
+    X(ACCEPT_LANGUAGE, "Accept-Language", 'a', 'e')        \
+    X(IF_NONE_MATCH, "If-None-Match", 'i', 'h')            \
+    X(IF_MODIFIED_SINCE, "If-Modified-Since", 'i', 'e')    \
+    X(RANGE, "Range", 'r', 'e')                            \
+    X(USER_AGENT, "User-Agent", 'u', 't')                  \
+    X(COOKIE, "Cookie", 'c', 'e')                          \
+    X(AUTHORIZATION, "Authorization", 'a', 'n')            \
+    X(CACHE_CONTROL, "Cache-Control", 'c', 'l')            \
+    X(UPGRADE, "Upgrade", 'u', 'e')                        \
+    X(REFERER, "Referer", 'r', 'r')
+
+#define KNOWN_HEADER_ID(id, name, first, last) HEADER_##id,
+
+/**
+ * Identifies a well-known header by its name, e.g., HEADER_CONTENT_LENGTH for
+ * "Content-Length", so that it can be found without comparing names.
+ * HEADER_UNKNOWN is any other header.
+ */
+typedef enum known_header {
+    HEADER_UNKNOWN,
+    KNOWN_HEADERS(KNOWN_HEADER_ID)
+    KNOWN_HEADERS_END, // one more than the last known header
+} known_header_t;
+
+#undef KNOWN_HEADER_ID
+
+/**
+ * Returns which known header the `len` bytes at `name` (not null-terminated)
+ * name, matched case-insensitively, or HEADER_UNKNOWN if none.
+ *
+ * Takes constant time however long the name: a perfect hash of its length and
+ * first and last letters picks the only known header it could be, and a
+ * single comparison checks whether it is.
+ *
+ * ```
+ * assert(known_header_lookup("content-length", 14) == HEADER_CONTENT_LENGTH);
+ * assert(known_header_lookup("X-Forwarded-For", 15) == HEADER_UNKNOWN);
+ * ```
+ */
+known_header_t known_header_lookup(const char *name, size_t len);
+
+/**
+ * Returns the name of a known header, as it is usually written, e.g.,
+ * "Content-Length".
+ */
+const char *known_header_name(known_header_t id);
+
+#endif /* __KNOWN_HEADERS_H */
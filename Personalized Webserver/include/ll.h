@@ -1,6 +1,7 @@
 #ifndef __LL__H
 #define __LL__H
 #include "mystr.h"
+#include "arena.h"
 
 typedef struct {
     char *key;
@@ -15,6 +16,16 @@ typedef struct ll_map ll_map_t;
  */
 ll_map_t *ll_init(void);
 
+/**
+ * Creates a new, empty dict whose nodes are allocated from `arena`, for a dict
+ * that lives no longer than the arena (e.g., a request's headers). Its keys and
+ * values should also come from the arena (e.g., via `arena_strndup`): the dict
+ * never frees them, so `ll_put` leaves replaced keys alone, and the old values
+ * it returns must not be freed either. `ll_free` does nothing for such a dict,
+ * which goes away when the arena is reset.
+ */
+ll_map_t *ll_init_arena(arena_t *arena);
+
 /**
  * Frees a string dict created by `ll_init` and all of its keys and values.
  */
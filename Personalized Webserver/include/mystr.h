@@ -2,12 +2,21 @@
 #define __MYSTR_H
 
 #include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include "strarray.h"
 
+/**
+ * The most separators `mystr_find_any` and the tokenizer accept at once.
+ */
+#define MYSTR_MAX_SEPS 8
+
 /**
  * Returns the index of the first occurrence of sep in str starting from start.
  * 
- * If sep is not found, returns -1.
+ * If sep is not found, returns -1. Only the part of `str` from `start` up to
+ * the match is looked at, with the C library's byte search (which picks the
+ * widest vector instructions the CPU has by itself).
  * 
  * Example:
  * ```
@@ -26,7 +35,149 @@ ssize_t mystr_indexof(const char *str, const char sep, size_t start);
  * The original string is not modified. The returned array and the strings
  * inside it are heap-allocated and should be freed by the caller using
  * `strarray_free` when they are no longer needed.
+ * 
+ * The strings are stored contiguously (see `strarray_init_contiguous`), so
+ * splitting takes a single allocation, however many pieces there are.
  */
 strarray_t *mystr_split(const char *str, const char sep);
 
+/**
+ * Splits a string into pieces like `mystr_split`, one piece at a time and
+ * without copying or allocating anything. Initialize one with
+ * `mystr_tokenizer_init` or `mystr_tokenizer_init_any`.
+ */
+typedef struct mystr_tokenizer {
+    const char *next;
+    const char *end;
+    char seps[MYSTR_MAX_SEPS + 1];
+} mystr_tokenizer_t;
+
+/**
+ * Starts splitting `str` on `sep`. The string is borrowed and must outlive
+ * the tokenizer.
+ */
+void mystr_tokenizer_init(mystr_tokenizer_t *tok, const char *str, const char sep);
+
+/**
+ * Starts splitting `str` on any of the (at most MYSTR_MAX_SEPS) characters in
+ * the string `seps`, e.g., ", \t" for a list in a header value.
+ * 
+ * ```
+ * mystr_tokenizer_t tok;
+ * mystr_tokenizer_init_any(&tok, "keep-alive, Upgrade", ", ");
+ * const char *token;
+ * size_t len;
+ * assert(mystr_next_token(&tok, &token, &len) && len == 10);
+ * assert(mystr_next_token(&tok, &token, &len) && len == 7);
+ * assert(!mystr_next_token(&tok, &token, &len));
+ * ```
+ */
+void mystr_tokenizer_init_any(mystr_tokenizer_t *tok, const char *str, const char *seps);
+
+/**
+ * Finds the next piece of the string, storing where it starts in `token` and
+ * its length in `len` (it isn't null-terminated), and returns true, or returns
+ * false once there are no more. Like `mystr_split`, never finds empty pieces.
+ * 
+ * ```
+ * mystr_tokenizer_t tok;
+ * mystr_tokenizer_init(&tok, "  to be ", ' ');
+ * const char *token;
+ * size_t len;
+ * assert(mystr_next_token(&tok, &token, &len) && len == 2 && strncmp(token, "to", 2) == 0);
+ * assert(mystr_next_token(&tok, &token, &len) && len == 2 && strncmp(token, "be", 2) == 0);
+ * assert(!mystr_next_token(&tok, &token, &len));
+ * ```
+ */
+bool mystr_next_token(mystr_tokenizer_t *tok, const char **token, size_t *len);
+
+/**
+ * The most digits `mystr_utoa` writes, for UINT64_MAX.
+ */
+#define MYSTR_UTOA_MAX 20
+
+/**
+ * Returns how many digits `n` has in base 10 (1 for 0).
+ */
+size_t mystr_utoa_length(uint64_t n);
+
+/**
+ * Writes `n` in base 10 to `dst`, which must have room for
+ * `mystr_utoa_length(n)` (at most MYSTR_UTOA_MAX) bytes, and returns how many
+ * it wrote. Doesn't null-terminate, so that it can write into the middle of a
+ * buffer, e.g., a Content-Length header being formatted.
+ *
+ * Much cheaper than `snprintf`: the digits are written two at a time, from a
+ * table, straight into place.
+ *
+ * ```
+ * char buf[MYSTR_UTOA_MAX + 1];
+ * buf[mystr_utoa(buf, 1234)] = '\0';
+ * assert(strcmp(buf, "1234") == 0);
+ * ```
+ */
+size_t mystr_utoa(char *dst, uint64_t n);
+
+/*
+ * The kernels below sit under request parsing and header lookup. Each has a
+ * scalar version and SSE2 and AVX2 ones, which look at 16 or 32 bytes at a
+ * time; the first call picks the fastest one the CPU supports (see
+ * `mystr_impl`).
+ */
+
+/**
+ * Returns the index of the first of the `len` bytes at `buf` which is one of
+ * the (at most MYSTR_MAX_SEPS) characters in the string `seps`, or `len` if
+ * there is none.
+ * 
+ * ```
+ * assert(mystr_find_any("a=1&b=2;c", 9, "&;") == 3);
+ * assert(mystr_find_any("abc", 3, "&;") == 3);
+ * ```
+ */
+size_t mystr_find_any(const char *buf, size_t len, const char *seps);
+
+/**
+ * Returns whether the `len` bytes at `a` and `b` are the same, ignoring the
+ * case of ASCII letters, as header names are compared. Unlike `strncasecmp`,
+ * doesn't stop at a null byte, and never depends on the locale.
+ * 
+ * ```
+ * assert(mystr_equal_nocase("Content-Length", "content-LENGTH", 14));
+ * assert(!mystr_equal_nocase("Content-Length", "Content_Length", 14));
+ * ```
+ */
+bool mystr_equal_nocase(const char *a, const char *b, size_t len);
+
+/**
+ * Returns the number of bytes at the front of the `len` bytes at `buf` which
+ * are token characters, i.e., may appear in a method or a header name (RFC
+ * 9110's `tchar`: letters, digits, and !#$%&'*+-.^_`|~), or `len` if they all
+ * are.
+ * 
+ * ```
+ * assert(mystr_token_length("Content-Length: 5", 17) == 14);
+ * assert(mystr_token_length("X(Y)", 4) == 1);
+ * ```
+ */
+size_t mystr_token_length(const char *buf, size_t len);
+
+/**
+ * Returns the name of the implementation ("scalar", "sse2" or "avx2") the
+ * kernels use.
+ */
+const char *mystr_impl(void);
+
+/**
+ * Returns whether the named implementation can run on this CPU.
+ */
+bool mystr_impl_supported(const char *impl);
+
+/**
+ * Makes the kernels use the named implementation from now on, e.g., to test
+ * or benchmark each of them. Returns false, changing nothing, if it can't run
+ * on this CPU.
+ */
+bool mystr_set_impl(const char *impl);
+
 #endif /* __MYSTR_H */
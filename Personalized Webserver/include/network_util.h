@@ -4,10 +4,56 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
 
 
 typedef struct connection connection_t;
 
+/**
+ * A long-lived listening socket. Created once with `nu_listen` and then used to
+ * accept any number of clients with `nu_accept` or `nu_wait_clients`.
+ **/
+typedef struct nu_listener nu_listener_t;
+
+/**
+ * An epoll-based event loop. Connections and listeners registered with it are
+ * serviced from a single thread, with their handlers invoked whenever the
+ * kernel reports them ready.
+ **/
+typedef struct nu_loop nu_loop_t;
+
+/**
+ * The kernel interface an event loop is built on.
+ **/
+typedef enum nu_backend {
+    // readiness notifications, with the handlers doing their own reads/writes
+    NU_BACKEND_EPOLL,
+    // io_uring, with accepts, receives, sends and closes submitted in batches
+    NU_BACKEND_URING,
+} nu_backend_t;
+
+/**
+ * Handler invoked by the event loop when conn becomes readable or writable.
+ * `aux` is the pointer given to `nu_loop_add`.
+ *
+ * Connections are registered edge-triggered, so the handler must read (or
+ * write) until the socket would block, or it will not be called again.
+ **/
+typedef void (*nu_conn_handler_t)(nu_loop_t *loop, connection_t *conn, void *aux);
+
+/**
+ * Handler invoked by the event loop when listener has clients waiting to be
+ * accepted. `aux` is the pointer given to `nu_loop_add_listener`.
+ **/
+typedef void (*nu_accept_handler_t)(nu_loop_t *loop, nu_listener_t *listener, void *aux);
+
+/**
+ * Handler invoked periodically by the event loop, see `nu_loop_set_tick`.
+ **/
+typedef void (*nu_tick_handler_t)(nu_loop_t *loop, void *aux);
+
 /**
  * TODO: put docs here
  **/
@@ -17,9 +63,48 @@ typedef void nu_callback(int fd, char *str);
  * Listens on localhost:port for a single client connection.
  * This function is blocking (i.e., it waits for a client to
  * connect before returning).
+ *
+ * The listening socket only exists for the duration of the call, so clients
+ * connecting between calls are refused. Servers should use `nu_listen` instead.
  **/
 connection_t *nu_wait_client(int port);
 
+/**
+ * Opens a listening socket on port which stays open until `nu_listener_free`.
+ * Clients that connect while the server is busy are queued in the kernel's
+ * backlog rather than refused.
+ *
+ * Returns NULL if the socket could not be bound.
+ **/
+nu_listener_t *nu_listen(int port);
+
+/**
+ * Like `nu_listen`, but sets SO_REUSEPORT so that several listeners, e.g., one
+ * per worker thread, can be bound to the same port. The kernel then spreads
+ * incoming connections across them.
+ **/
+nu_listener_t *nu_listen_shared(int port);
+
+/**
+ * Accepts up to `max_clients` pending connections from listener without
+ * blocking, storing them in `clients`. Accepted sockets are non-blocking and
+ * close-on-exec.
+ *
+ * Returns the number of connections accepted, which is 0 if none were pending.
+ * The connections are owned by the caller and closed with nu_close_connection.
+ **/
+size_t nu_accept(nu_listener_t *listener, connection_t **clients, size_t max_clients);
+
+/**
+ * Like `nu_accept`, but blocks until at least one client has connected.
+ **/
+size_t nu_wait_clients(nu_listener_t *listener, connection_t **clients, size_t max_clients);
+
+/**
+ * Closes the listening socket and frees the listener.
+ **/
+void nu_listener_free(nu_listener_t *listener);
+
 /**
  * Opens a client connection to the server pointed to by ip:port.
  * This function assumes that the server has already called nu_wait_client.
@@ -47,9 +132,142 @@ char *nu_read_header(connection_t *conn);
 
 /**
  * Sends bytes to the open connection represented by conn.
+ *
+ * On a connection registered with a loop, whatever the socket doesn't take
+ * right away is copied and queued, and the loop sends it in order.
  */
 int nu_send_bytes(connection_t *conn, const char *bytes, size_t bytes_len);
 
+/**
+ * Sends the `iov_len` segments of iov to conn back to back with a single
+ * gathering write, resuming after partial writes until everything is sent.
+ * The segments are sent from where they are, without being copied together
+ * first. The iov array itself is modified as the write progresses.
+ *
+ * On a connection registered with a loop this never blocks: whatever the
+ * socket doesn't take right away is copied onto the connection's output queue
+ * and sent by the loop once there is room (see `nu_pending_output`). The io_uring
+ * backend queues everything.
+ *
+ * Returns the number of bytes sent or queued, or -1 on error. Once a send has
+ * failed, every later one on the connection fails too.
+ */
+ssize_t nu_send_iov(connection_t *conn, struct iovec *iov, size_t iov_len);
+
+/**
+ * A reference on the memory behind a segment being sent (e.g., a cached body
+ * shared by many connections), which lets the output queue keep the memory
+ * alive, by calling `retain` on `owner`, instead of copying it. The queue calls
+ * `release` on `owner` once it has sent the segment.
+ **/
+typedef struct nu_ref {
+    void (*retain)(void *owner);
+    void (*release)(void *owner);
+    void *owner;
+} nu_ref_t;
+
+/**
+ * Like `nu_send_iov`, but whatever the socket doesn't take right away of a
+ * segment iov[i] whose refs[i].owner is not NULL is queued by reference rather
+ * than copied. `refs` has one entry per segment, or is NULL for none. Once this
+ * returns, the caller may drop its own references.
+ */
+ssize_t nu_send_iov_refs(connection_t *conn, struct iovec *iov, const nu_ref_t *refs, size_t iov_len);
+
+/**
+ * Sends the segments of iov (e.g., response headers) followed by `len` bytes of
+ * the file open at fd, starting at `offset`. The headers are sent with MSG_MORE
+ * so they are held back and leave together with the start of the file, which
+ * is then sent with sendfile (or splice, if fd is a pipe) directly from the
+ * page cache without passing through user space. fd is not closed. The iov
+ * array is modified as the write progresses.
+ *
+ * On a connection registered with an epoll loop, whatever doesn't fit in the
+ * socket is queued as for `nu_send_iov`, with the file's remainder queued by
+ * reference (on a duplicate of fd) and sent with sendfile later. On an io_uring
+ * loop, the headers and file are read into one queued buffer instead.
+ *
+ * Returns the number of bytes sent or queued, or -1 on error.
+ */
+ssize_t nu_send_file(connection_t *conn, struct iovec *iov, size_t iov_len, int fd, off_t offset, size_t len);
+
+/**
+ * Like `nu_send_file`, with references for the segments of iov as for
+ * `nu_send_iov_refs`.
+ */
+ssize_t nu_send_file_refs(connection_t *conn, struct iovec *iov, const nu_ref_t *refs, size_t iov_len,
+                          int fd, off_t offset, size_t len);
+
+/**
+ * Returns the number of bytes queued on conn which the loop has yet to send.
+ * Servers can stop reading requests from a client while this is high, and pick
+ * up again from on_writable once it has drained.
+ */
+size_t nu_pending_output(connection_t *conn);
+
+/**
+ * Returns how many bytes of conn's queued output have been sent so far. If it
+ * hasn't changed over some time while output is pending, the peer has
+ * stopped reading.
+ */
+uint64_t nu_output_progress(connection_t *conn);
+
+/**
+ * Reads whatever the peer has sent on a non-blocking connection into conn's
+ * input buffer, stopping once the socket would block or the buffer is full.
+ *
+ * The input buffer is only allocated while it holds unconsumed bytes. It
+ * starts at 2 KB (taken from a pool kept by the connection's loop), grows
+ * while a header doesn't fit, up to 16 KB, and is given back as soon as
+ * everything in it has been consumed, so idle connections cost no buffer.
+ *
+ * Returns the number of bytes read, which is 0 if nothing was available, or -1
+ * once the peer has closed the connection or on error.
+ *
+ * On a connection registered with an io_uring loop, this takes the bytes the
+ * loop has already received instead of reading from the socket.
+ **/
+ssize_t nu_recv(connection_t *conn);
+
+/**
+ * Removes a "\r\n\r\n" terminated header from the front of conn's input
+ * buffer, if a complete one has been received. Never reads from the socket.
+ *
+ * Returns the header as a heap-allocated string including its terminator, or
+ * NULL if no complete header is buffered.
+ **/
+char *nu_take_header(connection_t *conn);
+
+/**
+ * Like `nu_take_header`, but returns the header where it is in conn's input
+ * buffer instead of copying it out, storing its length (including the
+ * terminator) in header_len. The header is NUL-terminated in place so that it
+ * can be parsed as a string.
+ *
+ * The header stays at the front of the buffer until `nu_consume_input` is
+ * called, which must happen before conn is read from again.
+ **/
+char *nu_peek_header(connection_t *conn, size_t *header_len);
+
+/**
+ * Returns the bytes in conn's input buffer, e.g., the start of a request body,
+ * storing how many there are in len, or NULL if it is empty. The bytes stay
+ * buffered until they are consumed with `nu_consume_input`.
+ **/
+char *nu_peek_input(connection_t *conn, size_t *len);
+
+/**
+ * Discards `amount` bytes from the front of conn's input buffer, e.g., a header
+ * returned by `nu_peek_header` once it has been parsed.
+ **/
+void nu_consume_input(connection_t *conn, size_t amount);
+
+/**
+ * Returns whether conn's input buffer is full, i.e., whether `nu_recv` cannot
+ * make progress until something is taken out of it.
+ **/
+bool nu_input_full(connection_t *conn);
+
 /**
  * Attempts to read a block of bytes from the connection represented by conn.
  * This function will block if it receives some bytes but less than the requested
@@ -77,4 +295,102 @@ int nu_multiplex(connection_t *local, connection_t *remote, nu_callback on_local
  **/
 void nu_close_connection(connection_t *conn);
 
+/**
+ * Creates a new event loop on the given backend, or returns NULL on failure.
+ * If io_uring is requested but the kernel doesn't support it, the loop falls
+ * back to epoll.
+ **/
+nu_loop_t *nu_loop_init(nu_backend_t backend);
+
+/**
+ * Returns the backend the loop actually runs on.
+ **/
+nu_backend_t nu_loop_backend(nu_loop_t *loop);
+
+/**
+ * Registers listener with the loop so that on_accept is called whenever
+ * clients are waiting. Returns 0 on success or -1 on error.
+ **/
+int nu_loop_add_listener(nu_loop_t *loop, nu_listener_t *listener, nu_accept_handler_t on_accept, void *aux);
+
+/**
+ * Registers a non-blocking connection with the loop. on_readable is called
+ * when data (or a hangup) arrives and on_writable once the connection's output
+ * queue has been sent (or a queued send has failed); either may be NULL.
+ * Returns 0 on success or -1 on error.
+ *
+ * Once registered, the connection must be closed with `nu_loop_close` rather
+ * than `nu_close_connection`.
+ **/
+int nu_loop_add(nu_loop_t *loop, connection_t *conn, nu_conn_handler_t on_readable, nu_conn_handler_t on_writable, void *aux);
+
+/**
+ * Closes a connection registered with the loop. It is safe to call from within
+ * the connection's own handlers; no further handlers are invoked for it and it
+ * is freed once the current batch of events has been dispatched.
+ *
+ * Output still queued is sent before the socket is closed, unless the client
+ * takes too long to read it.
+ **/
+void nu_loop_close(nu_loop_t *loop, connection_t *conn);
+
+/**
+ * Like `nu_loop_close`, but closes the connection gracefully, for when the
+ * peer may still be sending, e.g., after answering a request with an error
+ * before reading all of it. Once the queued output has been sent, the
+ * connection is shut down for writing, and whatever more the peer sends is
+ * read and thrown away until it closes its end (or for a couple of seconds at
+ * most). Only then is the socket closed: closing it with input unread would
+ * make the kernel reset the connection, which can destroy the last response
+ * before the peer has read it.
+ **/
+void nu_loop_shutdown(nu_loop_t *loop, connection_t *conn);
+
+/**
+ * Like `nu_loop_close`, but discards any output still queued instead of
+ * waiting for the peer to read it, e.g., to get rid of a client which has
+ * stopped reading.
+ **/
+void nu_loop_abort(nu_loop_t *loop, connection_t *conn);
+
+/**
+ * Runs the loop on the calling thread, dispatching events until `nu_loop_stop`
+ * is called from a handler.
+ **/
+void nu_loop_run(nu_loop_t *loop);
+
+/**
+ * Arranges for on_tick to be called roughly every interval_ms while the loop
+ * runs, e.g., to expire idle connections. Replaces any previous tick handler.
+ **/
+void nu_loop_set_tick(nu_loop_t *loop, int interval_ms, nu_tick_handler_t on_tick, void *aux);
+
+/**
+ * Arranges for on_timeout to be called if timeout_ms milliseconds pass before
+ * this is called again for conn, which must be registered with a loop. Each
+ * call replaces the previous deadline, so a handler can push it back whenever
+ * the connection makes progress; a negative timeout_ms cancels it. Closing the
+ * connection cancels it too.
+ *
+ * Deadlines are kept in a timer wheel, so setting one takes constant time
+ * however many connections there are.
+ **/
+void nu_set_timeout(connection_t *conn, int timeout_ms, nu_conn_handler_t on_timeout);
+
+/**
+ * Returns the loop's monotonic clock in milliseconds. The clock is read once
+ * each time the loop wakes up, so this is free to call from handlers.
+ **/
+uint64_t nu_loop_now(nu_loop_t *loop);
+
+/**
+ * Makes `nu_loop_run` return after the current batch of events.
+ **/
+void nu_loop_stop(nu_loop_t *loop);
+
+/**
+ * Frees the loop. Registered listeners are not closed.
+ **/
+void nu_loop_free(nu_loop_t *loop);
+
 #endif /* __NETWORK_UTIL_H */
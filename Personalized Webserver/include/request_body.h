@@ -0,0 +1,77 @@
+#ifndef __REQUEST_BODY_H
+#define __REQUEST_BODY_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+/**
+ * The body of an HTTP request, decoded incrementally as it arrives on the
+ * connection and then read back by the handler.
+ *
+ * Bodies sent with `Content-Length` are taken as is, and bodies sent with
+ * `Transfer-Encoding: chunked` are decoded as they are fed in, so the handler
+ * only ever sees the payload. The payload is kept in memory while it is small,
+ * and moved to an anonymous temporary file once it grows past the memory limit
+ * it was created with, so that large uploads are never held in RAM.
+ */
+typedef struct request_body request_body_t;
+
+/**
+ * The state of a body after feeding it more bytes.
+ */
+typedef enum body_status {
+    BODY_INCOMPLETE, // more bytes are needed
+    BODY_COMPLETE,   // the whole body has been received
+    BODY_TOO_LARGE,  // the body is longer than the maximum it was created with,
+                     // or its chunk extensions and trailers are too long
+    BODY_INVALID,    // the chunked encoding is malformed
+    BODY_IO_ERROR,   // the body couldn't be written to its temporary file
+} body_status_t;
+
+/**
+ * Creates an empty body of `content_length` bytes, or, if `chunked` is true, of
+ * a chunked body whose length is only known once its last chunk arrives.
+ *
+ * Bodies longer than `max_len` bytes are rejected with BODY_TOO_LARGE. Once
+ * more than `memory_limit` bytes have been received, they are spilled to a
+ * temporary file; pass SIZE_MAX to always keep bodies in memory.
+ */
+request_body_t *request_body_init(bool chunked, size_t content_length, size_t max_len, size_t memory_limit);
+
+/**
+ * Feeds up to `len` raw bytes received on the connection, decoding them if the
+ * body is chunked. Stops at the end of the body, so that anything after it
+ * (e.g., the next pipelined request) is left alone.
+ *
+ * Stores the number of bytes used in `*consumed` and returns the body's state.
+ * Once the body is no longer BODY_INCOMPLETE, it must not be fed again.
+ */
+body_status_t request_body_feed(request_body_t *body, const char *data, size_t len, size_t *consumed);
+
+/**
+ * Returns the number of payload bytes received so far, which is the length of
+ * the whole body once it is complete.
+ */
+size_t request_body_length(request_body_t *body);
+
+/**
+ * Returns whether the body has been spilled to a temporary file.
+ */
+bool request_body_spilled(request_body_t *body);
+
+/**
+ * Reads up to `len` bytes of the payload into `buf`, continuing where the last
+ * read left off, so a handler can process a large body piece by piece.
+ *
+ * Returns the number of bytes read, 0 at the end of the body, or -1 on error.
+ */
+ssize_t request_body_read(request_body_t *body, char *buf, size_t len);
+
+/**
+ * Frees the body, deleting its temporary file, if any.
+ */
+void request_body_free(request_body_t *body);
+
+#endif /* __REQUEST_BODY_H */
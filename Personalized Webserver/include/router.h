@@ -18,10 +18,18 @@ typedef struct router router_t;
  * Represents a handler for a given route.
  * 
  * It accepts a request, borrowing it, and returns a owned bytes
- * which should be responded with.
+ * which should be responded with: a formatted response, or one built with a
+ * `response_t` and finished with `response_finish`, which the server formats
+ * when it sends it.
  */
 typedef bytes_t *(*route_handler_t)(request_t *);
 
+/**
+ * The largest request body, in bytes, that routes accept unless configured
+ * otherwise with `router_set_max_body`.
+ */
+#define ROUTER_DEFAULT_MAX_BODY (1 << 20)
+
 /**
  * Initialize a router with a fallback handler, which will be called on all
  * requests which don't match a registered path.
@@ -48,10 +56,27 @@ router_t *router_init(size_t max_routes, route_handler_t fallback_handler);
  */
 void router_register(router_t *router, const char *path, route_handler_t handler);
 
+/**
+ * Sets the largest request body, in bytes, that the server accepts for the
+ * registered route `path`, or for the fallback handler if `path` is NULL.
+ * Requests with larger bodies are answered with 413 Payload Too Large without
+ * reaching the handler. Does nothing if `path` hasn't been registered.
+ */
+void router_set_max_body(router_t *router, const char *path, size_t max_body);
+
+/**
+ * Returns the largest request body accepted for requests to `path`, i.e., the
+ * limit of the route it would be dispatched to.
+ */
+size_t router_max_body(router_t *router, const char *path);
+
 /**
  * Dispatch a request to the matching route handler, or the fallback if none
  * exists. Dispatching, here, simply means invoking the previously registered
  * route handler and returning the result, which is an owned array of bytes.
+ *
+ * Routes are matched against the request's decoded path (see `request_path`),
+ * so "/hello?x=1" and "/h%65llo" both go to "/hello".
  * 
  * If the set handler returns `NULL,` the the request is instead sent to the
  * fallback handler.
@@ -60,6 +85,13 @@ void router_register(router_t *router, const char *path, route_handler_t handler
  */
 bytes_t *router_dispatch(router_t *router, request_t *request);
 
+/**
+ * Returns a new router with the same fallback, capacity, routes, and body size
+ * limits as `router`, e.g., so that each worker thread can dispatch on its own
+ * copy. The copy must be freed separately with `router_free`.
+ */
+router_t *router_copy(router_t *router);
+
 /**
  * Frees all resources associated with the router. Note that function pointers
  * are pointers to code, which is owned by the program like a string literal,
@@ -2,6 +2,7 @@
 #define __STRARRAY_H
 
 #include <stddef.h>
+#include <stdbool.h>
 
 /**
  * A dynamically-sized array of strings.
@@ -12,10 +13,16 @@
  * The `length` field is the number of strings in the array.
  * 
  * All the strings and the array itself are heap-allocated and should be freed.
+ * 
+ * An array made by `strarray_init_contiguous` instead keeps everything in one
+ * allocation: the struct, followed by the `data` array, followed by the
+ * strings, and has `contiguous` set. It is still freed by `strarray_free`, but
+ * its strings can't be freed or replaced one by one.
  */
 typedef struct strarray {
     char **data;
     size_t length;
+    bool contiguous;
 } strarray_t;
 
 /**
@@ -32,12 +39,34 @@ typedef struct strarray {
  */
 strarray_t *strarray_init(size_t length);
 
+/**
+ * Allocates a new strarray_t with the given length whose strings are stored
+ * together, in the `size` bytes stored in `storage`, all in a single call to
+ * malloc.
+ * 
+ * The strings in `data` are initialized to NULL; the caller copies its strings
+ * (with their null-terminators) into `storage` and points `data` at them.
+ * 
+ * ```
+ * char *storage;
+ * strarray_t *arr = strarray_init_contiguous(2, 6, &storage);
+ * memcpy(storage, "ab\0cd", 6);
+ * arr->data[0] = storage;
+ * arr->data[1] = storage + 3;
+ * strarray_free(arr);
+ * ```
+ */
+strarray_t *strarray_init_contiguous(size_t length, size_t size, char **storage);
+
 /**
  * Frees the given strarray_t, it's data, and all the strings inside it.
  * 
  * Each string in the array is freed using free, then the data pointer, and
  * finally the struct itself. Note that this means it is invalid to call this
  * function on a strarray_t which has elements that were not heap-allocated.
+ * 
+ * An array made by `strarray_init_contiguous` (i.e., with `contiguous` set) is
+ * freed all at once instead.
  */
 void strarray_free(strarray_t *arr);
 
@@ -26,8 +26,8 @@ bool isclose(double d1, double d2);
  */
 bool streq(const char *s1, const char *s2);
 #define assert_streq(S1, S2) do { \
-    char *s1 = S1; \
-    char *s2 = S2; \
+    const char *s1 = S1; \
+    const char *s2 = S2; \
     if (s1 == NULL) {\
         fprintf(stderr, "%s:%d: %s: Assertion `%s != NULL` failed", __FILE__, __LINE__, __func__, #S1); \
         abort(); \
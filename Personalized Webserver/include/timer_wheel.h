@@ -0,0 +1,99 @@
+#ifndef __TIMER_WHEEL_H
+#define __TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * A hierarchical timer wheel: a set of timers, each due at some tick, which
+ * are fired as the wheel's clock is advanced.
+ *
+ * Scheduling and cancelling a timer take constant time, however many timers
+ * there are, and so does advancing the clock past stretches with nothing due.
+ * That makes it cheap to keep a deadline on every connection and to push it
+ * back each time the connection makes progress.
+ *
+ * Ticks are whatever unit the caller advances the clock in (the event loop
+ * uses milliseconds).
+ */
+typedef struct timer_wheel timer_wheel_t;
+
+typedef struct wheel_timer wheel_timer_t;
+
+/**
+ * Called with the timer and its `aux` when the timer fires. The timer is no
+ * longer scheduled by then, so the callback may schedule it again.
+ */
+typedef void (*wheel_timer_fn_t)(wheel_timer_t *timer, void *aux);
+
+/**
+ * A timer, embedded in whatever it times out (e.g., a connection) so that
+ * scheduling it never allocates. Its fields are managed by the wheel.
+ */
+struct wheel_timer {
+    uint64_t deadline;
+    wheel_timer_fn_t fn;
+    void *aux;
+    bool pending;
+    unsigned char level;
+    unsigned char slot;
+    struct wheel_timer *prev;
+    struct wheel_timer *next;
+};
+
+/**
+ * Creates an empty wheel whose clock starts at `now`.
+ */
+timer_wheel_t *timer_wheel_init(uint64_t now);
+
+/**
+ * Initializes a timer which calls `fn` with `aux` when it fires. The timer
+ * starts out unscheduled.
+ */
+void wheel_timer_init(wheel_timer_t *timer, wheel_timer_fn_t fn, void *aux);
+
+/**
+ * Returns whether the timer is scheduled, i.e., has yet to fire or be
+ * cancelled.
+ */
+bool wheel_timer_pending(const wheel_timer_t *timer);
+
+/**
+ * Schedules the timer to fire once the wheel's clock reaches `deadline`,
+ * moving it if it was already scheduled. A deadline that has already passed
+ * fires on the next advance.
+ */
+void timer_wheel_schedule(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t deadline);
+
+/**
+ * Unschedules the timer, if it is scheduled.
+ */
+void timer_wheel_cancel(timer_wheel_t *wheel, wheel_timer_t *timer);
+
+/**
+ * Advances the wheel's clock to `now`, firing every timer due by then, earliest
+ * first. Does nothing if `now` is not past the wheel's clock.
+ */
+void timer_wheel_advance(timer_wheel_t *wheel, uint64_t now);
+
+/**
+ * Returns the wheel's clock, i.e., the last time it was advanced to.
+ */
+uint64_t timer_wheel_now(timer_wheel_t *wheel);
+
+/**
+ * Returns the tick by which the wheel should next be advanced: never later
+ * than the earliest deadline, but possibly earlier, when timers due further
+ * out need to be filed closer. Returns UINT64_MAX if no timers are scheduled.
+ *
+ * This is how long an event loop may sleep.
+ */
+uint64_t timer_wheel_next(timer_wheel_t *wheel);
+
+/**
+ * Frees the wheel. Timers still scheduled are unscheduled, but not freed,
+ * since they belong to their owners.
+ */
+void timer_wheel_free(timer_wheel_t *wheel);
+
+#endif /* __TIMER_WHEEL_H */
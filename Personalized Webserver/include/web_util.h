@@ -10,6 +10,7 @@
 
 char *wutil_get_filename_ext(const char *filename);
 ssize_t wutil_get_file_size(FILE *f);
+int wutil_open_file(const char *path, size_t *size);
 char *wutil_get_resolved_path(request_t *request);
 response_code_t wutil_check_resolved_path(char* resolved_path);
 mime_type_t wutil_get_mime_from_extension(char *ext);
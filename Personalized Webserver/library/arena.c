@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdalign.h>
+#include <assert.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    alignas(ARENA_ALIGN) char data[];
+} arena_chunk_t;
+
+struct arena {
+    size_t chunk_size;
+    // the chunks allocated from since the last reset, the current one first
+    arena_chunk_t *used;
+    // chunks kept from before the last reset, to be used again
+    arena_chunk_t *spare;
+    // blocks for allocations too big for a chunk
+    arena_chunk_t *large;
+    // the free part of the current chunk
+    char *next;
+    char *end;
+};
+
+arena_t *arena_init(size_t chunk_size) {
+    arena_t *arena = malloc(sizeof(arena_t));
+    assert(arena);
+    arena->chunk_size = chunk_size;
+    arena->used = NULL;
+    arena->spare = NULL;
+    arena->large = NULL;
+    arena->next = NULL;
+    arena->end = NULL;
+    return arena;
+}
+
+static arena_chunk_t *chunk_alloc(size_t size) {
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + size);
+    assert(chunk);
+    return chunk;
+}
+
+static void chunks_free(arena_chunk_t *chunk) {
+    while (chunk != NULL) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (size <= (size_t) (arena->end - arena->next)) {
+        void *ptr = arena->next;
+        arena->next += size;
+        return ptr;
+    }
+    if (size > arena->chunk_size) {
+        arena_chunk_t *block = chunk_alloc(size);
+        block->next = arena->large;
+        arena->large = block;
+        return block->data;
+    }
+    // what's left of the current chunk is given up on
+    arena_chunk_t *chunk = arena->spare;
+    if (chunk != NULL) {
+        arena->spare = chunk->next;
+    } else {
+        chunk = chunk_alloc(arena->chunk_size);
+    }
+    chunk->next = arena->used;
+    arena->used = chunk;
+    arena->next = chunk->data + size;
+    arena->end = chunk->data + arena->chunk_size;
+    return chunk->data;
+}
+
+char *arena_strndup(arena_t *arena, const char *str, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void arena_reset(arena_t *arena) {
+    while (arena->used != NULL) {
+        arena_chunk_t *chunk = arena->used;
+        arena->used = chunk->next;
+        chunk->next = arena->spare;
+        arena->spare = chunk;
+    }
+    chunks_free(arena->large);
+    arena->large = NULL;
+    arena->next = NULL;
+    arena->end = NULL;
+}
+
+void arena_free(arena_t *arena) {
+    chunks_free(arena->used);
+    chunks_free(arena->spare);
+    chunks_free(arena->large);
+    free(arena);
+}
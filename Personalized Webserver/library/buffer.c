@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <assert.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "buffer.h"
+
+typedef enum buffer_kind {
+    BUFFER_HEAP,  // the bytes follow the struct, or were handed to buffer_wrap
+    BUFFER_MAP,   // the bytes are mapped from a file
+    BUFFER_SLICE, // the bytes belong to `parent`
+} buffer_kind_t;
+
+struct buffer {
+    const char *data;
+    size_t len;
+    // changed only with atomic operations, as references are taken and
+    // dropped on any thread
+    size_t refs;
+    buffer_kind_t kind;
+    // for BUFFER_SLICE, the buffer the bytes are in, which is never itself a
+    // slice
+    buffer_t *parent;
+    // for BUFFER_HEAP, whether `data` is an allocation of its own
+    bool wrapped;
+    // the bytes that follow the struct, for copies
+    alignas(max_align_t) char bytes[];
+};
+
+static buffer_t *buffer_alloc(buffer_kind_t kind, size_t extra) {
+    buffer_t *buffer = malloc(sizeof(buffer_t) + extra);
+    assert(buffer);
+    buffer->data = buffer->bytes;
+    buffer->len = extra;
+    buffer->refs = 1;
+    buffer->kind = kind;
+    buffer->parent = NULL;
+    buffer->wrapped = false;
+    return buffer;
+}
+
+buffer_t *buffer_copy(const char *data, size_t len) {
+    buffer_t *buffer = buffer_alloc(BUFFER_HEAP, len);
+    memcpy(buffer->bytes, data, len);
+    return buffer;
+}
+
+buffer_t *buffer_wrap(char *data, size_t len) {
+    buffer_t *buffer = buffer_alloc(BUFFER_HEAP, 0);
+    buffer->data = data;
+    buffer->len = len;
+    buffer->wrapped = true;
+    return buffer;
+}
+
+buffer_t *buffer_map_file(int fd) {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0) {
+        return NULL;
+    }
+    if (!S_ISREG(file_stat.st_mode)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    // an empty file can't be mapped, and doesn't need to be
+    if (file_stat.st_size == 0) {
+        return buffer_alloc(BUFFER_HEAP, 0);
+    }
+    void *map = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    buffer_t *buffer = buffer_alloc(BUFFER_MAP, 0);
+    buffer->data = map;
+    buffer->len = file_stat.st_size;
+    return buffer;
+}
+
+buffer_t *buffer_slice(buffer_t *parent, size_t offset, size_t len) {
+    assert(offset <= parent->len && len <= parent->len - offset);
+    buffer_t *slice = buffer_alloc(BUFFER_SLICE, 0);
+    slice->data = parent->data + offset;
+    slice->len = len;
+    // a slice of a slice refers straight to the bytes' owner, so that chains
+    // of slices don't build up
+    slice->parent = buffer_retain(parent->kind == BUFFER_SLICE ? parent->parent : parent);
+    return slice;
+}
+
+buffer_t *buffer_retain(buffer_t *buffer) {
+    __atomic_add_fetch(&buffer->refs, 1, __ATOMIC_RELAXED);
+    return buffer;
+}
+
+void buffer_release(buffer_t *buffer) {
+    // the last reference is dropped after every other thread's reads of the
+    // bytes, which it must not free out from under them
+    if (__atomic_sub_fetch(&buffer->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    switch (buffer->kind) {
+        case BUFFER_HEAP:
+            if (buffer->wrapped) {
+                free((char *) buffer->data);
+            }
+            break;
+        case BUFFER_MAP:
+            munmap((void *) buffer->data, buffer->len);
+            break;
+        case BUFFER_SLICE:
+            buffer_release(buffer->parent);
+            break;
+    }
+    free(buffer);
+}
+
+const char *buffer_data(const buffer_t *buffer) {
+    return buffer->data;
+}
+
+size_t buffer_len(const buffer_t *buffer) {
+    return buffer->len;
+}
@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "header_map.h"
+#include "mystr.h"
+
+// entries a map starts with room for, enough for most requests
+#define HEADER_MAP_INITIAL_CAPACITY 16
+// marks the end of a name's chain of values
+#define NO_ENTRY UINT32_MAX
+
+typedef struct header_entry {
+    const char *name;
+    const char *value;
+    uint32_t name_len;
+    uint32_t hash;
+    // the index of the name's next value, or NO_ENTRY
+    uint32_t next;
+    // for a name's first value, the index of its last one
+    uint32_t last;
+} header_entry_t;
+
+struct header_map {
+    arena_t *arena;
+    size_t size;
+    size_t capacity;
+    header_entry_t *entries;
+    // for each name, the index of its first value plus one, or 0 for an empty
+    // slot. There are twice as many slots as entries, so the index is never
+    // more than half full and probes stay short.
+    uint32_t *slots;
+    // the same for the known headers, which get a fixed slot each instead of
+    // going into the index
+    uint32_t known[KNOWN_HEADERS_END];
+};
+
+static void *map_alloc(arena_t *arena, size_t size) {
+    void *ptr = arena != NULL ? arena_alloc(arena, size) : malloc(size);
+    assert(ptr);
+    return ptr;
+}
+
+static void map_release(arena_t *arena, void *ptr) {
+    if (arena == NULL) {
+        free(ptr);
+    }
+}
+
+static char fold(char c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+/**
+ * Hashes a name (FNV-1a), ignoring the case of its letters.
+ */
+static uint32_t name_hash(const char *name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char) fold(name[i])) * 16777619u;
+    }
+    return hash;
+}
+
+header_map_t *header_map_init(arena_t *arena) {
+    header_map_t *map = map_alloc(arena, sizeof(header_map_t));
+    map->arena = arena;
+    map->size = 0;
+    map->capacity = HEADER_MAP_INITIAL_CAPACITY;
+    map->entries = map_alloc(arena, map->capacity * sizeof(header_entry_t));
+    map->slots = map_alloc(arena, 2 * map->capacity * sizeof(uint32_t));
+    memset(map->slots, 0, 2 * map->capacity * sizeof(uint32_t));
+    memset(map->known, 0, sizeof(map->known));
+    return map;
+}
+
+void header_map_free(header_map_t *map) {
+    if (map->arena != NULL) {
+        return;
+    }
+    for (size_t i = 0; i < map->size; i++) {
+        // the name and value share an allocation
+        free((char *) map->entries[i].name);
+    }
+    free(map->entries);
+    free(map->slots);
+    free(map);
+}
+
+/**
+ * Returns the slot holding the name, or the empty slot where it would go.
+ */
+static uint32_t *map_find_slot(const header_map_t *map, const char *name, size_t len, uint32_t hash) {
+    size_t mask = 2 * map->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t *slot = &map->slots[i];
+        if (*slot == 0) {
+            return slot;
+        }
+        const header_entry_t *entry = &map->entries[*slot - 1];
+        if (entry->hash == hash && entry->name_len == len && mystr_equal_nocase(entry->name, name, len)) {
+            return slot;
+        }
+    }
+}
+
+/**
+ * Doubles the map's capacity, moving the entries over and rebuilding the
+ * index from the hashes stored in them.
+ */
+static void map_grow(header_map_t *map) {
+    size_t old_slots = 2 * map->capacity;
+    uint32_t *slots = map->slots;
+    header_entry_t *entries = map_alloc(map->arena, 2 * map->capacity * sizeof(header_entry_t));
+    memcpy(entries, map->entries, map->size * sizeof(header_entry_t));
+    map_release(map->arena, map->entries);
+    map->entries = entries;
+    map->capacity *= 2;
+    map->slots = map_alloc(map->arena, 2 * map->capacity * sizeof(uint32_t));
+    memset(map->slots, 0, 2 * map->capacity * sizeof(uint32_t));
+    size_t mask = 2 * map->capacity - 1;
+    for (size_t i = 0; i < old_slots; i++) {
+        if (slots[i] == 0) {
+            continue;
+        }
+        size_t j = map->entries[slots[i] - 1].hash & mask;
+        while (map->slots[j] != 0) {
+            j = (j + 1) & mask;
+        }
+        map->slots[j] = slots[i];
+    }
+    map_release(map->arena, slots);
+}
+
+void header_map_add(header_map_t *map, const char *name, size_t name_len, const char *value, size_t value_len) {
+    header_map_add_known(map, known_header_lookup(name, name_len), name, name_len, value, value_len);
+}
+
+void header_map_add_known(header_map_t *map, known_header_t id, const char *name, size_t name_len, const char *value,
+                          size_t value_len) {
+    if (map->size == map->capacity) {
+        map_grow(map);
+    }
+    char *strings = map_alloc(map->arena, name_len + value_len + 2);
+    memcpy(strings, name, name_len);
+    strings[name_len] = '\0';
+    memcpy(strings + name_len + 1, value, value_len);
+    strings[name_len + 1 + value_len] = '\0';
+
+    // a known header's hash is never needed, as it isn't in the index
+    uint32_t hash = id == HEADER_UNKNOWN ? name_hash(name, name_len) : 0;
+    uint32_t index = map->size++;
+    header_entry_t *entry = &map->entries[index];
+    entry->name = strings;
+    entry->value = strings + name_len + 1;
+    entry->name_len = name_len;
+    entry->hash = hash;
+    entry->next = NO_ENTRY;
+    entry->last = index;
+
+    uint32_t *slot = id != HEADER_UNKNOWN ? &map->known[id] : map_find_slot(map, name, name_len, hash);
+    if (*slot == 0) {
+        *slot = index + 1;
+    } else {
+        header_entry_t *first = &map->entries[*slot - 1];
+        map->entries[first->last].next = index;
+        first->last = index;
+    }
+}
+
+/**
+ * Returns the first entry for `name`, or NULL if it isn't in the map.
+ */
+static const header_entry_t *map_lookup(const header_map_t *map, const char *name) {
+    size_t len = strlen(name);
+    known_header_t id = known_header_lookup(name, len);
+    uint32_t slot = id != HEADER_UNKNOWN ? map->known[id] : *map_find_slot(map, name, len, name_hash(name, len));
+    return slot != 0 ? &map->entries[slot - 1] : NULL;
+}
+
+const char *header_map_get(const header_map_t *map, const char *name) {
+    const header_entry_t *first = map_lookup(map, name);
+    return first != NULL ? map->entries[first->last].value : NULL;
+}
+
+const char *header_map_get_known(const header_map_t *map, known_header_t id) {
+    assert(id != HEADER_UNKNOWN && id < KNOWN_HEADERS_END);
+    uint32_t slot = map->known[id];
+    return slot != 0 ? map->entries[map->entries[slot - 1].last].value : NULL;
+}
+
+size_t header_map_count(const header_map_t *map, const char *name) {
+    const header_entry_t *entry = map_lookup(map, name);
+    size_t count = 0;
+    while (entry != NULL) {
+        count++;
+        entry = entry->next != NO_ENTRY ? &map->entries[entry->next] : NULL;
+    }
+    return count;
+}
+
+const char *header_map_next_value(const header_map_t *map, const char *name, size_t *cursor) {
+    // the cursor is the index of the next value plus one, or SIZE_MAX once
+    // there are no more
+    const header_entry_t *entry = NULL;
+    if (*cursor == 0) {
+        entry = map_lookup(map, name);
+    } else if (*cursor != SIZE_MAX) {
+        entry = &map->entries[*cursor - 1];
+    }
+    if (entry == NULL) {
+        *cursor = SIZE_MAX;
+        return NULL;
+    }
+    *cursor = entry->next != NO_ENTRY ? (size_t) entry->next + 1 : SIZE_MAX;
+    return entry->value;
+}
+
+size_t header_map_size(const header_map_t *map) {
+    return map->size;
+}
+
+const char *header_map_entry(const header_map_t *map, size_t i, const char **name) {
+    assert(i < map->size);
+    *name = map->entries[i].name;
+    return map->entries[i].value;
+}
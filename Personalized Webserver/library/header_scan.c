@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "header_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HEADER_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef const char *(*scan_fn_t)(const char *buf, size_t len);
+
+const char *header_scan_terminator_scalar(const char *buf, size_t len) {
+    for (size_t i = 3; i < len; i++) {
+        // the last byte of the terminator is checked first since most bytes of
+        // a header aren't '\n'
+        if (buf[i] == '\n' && buf[i - 1] == '\r' && buf[i - 2] == '\n' && buf[i - 3] == '\r') {
+            return buf + i + 1;
+        }
+    }
+    return NULL;
+}
+
+#ifdef HEADER_SCAN_X86
+/*
+ * The vector versions compare a block of positions at once: position i starts
+ * a terminator iff buf[i] == '\r', buf[i + 1] == '\n', buf[i + 2] == '\r' and
+ * buf[i + 3] == '\n', so four overlapping loads are compared against those
+ * bytes and the results ANDed together. The lowest set bit of the mask is the
+ * first match. The scalar loop picks up the last few positions.
+ */
+
+__attribute__((target("sse2")))
+const char *header_scan_terminator_sse2(const char *buf, size_t len) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 16 + 3 <= len; i += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *) (buf + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *) (buf + i + 1));
+        __m128i b2 = _mm_loadu_si128((const __m128i *) (buf + i + 2));
+        __m128i b3 = _mm_loadu_si128((const __m128i *) (buf + i + 3));
+        __m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, cr), _mm_cmpeq_epi8(b1, lf)),
+                                      _mm_and_si128(_mm_cmpeq_epi8(b2, cr), _mm_cmpeq_epi8(b3, lf)));
+        unsigned mask = _mm_movemask_epi8(match);
+        if (mask != 0) {
+            return buf + i + __builtin_ctz(mask) + 4;
+        }
+    }
+    return header_scan_terminator_scalar(buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+const char *header_scan_terminator_avx2(const char *buf, size_t len) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 32 + 3 <= len; i += 32) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i *) (buf + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *) (buf + i + 1));
+        __m256i b2 = _mm256_loadu_si256((const __m256i *) (buf + i + 2));
+        __m256i b3 = _mm256_loadu_si256((const __m256i *) (buf + i + 3));
+        __m256i match = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, cr), _mm256_cmpeq_epi8(b1, lf)),
+                                         _mm256_and_si256(_mm256_cmpeq_epi8(b2, cr), _mm256_cmpeq_epi8(b3, lf)));
+        unsigned mask = _mm256_movemask_epi8(match);
+        if (mask != 0) {
+            return buf + i + __builtin_ctz(mask) + 4;
+        }
+    }
+    // the SSE2 code that finishes the scan is not VEX-encoded, and would stall
+    // on the upper halves of the registers left dirty by the loop
+    _mm256_zeroupper();
+    return header_scan_terminator_sse2(buf + i, len - i);
+}
+#else
+const char *header_scan_terminator_sse2(const char *buf, size_t len) {
+    return header_scan_terminator_scalar(buf, len);
+}
+
+const char *header_scan_terminator_avx2(const char *buf, size_t len) {
+    return header_scan_terminator_scalar(buf, len);
+}
+#endif
+
+/**
+ * Returns whether `c` can't appear in a header value.
+ */
+static bool is_value_ctl(unsigned char c) {
+    return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+size_t header_scan_text(const char *buf, size_t len) {
+    size_t i = 0;
+#ifdef __SSE2__
+    /* Bytes past ASCII are negative as signed chars, so the control
+     * characters are exactly those greater than -1 and less than ' '. */
+    const __m128i minus_one = _mm_set1_epi8(-1);
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    for (; i + 16 <= len; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *) (buf + i));
+        __m128i ctl = _mm_and_si128(_mm_cmpgt_epi8(b, minus_one), _mm_cmplt_epi8(b, space));
+        ctl = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(b, tab), ctl), _mm_cmpeq_epi8(b, del));
+        unsigned mask = _mm_movemask_epi8(ctl);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    while (i < len && !is_value_ctl(buf[i])) {
+        i++;
+    }
+    return i;
+}
+
+size_t header_scan_token(const char *buf, size_t len, char stop) {
+    size_t i = 0;
+#ifdef __SSE2__
+    // as above, but with spaces counted as control characters
+    const __m128i minus_one = _mm_set1_epi8(-1);
+    const __m128i past_space = _mm_set1_epi8(' ' + 1);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i stops = _mm_set1_epi8(stop);
+    for (; i + 16 <= len; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *) (buf + i));
+        __m128i end = _mm_and_si128(_mm_cmpgt_epi8(b, minus_one), _mm_cmplt_epi8(b, past_space));
+        end = _mm_or_si128(end, _mm_or_si128(_mm_cmpeq_epi8(b, del), _mm_cmpeq_epi8(b, stops)));
+        unsigned mask = _mm_movemask_epi8(end);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    while (i < len && !is_value_ctl(buf[i]) && buf[i] != ' ' && buf[i] != '\t' && buf[i] != stop) {
+        i++;
+    }
+    return i;
+}
+
+bool header_scan_supported(const char *impl) {
+    if (strcmp(impl, "scalar") == 0) {
+        return true;
+    }
+#ifdef HEADER_SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(impl, "sse2") == 0) {
+        return __builtin_cpu_supports("sse2");
+    }
+    if (strcmp(impl, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return false;
+}
+
+const char *header_scan_impl(void) {
+    if (header_scan_supported("avx2")) {
+        return "avx2";
+    }
+    if (header_scan_supported("sse2")) {
+        return "sse2";
+    }
+    return "scalar";
+}
+
+static const char *scan_resolve(const char *buf, size_t len);
+
+// starts out pointing at the resolver, which swaps in the real implementation
+// on first use; racing threads all store the same pointer
+static scan_fn_t scan_impl = scan_resolve;
+
+static const char *scan_resolve(const char *buf, size_t len) {
+    const char *name = header_scan_impl();
+    scan_fn_t impl = header_scan_terminator_scalar;
+    if (strcmp(name, "avx2") == 0) {
+        impl = header_scan_terminator_avx2;
+    } else if (strcmp(name, "sse2") == 0) {
+        impl = header_scan_terminator_sse2;
+    }
+    __atomic_store_n(&scan_impl, impl, __ATOMIC_RELAXED);
+    return impl(buf, len);
+}
+
+const char *header_scan_terminator(const char *buf, size_t len) {
+    return __atomic_load_n(&scan_impl, __ATOMIC_RELAXED)(buf, len);
+}
+
+const char *header_scan_terminator_from(const char *buf, size_t len, size_t *scanned) {
+    size_t start = *scanned < len ? *scanned : len;
+    const char *end = header_scan_terminator(buf + start, len - start);
+    if (end == NULL) {
+        // a terminator could still start in the last three bytes, once the
+        // rest of it arrives
+        *scanned = len > 3 ? len - 3 : 0;
+    }
+    return end;
+}
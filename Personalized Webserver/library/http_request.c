@@ -4,80 +4,634 @@
 #include <assert.h>
 
 #include "http_request.h"
-#include "ll.h"
+#include "header_scan.h"
 #include "mystr.h"
 
+/**
+ * Allocates a request with room for its method, path, query and version
+ * strings, of the given lengths, right after the struct, and copies them in.
+ * `query` may be NULL for a request without one. The request is made in
+ * `arena`, unless it is NULL.
+ */
+static request_t *request_alloc(arena_t *arena, const char *method, size_t method_len, const char *path,
+                                size_t path_len, const char *query, size_t query_len, const char *http_version,
+                                size_t http_version_len) {
+    size_t size = sizeof(request_t) + method_len + path_len + http_version_len + 3;
+    if (query != NULL) {
+        size += query_len + 1;
+    }
+    request_t *req = arena != NULL ? arena_alloc(arena, size) : malloc(size);
+    assert(req);
+    req->headers = header_map_init(arena);
+    req->body = NULL;
+    req->arena = arena;
+    req->decoded_path = NULL;
+    req->decode_arena = arena;
+
+    char *strings = (char *) (req + 1);
+    req->method = strings;
+    memcpy(req->method, method, method_len);
+    req->method[method_len] = '\0';
+    req->path = req->method + method_len + 1;
+    memcpy(req->path, path, path_len);
+    req->path[path_len] = '\0';
+    req->http_version = req->path + path_len + 1;
+    memcpy(req->http_version, http_version, http_version_len);
+    req->http_version[http_version_len] = '\0';
+    req->query = NULL;
+    if (query != NULL) {
+        req->query = req->http_version + http_version_len + 1;
+        memcpy(req->query, query, query_len);
+        req->query[query_len] = '\0';
+    }
+    return req;
+}
+
 request_t *request_init(const char *method, const char *path , const char *http_version) {
-    request_t *req = malloc(sizeof(request_t));
-    req->headers = ll_init();
+    size_t path_len = strlen(path);
+    const char *query = memchr(path, '?', path_len);
+    size_t query_len = 0;
+    if (query != NULL) {
+        path_len = query - path;
+        query_len = strlen(++query);
+    }
+    return request_alloc(NULL, method, strlen(method), path, path_len, query, query_len, http_version,
+                         strlen(http_version));
+}
 
-    char *http_copy = malloc(sizeof(char) * strlen(http_version) + 1);
-    strcpy(http_copy, http_version);
+/*
+ * The parser's states. Each is named for what the next byte is expected to be
+ * part of.
+ */
+enum {
+    STATE_METHOD,
+    STATE_PATH,
+    STATE_VERSION,
+    STATE_REQUEST_LINE_LF, // the '\n' after a '\r' ending the request line
+    STATE_LINE_START,      // a header line, or the empty line ending the header
+    STATE_NAME,
+    STATE_VALUE_START,     // whitespace before a value
+    STATE_VALUE,
+    STATE_HEADER_LF,       // the '\n' after a '\r' ending a header line
+    STATE_END_LF,          // the '\n' after a '\r' ending the header
+    STATE_DONE,
+    STATE_ERROR,
+};
 
-    char *path_copy = malloc(sizeof(char) * strlen(path) + 1);
-    strcpy(path_copy, path);
+/**
+ * Returns whether `c` is a control character (or NUL), none of which may
+ * appear in a header except as line endings and tabs in values.
+ */
+static bool is_ctl(char c) {
+    return (unsigned char) c < 0x20 || c == 0x7f;
+}
 
-    char *method_copy = malloc(sizeof(char) * strlen(method) + 1);
-    strcpy(method_copy, method);
+static bool is_space(char c) {
+    return c == ' ' || c == '\t';
+}
 
-    req->http_version = http_copy;
-    req->method = method_copy;
-    req->path = path_copy;
-    
-    return req;
+void request_parser_init(request_parser_t *parser) {
+    parser->error = HTTP_OK;
+    parser->state = STATE_METHOD;
+    parser->offset = 0;
+    parser->method_len = 0;
+    parser->path_start = 0;
+    parser->path_len = 0;
+    parser->query_start = 0;
+    parser->query_len = 0;
+    parser->version_start = 0;
+    parser->version_len = 0;
+    parser->num_headers = 0;
+    parser->headers_capacity = REQUEST_PARSER_INLINE_HEADERS;
+    parser->headers = parser->inline_headers;
 }
 
-request_t *request_parse(const char *contents) {
-    strarray_t *line = mystr_split(contents, '\n');
-    strarray_t *first_line = mystr_split(line->data[0], ' ');
+/**
+ * Adds the header line just parsed to the parser's headers, moving them to the
+ * heap once they no longer fit inline.
+ */
+static void parser_push_header(request_parser_t *parser) {
+    if (parser->num_headers == parser->headers_capacity) {
+        size_t capacity = parser->headers_capacity * 2;
+        if (parser->headers == parser->inline_headers) {
+            parser->headers = malloc(capacity * sizeof(header_span_t));
+            assert(parser->headers);
+            memcpy(parser->headers, parser->inline_headers, sizeof(parser->inline_headers));
+        } else {
+            parser->headers = realloc(parser->headers, capacity * sizeof(header_span_t));
+            assert(parser->headers);
+        }
+        parser->headers_capacity = capacity;
+    }
+    parser->headers[parser->num_headers++] = parser->current;
+}
 
-    char *final_method = malloc(sizeof(char) * (strlen(first_line->data[0]) + 1));
-    assert(final_method);
-    strcpy(final_method, first_line->data[0]);
+static parse_status_t parser_fail(request_parser_t *parser, response_code_t error, size_t offset) {
+    parser->state = STATE_ERROR;
+    parser->error = error;
+    parser->offset = offset;
+    return PARSE_ERROR;
+}
 
-    char *final_path = malloc(sizeof(char) * (strlen(first_line->data[1]) + 1));
-    assert(final_path);
-    strcpy(final_path, first_line->data[1]);
+/**
+ * Returns the index of the first byte at or after `i` which can't be part of a
+ * token, i.e., a space, a control character, or `stop`, or `end` if there is
+ * none.
+ */
+static size_t scan_token(const char *buf, size_t i, size_t end, char stop) {
+    return i + header_scan_token(buf + i, end - i, stop);
+}
 
-    //don't need the plus 1 because it has a \r at the back of the string
-    char *final_version = malloc(sizeof(char) * strlen(first_line->data[2]));
-    assert(final_version);
-    strncpy(final_version, first_line->data[2], strlen(first_line->data[2]) - 1);
-    final_version[strlen(first_line->data[2]) - 1] = '\0';
-    
-    request_t *final = request_init(final_method, final_path, final_version);
-    
-    free(final_method);
-    free(final_path);
-    free(final_version);
-    strarray_free(first_line);
+/**
+ * Returns the index of the first control character other than a tab at or
+ * after `i`, e.g., the end of a header value, or `end` if there is none.
+ */
+static size_t scan_text(const char *buf, size_t i, size_t end) {
+    return i + header_scan_text(buf + i, end - i);
+}
 
-    for (size_t i = 1; i < line->length - 1; i++){
-        strarray_t *key_line = mystr_split(line->data[i], ' ');
-        char *temp_key = malloc(sizeof(char) * strlen(key_line->data[0]));
-        assert(temp_key);
-        strncpy(temp_key, key_line->data[0], strlen(key_line->data[0]) - 1);
-        temp_key[strlen(key_line->data[0]) - 1] = '\0';
+/**
+ * Returns the length of the value from `start` to `end`, leaving out the
+ * whitespace at its end.
+ */
+static uint32_t value_length(const char *buf, size_t start, size_t end) {
+    while (end > start && is_space(buf[end - 1])) {
+        end--;
+    }
+    return end - start;
+}
 
-        char *temp_value = malloc(sizeof(char) * strlen(key_line->data[1]));
-        assert(temp_value);
-        strncpy(temp_value, key_line->data[1], strlen(key_line->data[1]) - 1);
-        temp_value[strlen(key_line->data[1]) - 1] = '\0';
+parse_status_t request_parser_feed(request_parser_t *parser, const char *buf, size_t len) {
+    assert(parser->state != STATE_DONE && parser->state != STATE_ERROR);
+    // offsets are stored in 32 bits, which no sensible header gets near
+    size_t end = len < UINT32_MAX ? len : UINT32_MAX;
+    unsigned state = parser->state;
+    header_span_t *current = &parser->current;
+    size_t i = parser->offset;
+    /* Each state scans ahead for the byte that ends it in a loop of its own,
+     * rather than going through the switch for every byte. */
+    while (i < end) {
+        char c;
+        switch (state) {
+            case STATE_METHOD:
+                i += mystr_token_length(buf + i, end - i);
+                if (i == end) {
+                    break;
+                }
+                if (buf[i] != ' ' || i == 0) {
+                    return parser_fail(parser, HTTP_BAD_REQUEST, i);
+                }
+                parser->method_len = i;
+                parser->path_start = ++i;
+                state = STATE_PATH;
+                break;
+            case STATE_PATH:
+                // the first '?' ends the path and starts the query, which may
+                // contain more of them
+                i = scan_token(buf, i, end, parser->query_start == 0 ? '?' : '\0');
+                if (i == end) {
+                    break;
+                }
+                if (buf[i] == '?' && parser->query_start == 0) {
+                    parser->path_len = i - parser->path_start;
+                    parser->query_start = ++i;
+                    break;
+                }
+                if (buf[i] != ' ' || i == parser->path_start) {
+                    return parser_fail(parser, HTTP_BAD_REQUEST, i);
+                }
+                if (parser->query_start == 0) {
+                    parser->path_len = i - parser->path_start;
+                } else {
+                    parser->query_len = i - parser->query_start;
+                }
+                parser->version_start = ++i;
+                state = STATE_VERSION;
+                break;
+            case STATE_VERSION:
+                i = scan_token(buf, i, end, '\0');
+                if (i == end) {
+                    break;
+                }
+                c = buf[i];
+                if ((c != '\r' && c != '\n') || i == parser->version_start) {
+                    return parser_fail(parser, HTTP_BAD_REQUEST, i);
+                }
+                parser->version_len = i - parser->version_start;
+                state = c == '\r' ? STATE_REQUEST_LINE_LF : STATE_LINE_START;
+                i++;
+                break;
+            case STATE_REQUEST_LINE_LF:
+            case STATE_HEADER_LF:
+                if (buf[i] != '\n') {
+                    return parser_fail(parser, HTTP_BAD_REQUEST, i);
+                }
+                if (state == STATE_HEADER_LF) {
+                    parser_push_header(parser);
+                }
+                state = STATE_LINE_START;
+                i++;
+                break;
+            case STATE_LINE_START:
+                c = buf[i];
+                if (c == '\r') {
+                    state = STATE_END_LF;
+                    i++;
+                } else if (c == '\n') {
+                    parser->state = STATE_DONE;
+                    parser->offset = i + 1;
+                    return PARSE_COMPLETE;
+                } else if (c == ':' || is_space(c) || is_ctl(c)) {
+                    // a leading space would be a continuation of the previous
+                    // line, which RFC 9112 says to reject
+                    return parser_fail(parser, HTTP_BAD_REQUEST, i);
+                } else {
+                    current->name_start = i;
+                    state = STATE_NAME;
+                }
+                break;
+            case STATE_NAME:
+                // a name may only be made of token characters
+                i += mystr_token_length(buf + i, end - i);
+                if (i == end) {
+                    break;
+                }
+                if (buf[i] != ':') {
+                    return parser_fail(parser, HTTP_BAD_REQUEST, i);
+                }
+                current->name_len = i - current->name_start;
+                current->id = known_header_lookup(buf + current->name_start, current->name_len);
+                current->value_start = ++i;
+                state = STATE_VALUE_START;
+                break;
+            case STATE_VALUE_START:
+                while (i < end && is_space(buf[i])) {
+                    i++;
+                }
+                current->value_start = i;
+                if (i < end) {
+                    state = STATE_VALUE;
+                }
+                break;
+            case STATE_VALUE:
+                i = scan_text(buf, i, end);
+                if (i == end) {
+                    break;
+                }
+                c = buf[i];
+                if (c != '\r' && c != '\n') {
+                    return parser_fail(parser, HTTP_BAD_REQUEST, i);
+                }
+                current->value_len = value_length(buf, current->value_start, i);
+                if (c == '\n') {
+                    parser_push_header(parser);
+                }
+                state = c == '\r' ? STATE_HEADER_LF : STATE_LINE_START;
+                i++;
+                break;
+            case STATE_END_LF:
+                if (buf[i] != '\n') {
+                    return parser_fail(parser, HTTP_BAD_REQUEST, i);
+                }
+                parser->state = STATE_DONE;
+                parser->offset = i + 1;
+                return PARSE_COMPLETE;
+        }
+    }
+    if (end < len) {
+        return parser_fail(parser, HTTP_HEADER_FIELDS_TOO_LARGE, i);
+    }
+    parser->state = state;
+    parser->offset = i;
+    return PARSE_INCOMPLETE;
+}
 
-        ll_put(final->headers, temp_key, temp_value);
+/**
+ * Ends a header which was cut off at the end of the input, as though an empty
+ * line followed it, as long as it wasn't cut off mid-token.
+ */
+static parse_status_t parser_finish(request_parser_t *parser, const char *buf) {
+    switch (parser->state) {
+        case STATE_VERSION:
+            if (parser->offset == parser->version_start) {
+                return parser_fail(parser, HTTP_BAD_REQUEST, parser->offset);
+            }
+            parser->version_len = parser->offset - parser->version_start;
+            break;
+        case STATE_VALUE_START:
+        case STATE_VALUE:
+            parser->current.value_len = value_length(buf, parser->current.value_start, parser->offset);
+            parser_push_header(parser);
+            break;
+        case STATE_HEADER_LF:
+            parser_push_header(parser);
+            break;
+        case STATE_REQUEST_LINE_LF:
+        case STATE_LINE_START:
+        case STATE_END_LF:
+            break;
+        case STATE_DONE:
+            return PARSE_COMPLETE;
+        case STATE_ERROR:
+            return PARSE_ERROR;
+        default:
+            return parser_fail(parser, HTTP_BAD_REQUEST, parser->offset);
+    }
+    parser->state = STATE_DONE;
+    return PARSE_COMPLETE;
+}
 
-        strarray_free(key_line);
+size_t request_parser_length(const request_parser_t *parser) {
+    assert(parser->state == STATE_DONE);
+    return parser->offset;
+}
+
+static str_view_t span_view(const char *buf, uint32_t start, uint32_t len) {
+    str_view_t view = { .ptr = buf + start, .len = len };
+    return view;
+}
+
+void request_parser_view(const request_parser_t *parser, const char *buf, request_view_t *view) {
+    assert(parser->state == STATE_DONE);
+    view->method = span_view(buf, 0, parser->method_len);
+    view->path = span_view(buf, parser->path_start, parser->path_len);
+    view->query.ptr = NULL;
+    view->query.len = 0;
+    if (parser->query_start != 0) {
+        view->query = span_view(buf, parser->query_start, parser->query_len);
+    }
+    view->http_version = span_view(buf, parser->version_start, parser->version_len);
+    view->num_headers = parser->num_headers;
+    view->headers_capacity = REQUEST_VIEW_INLINE_HEADERS;
+    view->headers = view->inline_headers;
+    if (parser->num_headers > REQUEST_VIEW_INLINE_HEADERS) {
+        view->headers_capacity = parser->num_headers;
+        view->headers = malloc(parser->num_headers * sizeof(header_view_t));
+        assert(view->headers);
+    }
+    for (size_t i = 0; i < parser->num_headers; i++) {
+        const header_span_t *span = &parser->headers[i];
+        view->headers[i].name = span_view(buf, span->name_start, span->name_len);
+        view->headers[i].value = span_view(buf, span->value_start, span->value_len);
+        view->headers[i].id = span->id;
+    }
+}
+
+void request_parser_free(request_parser_t *parser) {
+    if (parser->headers != parser->inline_headers) {
+        free(parser->headers);
+    }
+    parser->headers = parser->inline_headers;
+    parser->num_headers = 0;
+}
+
+bool request_view_parse(const char *contents, size_t len, request_view_t *view) {
+    view->num_headers = 0;
+    view->headers = view->inline_headers;
+    view->headers_capacity = REQUEST_VIEW_INLINE_HEADERS;
+
+    request_parser_t parser;
+    request_parser_init(&parser);
+    parse_status_t status = request_parser_feed(&parser, contents, len);
+    if (status == PARSE_INCOMPLETE) {
+        status = parser_finish(&parser, contents);
     }
+    if (status == PARSE_COMPLETE) {
+        request_parser_view(&parser, contents, view);
+    }
+    request_parser_free(&parser);
+    return status == PARSE_COMPLETE;
+}
+
+const str_view_t *request_view_header(const request_view_t *view, const char *name) {
+    size_t name_len = strlen(name);
+    known_header_t id = known_header_lookup(name, name_len);
+    if (id != HEADER_UNKNOWN) {
+        return request_view_known_header(view, id);
+    }
+    for (size_t i = 0; i < view->num_headers; i++) {
+        const header_view_t *header = &view->headers[i];
+        if (header->name.len == name_len && mystr_equal_nocase(header->name.ptr, name, name_len)) {
+            return &header->value;
+        }
+    }
+    return NULL;
+}
 
-    strarray_free(line);
+const str_view_t *request_view_known_header(const request_view_t *view, known_header_t id) {
+    for (size_t i = 0; i < view->num_headers; i++) {
+        if (view->headers[i].id == id) {
+            return &view->headers[i].value;
+        }
+    }
+    return NULL;
+}
+
+void request_view_free(request_view_t *view) {
+    if (view->headers != view->inline_headers) {
+        free(view->headers);
+    }
+    view->headers = view->inline_headers;
+    view->num_headers = 0;
+}
 
-    return final;
+request_t *request_from_view(const request_view_t *view) {
+    return request_from_view_arena(view, NULL);
+}
+
+request_t *request_from_view_arena(const request_view_t *view, arena_t *arena) {
+    request_t *req = request_alloc(arena, view->method.ptr, view->method.len, view->path.ptr, view->path.len,
+                                   view->query.ptr, view->query.len, view->http_version.ptr, view->http_version.len);
+    for (size_t i = 0; i < view->num_headers; i++) {
+        const header_view_t *header = &view->headers[i];
+        header_map_add_known(req->headers, header->id, header->name.ptr, header->name.len, header->value.ptr, header->value.len);
+    }
+    return req;
+}
+
+request_t *request_parse(const char *contents) {
+    request_view_t view;
+    request_t *req = NULL;
+    if (request_view_parse(contents, strlen(contents), &view)) {
+        req = request_from_view(&view);
+    }
+    request_view_free(&view);
+    return req;
 }
 
 void request_free(request_t *req) {
-    ll_free(req->headers);
-    free(req->http_version);
-    free(req->method);
-    free(req->path);
+    request_body_free(req->body);
+    if (req->arena != NULL) {
+        return;
+    }
+    if (req->decode_arena != NULL) {
+        arena_free(req->decode_arena);
+    }
+    header_map_free(req->headers);
     free(req);
-}
\ No newline at end of file
+}
+
+const char *request_header(const request_t *req, const char *name) {
+    return header_map_get(req->headers, name);
+}
+
+const char *request_known_header(const request_t *req, known_header_t id) {
+    return header_map_get_known(req->headers, id);
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+ssize_t url_decode(char *dst, const char *src, size_t len, bool form) {
+    size_t out = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = src[i];
+        if (c == '%') {
+            int high = i + 2 < len ? hex_value(src[i + 1]) : -1;
+            int low = i + 2 < len ? hex_value(src[i + 2]) : -1;
+            if (high < 0 || low < 0 || (high == 0 && low == 0)) {
+                return -1;
+            }
+            c = (char) (high << 4 | low);
+            i += 2;
+        } else if (c == '+' && form) {
+            c = ' ';
+        }
+        dst[out++] = c;
+    }
+    return out;
+}
+
+/**
+ * Returns where the request's decoded strings go: its arena, or one of its own
+ * for a request on the heap, made the first time it is needed.
+ */
+static arena_t *request_decode_arena(request_t *req) {
+    if (req->decode_arena == NULL) {
+        req->decode_arena = arena_init(ARENA_DEFAULT_CHUNK_SIZE);
+    }
+    return req->decode_arena;
+}
+
+/**
+ * Decodes the `len` bytes at `src` into a null-terminated string in the
+ * request's decode arena, or returns NULL if they are encoded invalidly.
+ */
+static char *request_decode(request_t *req, const char *src, size_t len, bool form) {
+    char *decoded = arena_alloc(request_decode_arena(req), len + 1);
+    ssize_t decoded_len = url_decode(decoded, src, len, form);
+    if (decoded_len < 0) {
+        return NULL;
+    }
+    decoded[decoded_len] = '\0';
+    return decoded;
+}
+
+const char *request_path(request_t *req) {
+    if (req->decoded_path == NULL) {
+        size_t len = strlen(req->path);
+        // most paths have nothing to decode, and are their own decoding
+        if (memchr(req->path, '%', len) == NULL) {
+            req->decoded_path = req->path;
+        } else {
+            req->decoded_path = request_decode(req, req->path, len, false);
+        }
+    }
+    return req->decoded_path;
+}
+
+void query_iter_init(query_iter_t *iter, const char *query) {
+    iter->next = query;
+}
+
+bool query_iter_next(query_iter_t *iter, str_view_t *name, str_view_t *value) {
+    const char *param = iter->next;
+    if (param == NULL) {
+        return false;
+    }
+    while (*param == '&') {
+        param++;
+    }
+    if (*param == '\0') {
+        iter->next = NULL;
+        return false;
+    }
+    size_t len = strcspn(param, "&");
+    iter->next = param + len;
+    const char *equals = memchr(param, '=', len);
+    name->ptr = param;
+    name->len = equals != NULL ? (size_t) (equals - param) : len;
+    value->ptr = equals != NULL ? equals + 1 : param + len;
+    value->len = param + len - value->ptr;
+    return true;
+}
+
+/**
+ * Returns whether the encoded `raw` decodes (as a query string would) to
+ * `name`, without decoding it anywhere.
+ */
+static bool query_name_equals(str_view_t raw, const char *name) {
+    size_t j = 0;
+    for (size_t i = 0; i < raw.len; i++, j++) {
+        char c = raw.ptr[i];
+        if (c == '%') {
+            int high = i + 2 < raw.len ? hex_value(raw.ptr[i + 1]) : -1;
+            int low = i + 2 < raw.len ? hex_value(raw.ptr[i + 2]) : -1;
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            c = (char) (high << 4 | low);
+            i += 2;
+        } else if (c == '+') {
+            c = ' ';
+        }
+        if (name[j] == '\0' || name[j] != c) {
+            return false;
+        }
+    }
+    return name[j] == '\0';
+}
+
+const char *request_query_param(request_t *req, const char *name) {
+    query_iter_t iter;
+    query_iter_init(&iter, req->query);
+    str_view_t raw_name, raw_value;
+    while (query_iter_next(&iter, &raw_name, &raw_value)) {
+        if (query_name_equals(raw_name, name)) {
+            return request_decode(req, raw_value.ptr, raw_value.len, true);
+        }
+    }
+    return NULL;
+}
+
+query_param_t *request_query_params(request_t *req, size_t *count) {
+    // counted first, so that the array is allocated once
+    query_iter_t iter;
+    str_view_t raw_name, raw_value;
+    size_t capacity = 0;
+    query_iter_init(&iter, req->query);
+    while (query_iter_next(&iter, &raw_name, &raw_value)) {
+        capacity++;
+    }
+    query_param_t *params = arena_alloc(request_decode_arena(req), capacity * sizeof(query_param_t));
+    *count = 0;
+    query_iter_init(&iter, req->query);
+    while (query_iter_next(&iter, &raw_name, &raw_value)) {
+        const char *name = request_decode(req, raw_name.ptr, raw_name.len, true);
+        const char *value = request_decode(req, raw_value.ptr, raw_value.len, true);
+        if (name != NULL && value != NULL) {
+            params[*count].name = name;
+            params[*count].value = value;
+            (*count)++;
+        }
+    }
+    return params;
+}
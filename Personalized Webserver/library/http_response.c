@@ -3,87 +3,341 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <unistd.h>
+#include <time.h>
 
 #include "http_response.h"
+#include "mystr.h"
 
-/**
- * Converts a supported status code into a human-readable brief. The brief is a
- * literal or global borrowed by the caller.
- * 
- * Supported codes are those in the `response_code_t` enum.
- * 
- * Will crash via assert, abort, or similar on unsupported status codes.
+// initial capacity of the buffer a stream's producer writes into
+#define STREAM_INITIAL_CAPACITY 256
+// the last chunk of a chunked body, with no trailers
+#define CHUNKED_END "0\r\n\r\n"
+
+struct response_stream {
+    response_code_t code;
+    mime_type_t type;
+    stream_producer_t produce;
+    void *state;
+    void (*state_free)(void *);
+    bool chunked;
+    // what the producer has written since the last `response_stream_next`,
+    // framed for the wire
+    char *buf;
+    size_t len;
+    size_t cap;
+};
+
+typedef struct response_header {
+    // the name and value, in one allocation if the response is on the heap
+    char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
+    struct response_header *next;
+} response_header_t;
+
+struct response {
+    arena_t *arena;
+    response_code_t code;
+    mime_type_t type;
+    // the headers the handler added, in order, and how many bytes their lines
+    // take
+    response_header_t *headers;
+    response_header_t *headers_tail;
+    size_t headers_len;
+    bytes_t *body;
+    bytes_t *body_tail;
+    size_t body_len;
+};
+
+/*
+ * The supported statuses, as X(code, status text), and MIME types, as
+ * X(arg, type, name), from which a template of the status line and
+ * Content-Type header of every response is put together at compile time, so
+ * that formatting a response's header is a few copies. These must be kept in
+ * step with `response_code_t` and `mime_type_t`.
  */
-static const char *status_brief(response_code_t code);
-/**
- * Converts a supported type code into a HTTP mime type string.
- * 
- * Will crash via assert, abort, or similar on unsupported status codes.
+#define RESPONSE_STATUSES(X)                                               \
+    X(HTTP_OK, "200 OK")                                                   \
+    X(HTTP_BAD_REQUEST, "400 Bad Request")                                 \
+    X(HTTP_FORBIDDEN, "403 Forbidden")                                     \
+    X(HTTP_NOT_FOUND, "404 Not Found")                                     \
+    X(HTTP_PAYLOAD_TOO_LARGE, "413 Payload Too Large")                     \
+    X(HTTP_HEADER_FIELDS_TOO_LARGE, "431 Request Header Fields Too Large")
+
+#define RESPONSE_MIME_TYPES(X, arg)                         \
+    X(arg, MIME_PLAIN, "text/plain")                        \
+    X(arg, MIME_HTML, "text/html")                          \
+    X(arg, MIME_JS, "text/javascript")                      \
+    X(arg, MIME_JSON, "text/json")                          \
+    X(arg, MIME_WASM, "application/wasm")                   \
+    X(arg, MIME_PNG, "image/png")                           \
+    X(arg, MIME_OCTET_STREAM, "application/octet-stream")
+
+#define STATUS_INDEX(code, status) code##_INDEX,
+#define MIME_COUNT(arg, type, name) +1
+
+// a status's row in the templates
+typedef enum status_index {
+    RESPONSE_STATUSES(STATUS_INDEX)
+    NUM_STATUSES
+} status_index_t;
+
+#define NUM_MIME_TYPES (0 RESPONSE_MIME_TYPES(MIME_COUNT, _))
+
+typedef struct header_template {
+    const char *text;
+    size_t len;
+} header_template_t;
+
+#define TEMPLATE_TEXT(status, name) "HTTP/1.1 " status "\r\nContent-Type: " name "\r\n"
+#define TEMPLATE(status, type, name) [type] = {TEMPLATE_TEXT(status, name), sizeof(TEMPLATE_TEXT(status, name)) - 1},
+#define TEMPLATE_ROW(code, status) [code##_INDEX] = {RESPONSE_MIME_TYPES(TEMPLATE, status)},
+
+static const header_template_t HEADER_TEMPLATES[NUM_STATUSES][NUM_MIME_TYPES] = {
+    RESPONSE_STATUSES(TEMPLATE_ROW)
+};
+
+#define CONTENT_LENGTH "Content-Length: "
+#define CRLF "\r\n"
+#define HEADER_END "\r\n\r\n"
+
+#define SERVER_NAME "Personalized-Server"
+// an IMF-fixdate, e.g., "Sun, 06 Nov 1994 08:49:37 GMT", is always this long
+#define HTTP_DATE_LEN 29
+#define DATE_HEADER "Date: "
+#define SERVER_HEADER "Server: " SERVER_NAME CRLF
+#define DATE_HEADERS_LEN (sizeof(DATE_HEADER) - 1 + HTTP_DATE_LEN + sizeof(CRLF) - 1 + sizeof(SERVER_HEADER) - 1)
+
+/*
+ * The Date and Server headers that go into every response, formatted only
+ * when the second changes, so that adding them to a header is one copy. Each
+ * thread has its own, which its event loop's tick keeps up to date (see
+ * `response_date_refresh`), so workers never share or lock it.
  */
-static const char *mime_string(mime_type_t type);
+typedef struct date_headers {
+    // the second `text` is for, or -1 before it is first formatted
+    time_t second;
+    // whether `response_date_refresh` keeps this thread's up to date, or
+    // whether it must check the time itself
+    bool refreshed;
+    char text[DATE_HEADERS_LEN + 1];
+} date_headers_t;
+
+static _Thread_local date_headers_t DATE_HEADERS = {.second = -1};
+
+static const char *const WEEKDAYS[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *const MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                     "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
 
 /**
- * Gets the length as a string of a number when serialized in base 10.
+ * Formats this thread's Date and Server headers for `now`, unless they are
+ * already for that second. The names of days and months are written out
+ * rather than left to strftime, whose are the locale's.
  */
-static size_t base_ten_repr_len(size_t n);
-
-static const char *status_brief(response_code_t code) {
-    switch (code) {
-        case HTTP_OK:
-            return "OK";
-        case HTTP_BAD_REQUEST:
-            return "Bad Request";
-        case HTTP_FORBIDDEN:
-            return "Forbidden";
-        case HTTP_NOT_FOUND:
-            return "Not Found";
-        default:
-            fprintf(stderr, "status_brief: Unsupported response status code: `%d`\n", code);
-            abort();
+static void date_headers_update(time_t now) {
+    date_headers_t *date = &DATE_HEADERS;
+    if (now == date->second) {
+        return;
     }
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    int len = snprintf(date->text, sizeof(date->text), DATE_HEADER "%s, %02d %s %04d %02d:%02d:%02d GMT" CRLF SERVER_HEADER,
+                       WEEKDAYS[tm.tm_wday], tm.tm_mday, MONTHS[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min,
+                       tm.tm_sec);
+    // only a year past 9999 wouldn't fit
+    assert(len == DATE_HEADERS_LEN);
+    (void) len;
+    date->second = now;
 }
 
-static const char *mime_string(mime_type_t type) {
-    switch (type) {
-        case MIME_PLAIN:        return "text/plain";
-        case MIME_HTML:         return "text/html";
-        case MIME_JS:           return "text/javascript";
-        case MIME_JSON:         return "text/json";
-        case MIME_PNG:          return "image/png";
-        case MIME_WASM:         return "application/wasm";
-        case MIME_OCTET_STREAM: return "application/octet-stream";
-        default:
-            fprintf(stderr, "response_type_format: Unsupported mime type: `%d`\n", type);
-            abort();
+void response_date_refresh(time_t now) {
+    DATE_HEADERS.refreshed = true;
+    date_headers_update(now);
+}
+
+/**
+ * Returns this thread's Date and Server headers, DATE_HEADERS_LEN bytes,
+ * checking the time first if nothing refreshes them.
+ */
+static const char *date_headers(void) {
+    if (!DATE_HEADERS.refreshed) {
+        date_headers_update(time(NULL));
     }
+    return DATE_HEADERS.text;
 }
 
-static size_t base_ten_repr_len(size_t n) {
-    if (n == 0) {
-        return 1;
+/**
+ * Returns the template of the status line and Content-Type header for a
+ * response with a supported status code and MIME type, i.e., those in the
+ * `response_code_t` and `mime_type_t` enums. The template is a global borrowed
+ * by the caller.
+ *
+ * Will crash via abort on an unsupported status code or type.
+ */
+static const header_template_t *header_template(response_code_t code, mime_type_t type) {
+    status_index_t row;
+    switch (code) {
+#define STATUS_CASE(code, status) case code: row = code##_INDEX; break;
+        RESPONSE_STATUSES(STATUS_CASE)
+#undef STATUS_CASE
+        default:
+            fprintf(stderr, "header_template: Unsupported response status code: `%d`\n", code);
+            abort();
     }
-    size_t len = 0;
-    while (n > 0) {
-        len += 1;
-        n /= 10;
+    if ((unsigned) type >= NUM_MIME_TYPES || HEADER_TEMPLATES[row][type].text == NULL) {
+        fprintf(stderr, "header_template: Unsupported mime type: `%d`\n", type);
+        abort();
     }
-    return len;
+    return &HEADER_TEMPLATES[row][type];
 }
 
 bytes_t *bytes_init(size_t len, char *data) {
-    bytes_t *init = malloc(sizeof(bytes_t));
+    return bytes_init_arena(NULL, len, data);
+}
+
+bytes_t *bytes_init_arena(arena_t *arena, size_t len, char *data) {
+    bytes_t *init = arena != NULL ? arena_alloc(arena, sizeof(bytes_t)) : malloc(sizeof(bytes_t));
     assert(init);
     init->len = len;
     init->data = data;
+    init->next = NULL;
+    init->fd = -1;
+    init->offset = 0;
+    init->stream = NULL;
+    init->response = NULL;
+    init->arena = arena;
+    init->kind = arena != NULL ? BYTES_BORROWED : BYTES_OWNED;
+    init->retain = NULL;
+    init->release = NULL;
+    init->owner = NULL;
+    return init;
+}
+
+bytes_t *bytes_init_borrowed(arena_t *arena, size_t len, const char *data) {
+    bytes_t *init = bytes_init_arena(arena, len, (char *) data);
+    init->kind = BYTES_BORROWED;
+    return init;
+}
+
+bytes_t *bytes_init_shared(arena_t *arena, size_t len, const char *data, void (*retain)(void *),
+                           void (*release)(void *), void *owner) {
+    bytes_t *init = bytes_init_arena(arena, len, (char *) data);
+    init->kind = BYTES_SHARED;
+    init->retain = retain;
+    init->release = release;
+    init->owner = owner;
+    return init;
+}
+
+static void buffer_retain_owner(void *buffer) {
+    buffer_retain(buffer);
+}
+
+static void buffer_release_owner(void *buffer) {
+    buffer_release(buffer);
+}
+
+bytes_t *bytes_init_buffer(arena_t *arena, buffer_t *buffer) {
+    return bytes_init_shared(arena, buffer_len(buffer), buffer_data(buffer), buffer_retain_owner, buffer_release_owner,
+                             buffer_retain(buffer));
+}
+
+bytes_t *bytes_init_file(int fd, off_t offset, size_t len) {
+    return bytes_init_file_arena(NULL, fd, offset, len);
+}
+
+bytes_t *bytes_init_file_arena(arena_t *arena, int fd, off_t offset, size_t len) {
+    bytes_t *init = bytes_init_arena(arena, len, NULL);
+    init->fd = fd;
+    init->offset = offset;
+    init->kind = BYTES_FILE;
     return init;
 }
 
 void bytes_free(bytes_t *bytes) {
-    free(bytes->data);
-    free(bytes);
+    while (bytes != NULL) {
+        bytes_t *next = bytes->next;
+        switch (bytes->kind) {
+            case BYTES_OWNED:
+                free(bytes->data);
+                break;
+            case BYTES_BORROWED:
+                break;
+            case BYTES_FILE:
+                close(bytes->fd);
+                break;
+            case BYTES_SHARED:
+                bytes->release(bytes->owner);
+                break;
+        }
+        if (bytes->stream != NULL) {
+            if (bytes->stream->state_free != NULL) {
+                bytes->stream->state_free(bytes->stream->state);
+            }
+            free(bytes->stream->buf);
+            free(bytes->stream);
+        }
+        if (bytes->response != NULL) {
+            response_free(bytes->response);
+        }
+        if (bytes->arena == NULL) {
+            free(bytes);
+        }
+        bytes = next;
+    }
+}
+
+/**
+ * Formats the status line and headers for a response with a `body_len` byte
+ * body, followed by `headers` (which take `headers_len` bytes, and may be
+ * NULL), into a new buffer, in `arena` unless it is NULL, with room for
+ * `extra` more bytes after the headers. The buffer is null-terminated after
+ * `extra` bytes.
+ * 
+ * Returns the buffer and stores the length of the headers in `header_len`.
+ */
+static char *response_header_format(arena_t *arena, response_code_t code, mime_type_t type, size_t body_len,
+                                    const response_header_t *headers, size_t headers_len, size_t extra,
+                                    size_t *header_len) {
+    const header_template_t *template = header_template(code, type);
+    *header_len = template->len + DATE_HEADERS_LEN + strlen(CONTENT_LENGTH) + mystr_utoa_length(body_len) + strlen(CRLF) +
+                  headers_len + strlen(CRLF);
+    // one extra byte so that text responses stay null-terminated past `len`
+    size_t size = *header_len + extra + 1;
+    char *resp = arena != NULL ? arena_alloc(arena, size) : malloc(size);
+    assert(resp);
+    char *end = resp;
+    memcpy(end, template->text, template->len);
+    end += template->len;
+    memcpy(end, date_headers(), DATE_HEADERS_LEN);
+    end += DATE_HEADERS_LEN;
+    memcpy(end, CONTENT_LENGTH, strlen(CONTENT_LENGTH));
+    end += strlen(CONTENT_LENGTH);
+    end += mystr_utoa(end, body_len);
+    memcpy(end, CRLF, strlen(CRLF));
+    end += strlen(CRLF);
+    for (const response_header_t *header = headers; header != NULL; header = header->next) {
+        memcpy(end, header->name, header->name_len);
+        end += header->name_len;
+        memcpy(end, ": ", 2);
+        end += 2;
+        memcpy(end, header->value, header->value_len);
+        end += header->value_len;
+        memcpy(end, CRLF, strlen(CRLF));
+        end += strlen(CRLF);
+    }
+    memcpy(end, CRLF, strlen(CRLF));
+    resp[size - 1] = '\0';
+    return resp;
+}
+
+bytes_t *response_type_format(response_code_t code, mime_type_t type, bytes_t *body) {
+    return response_type_format_arena(NULL, code, type, body);
 }
 
-bytes_t *response_type_format(response_code_t code, mime_type_t type, bytes_t *_body) {
+bytes_t *response_type_format_arena(arena_t *arena, response_code_t code, mime_type_t type, bytes_t *_body) {
     const char *body;
     size_t body_len;
     if (_body == NULL) {
@@ -93,26 +347,227 @@ bytes_t *response_type_format(response_code_t code, mime_type_t type, bytes_t *_
         body = ((bytes_t *) _body)->data;
         body_len = ((bytes_t *) _body)->len;
     }
-    const char *brief = status_brief(code);
-    size_t brief_len = strlen(brief);
-    const char *mime = mime_string(type);
-    size_t mime_len = strlen(mime);
-    const char FORMAT[] = 
-        "HTTP/1.1 %d %s\r\n"
-        "Content-Type: %s\r\n"
-        "Content-Length: %zu\r\n"
-        "\r\n";
-    // length of the template in the formatted string. Subtracts off format strings.
-    const size_t TEMPLATE_LEN = strlen(FORMAT) - strlen("%d") - 2 * strlen("%s") - strlen("%zu");
-    const size_t STATUS_CODE_LEN = 3;
-    size_t content_len_len = base_ten_repr_len(body_len);
-    size_t resp_len = TEMPLATE_LEN + STATUS_CODE_LEN + brief_len + mime_len + content_len_len + body_len;
-    if (type == MIME_HTML || type == MIME_PLAIN) {
-        resp_len += 1;
-    }
-    char *resp = calloc(resp_len, sizeof(char));
-    assert(resp);
-    size_t end = snprintf(resp, resp_len, FORMAT, code, brief, mime, body_len);
-    memcpy(resp + end, body, body_len);
-    return bytes_init(resp_len, resp);
+    size_t header_len;
+    char *resp = response_header_format(arena, code, type, body_len, NULL, 0, body_len, &header_len);
+    memcpy(resp + header_len, body, body_len);
+    return bytes_init_arena(arena, header_len + body_len, resp);
+}
+
+bytes_t *response_type_format_iov(response_code_t code, mime_type_t type, bytes_t *body) {
+    return response_type_format_iov_arena(NULL, code, type, body);
+}
+
+bytes_t *response_type_format_iov_arena(arena_t *arena, response_code_t code, mime_type_t type, bytes_t *body) {
+    size_t body_len = body == NULL ? 0 : body->len;
+    size_t header_len;
+    char *header = response_header_format(arena, code, type, body_len, NULL, 0, 0, &header_len);
+    bytes_t *resp = bytes_init_arena(arena, header_len, header);
+    resp->next = body;
+    return resp;
+}
+
+bytes_t *response_type_format_stream(response_code_t code, mime_type_t type, stream_producer_t produce, void *state, void (*state_free)(void *)) {
+    // checked now so that bad arguments crash in the handler, not mid-stream
+    header_template(code, type);
+    response_stream_t *stream = malloc(sizeof(response_stream_t));
+    assert(stream);
+    stream->code = code;
+    stream->type = type;
+    stream->produce = produce;
+    stream->state = state;
+    stream->state_free = state_free;
+    stream->chunked = true;
+    stream->buf = NULL;
+    stream->len = 0;
+    stream->cap = 0;
+    bytes_t *resp = bytes_init(0, NULL);
+    resp->stream = stream;
+    return resp;
+}
+
+/**
+ * Appends `len` bytes to the stream's buffer, growing it as needed.
+ */
+static void stream_append(response_stream_t *stream, const char *data, size_t len) {
+    if (stream->len + len > stream->cap) {
+        size_t cap = stream->cap == 0 ? STREAM_INITIAL_CAPACITY : stream->cap;
+        while (cap < stream->len + len) {
+            cap *= 2;
+        }
+        stream->buf = realloc(stream->buf, cap);
+        assert(stream->buf);
+        stream->cap = cap;
+    }
+    memcpy(stream->buf + stream->len, data, len);
+    stream->len += len;
+}
+
+void response_stream_write(response_stream_t *stream, const char *data, size_t len) {
+    // an empty chunk would end the body
+    if (len == 0) {
+        return;
+    }
+    if (stream->chunked) {
+        char size_line[sizeof(size_t) * 2 + 3];
+        int size_len = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+        stream_append(stream, size_line, size_len);
+    }
+    stream_append(stream, data, len);
+    if (stream->chunked) {
+        stream_append(stream, "\r\n", 2);
+    }
+}
+
+bytes_t *response_stream_header(response_stream_t *stream, bool chunked) {
+    stream->chunked = chunked;
+    const char *framing = chunked ? "Transfer-Encoding: chunked" HEADER_END : "Connection: close" HEADER_END;
+    size_t framing_len = strlen(framing);
+    const header_template_t *template = header_template(stream->code, stream->type);
+    size_t header_len = template->len + DATE_HEADERS_LEN + framing_len;
+    char *header = malloc(header_len + 1);
+    assert(header);
+    memcpy(header, template->text, template->len);
+    memcpy(header + template->len, date_headers(), DATE_HEADERS_LEN);
+    memcpy(header + template->len + DATE_HEADERS_LEN, framing, framing_len + 1);
+    return bytes_init(header_len, header);
+}
+
+bytes_t *response_stream_next(response_stream_t *stream, bool *done) {
+    *done = !stream->produce(stream, stream->state);
+    if (*done && stream->chunked) {
+        stream_append(stream, CHUNKED_END, strlen(CHUNKED_END));
+    }
+    // the buffer is handed over with what was written, and a new one is
+    // started on the next write
+    bytes_t *piece = bytes_init(stream->len, stream->buf);
+    stream->buf = NULL;
+    stream->len = 0;
+    stream->cap = 0;
+    return piece;
+}
+
+static void *response_alloc(arena_t *arena, size_t size) {
+    void *ptr = arena != NULL ? arena_alloc(arena, size) : malloc(size);
+    assert(ptr);
+    return ptr;
+}
+
+response_t *response_init(arena_t *arena, response_code_t code, mime_type_t type) {
+    // checked now so that bad arguments crash in the handler, not when sent
+    header_template(code, type);
+    response_t *resp = response_alloc(arena, sizeof(response_t));
+    resp->arena = arena;
+    resp->code = code;
+    resp->type = type;
+    resp->headers = NULL;
+    resp->headers_tail = NULL;
+    resp->headers_len = 0;
+    resp->body = NULL;
+    resp->body_tail = NULL;
+    resp->body_len = 0;
+    return resp;
+}
+
+bool response_add_header(response_t *resp, const char *name, const char *value) {
+    size_t name_len = strlen(name);
+    size_t value_len = strlen(value);
+    if (name_len == 0 || mystr_token_length(name, name_len) != name_len ||
+        mystr_find_any(value, value_len, "\r\n") != value_len) {
+        return false;
+    }
+    response_header_t *header = response_alloc(resp->arena, sizeof(response_header_t));
+    char *strings = response_alloc(resp->arena, name_len + value_len + 2);
+    memcpy(strings, name, name_len + 1);
+    memcpy(strings + name_len + 1, value, value_len + 1);
+    header->name = strings;
+    header->name_len = name_len;
+    header->value = strings + name_len + 1;
+    header->value_len = value_len;
+    header->next = NULL;
+    if (resp->headers_tail != NULL) {
+        resp->headers_tail->next = header;
+    } else {
+        resp->headers = header;
+    }
+    resp->headers_tail = header;
+    // "name: value\r\n"
+    resp->headers_len += name_len + 2 + value_len + 2;
+    return true;
+}
+
+void response_add_body(response_t *resp, bytes_t *segment) {
+    if (resp->body_tail != NULL) {
+        resp->body_tail->next = segment;
+    } else {
+        resp->body = segment;
+    }
+    for (; segment != NULL; segment = segment->next) {
+        assert(segment->stream == NULL && segment->response == NULL);
+        resp->body_len += segment->len;
+        resp->body_tail = segment;
+    }
+}
+
+void response_add_body_borrowed(response_t *resp, const char *data, size_t len) {
+    response_add_body(resp, bytes_init_borrowed(resp->arena, len, data));
+}
+
+void response_add_body_copy(response_t *resp, const char *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    char *copy = response_alloc(resp->arena, len);
+    memcpy(copy, data, len);
+    response_add_body(resp, bytes_init_arena(resp->arena, len, copy));
+}
+
+void response_add_body_file(response_t *resp, int fd, off_t offset, size_t len) {
+    response_add_body(resp, bytes_init_file_arena(resp->arena, fd, offset, len));
+}
+
+void response_add_body_buffer(response_t *resp, buffer_t *buffer) {
+    response_add_body(resp, bytes_init_buffer(resp->arena, buffer));
+}
+
+size_t response_body_length(const response_t *resp) {
+    return resp->body_len;
+}
+
+bytes_t *response_finish(response_t *resp) {
+    bytes_t *bytes = bytes_init_borrowed(resp->arena, 0, NULL);
+    bytes->response = resp;
+    return bytes;
+}
+
+bytes_t *response_serialize(bytes_t *bytes) {
+    response_t *resp = bytes->response;
+    if (resp == NULL) {
+        return bytes;
+    }
+    size_t header_len;
+    char *header = response_header_format(resp->arena, resp->code, resp->type, resp->body_len, resp->headers,
+                                          resp->headers_len, 0, &header_len);
+    bytes_t *serialized = bytes_init_arena(resp->arena, header_len, header);
+    // the body's segments move over as they are, whoever their contents
+    // belong to
+    serialized->next = resp->body;
+    resp->body = NULL;
+    bytes_free(bytes);
+    return serialized;
+}
+
+void response_free(response_t *resp) {
+    bytes_free(resp->body);
+    if (resp->arena != NULL) {
+        return;
+    }
+    response_header_t *header = resp->headers;
+    while (header != NULL) {
+        response_header_t *next = header->next;
+        // the name and value share an allocation
+        free(header->name);
+        free(header);
+        header = next;
+    }
+    free(resp);
 }
@@ -0,0 +1,778 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+#include "http_server.h"
+#include "network_util.h"
+#include "http_request.h"
+#include "http_response.h"
+#include "mystr.h"
+
+// maximum number of clients accepted per wakeup of the listener
+#define ACCEPT_BATCH 32
+// requests answered on one connection before the server closes it
+#define KEEP_ALIVE_MAX_REQUESTS 100
+// how long a connection may sit between requests before it is closed
+#define KEEP_ALIVE_IDLE_MS 5000
+// how long a client has to send a whole header, from its first byte
+#define HEADER_TIMEOUT_MS 10000
+// how long a body may go without any of it arriving
+#define BODY_TIMEOUT_MS 10000
+// how long a client may go without reading any of its pending responses
+#define WRITE_STALL_MS 10000
+// responses with up to this many segments are sent without allocating
+#define SEND_IOV_INLINE 8
+// how often each worker checks the clock for the Date header of its
+// responses, which is only formatted again once the second changes; often
+// enough that the date is never much behind
+#define DATE_TICK_MS 100
+#define DEFAULT_OUTPUT_HIGH_WATER (1 << 20)
+#define DEFAULT_BODY_MEMORY_LIMIT (64 << 10)
+
+// interim response to clients which wait for permission to send their body
+const char *CONTINUE_RESPONSE = "HTTP/1.1 100 Continue\r\n\r\n";
+
+/**
+ * What reading from a client led to.
+ */
+typedef enum client_step {
+    STEP_CONTINUE, // something was handled; keep going
+    STEP_WAIT,     // more input is needed
+    STEP_CLOSE,    // the connection should be closed
+} client_step_t;
+
+/**
+ * What a client is waiting on, which decides how long it may take.
+ */
+typedef enum client_timeout {
+    TIMEOUT_NONE,
+    TIMEOUT_IDLE,   // the next request
+    TIMEOUT_HEADER, // the rest of a header
+    TIMEOUT_BODY,   // more of a body
+    TIMEOUT_WRITE,  // room to send responses
+} client_timeout_t;
+
+/**
+ * Per-connection state. Clients are kept in a list so that they can all be
+ * closed along with the server.
+ */
+typedef struct client {
+    connection_t *conn;
+    http_server_t *server;
+    size_t num_requests;
+    client_timeout_t timeout;
+    // output sent as of when TIMEOUT_WRITE was last set
+    uint64_t out_progress;
+    // set while requests are left unread because too much output is queued
+    bool backlogged;
+    // the next request's header, as far as it has arrived
+    request_parser_t parser;
+    // where the current request and its response are made, reset once the
+    // response has been sent
+    arena_t *arena;
+    // a request whose body is still being received, or NULL
+    request_t *request;
+    // a streamed response which is still being produced, or NULL, and whether
+    // the connection is kept open once it is done
+    bytes_t *stream;
+    bool stream_keep_alive;
+    struct client *prev;
+    struct client *next;
+} client_t;
+
+/**
+ * A worker thread in multi-threaded mode, with its own server (and so its own
+ * listener and event loop) and its own copy of the router.
+ */
+typedef struct worker {
+    pthread_t thread;
+    http_server_t *server;
+    router_t *router;
+} worker_t;
+
+struct http_server {
+    router_t *router;
+    http_server_options_t options;
+    nu_listener_t *listener;
+    nu_loop_t *loop;
+    client_t *client_head;
+    client_t *client_tail;
+};
+
+static void client_unlink(client_t *client) {
+    http_server_t *server = client->server;
+    if (client->prev != NULL) {
+        client->prev->next = client->next;
+    } else {
+        server->client_head = client->next;
+    }
+    if (client->next != NULL) {
+        client->next->prev = client->prev;
+    } else {
+        server->client_tail = client->prev;
+    }
+    client->prev = NULL;
+    client->next = NULL;
+}
+
+static void client_append(client_t *client) {
+    http_server_t *server = client->server;
+    client->prev = server->client_tail;
+    client->next = NULL;
+    if (server->client_tail != NULL) {
+        server->client_tail->next = client;
+    } else {
+        server->client_head = client;
+    }
+    server->client_tail = client;
+}
+
+
+static client_t *client_init(http_server_t *server, connection_t *conn) {
+    client_t *client = malloc(sizeof(client_t));
+    assert(client);
+    client->conn = conn;
+    client->server = server;
+    client->num_requests = 0;
+    client->timeout = TIMEOUT_NONE;
+    client->out_progress = 0;
+    client->backlogged = false;
+    request_parser_init(&client->parser);
+    client->arena = arena_init(ARENA_DEFAULT_CHUNK_SIZE);
+    client->request = NULL;
+    client->stream = NULL;
+    client->stream_keep_alive = false;
+    client_append(client);
+    return client;
+}
+
+static void client_free(client_t *client) {
+    client_unlink(client);
+    request_parser_free(&client->parser);
+    if (client->request != NULL) {
+        request_free(client->request);
+    }
+    bytes_free(client->stream);
+    arena_free(client->arena);
+    free(client);
+}
+
+static void client_close(client_t *client) {
+    nu_loop_close(client->server->loop, client->conn);
+    client_free(client);
+}
+
+/**
+ * Hangs up on a client which may have sent more than the server has read, e.g.,
+ * the rest of a request it has answered with an error, or requests pipelined
+ * after a response that closes the connection. The connection is only closed
+ * once the client has stopped sending (see `nu_loop_shutdown`), so that the
+ * input left unread doesn't get it reset before the client has read the last
+ * response.
+ */
+static void client_shutdown(client_t *client) {
+    nu_loop_shutdown(client->server->loop, client->conn);
+    client_free(client);
+}
+
+/**
+ * Returns whether the Connection header lists `option`, e.g., "close" in
+ * "Connection: close" or "keep-alive" in "Connection: keep-alive, Upgrade".
+ */
+static bool connection_has(const char *connection, const char *option) {
+    if (connection == NULL) {
+        return false;
+    }
+    size_t option_len = strlen(option);
+    mystr_tokenizer_t tok;
+    mystr_tokenizer_init_any(&tok, connection, ", \t");
+    const char *token;
+    size_t len;
+    while (mystr_next_token(&tok, &token, &len)) {
+        if (len == option_len && mystr_equal_nocase(token, option, len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns whether the client asked for the connection to stay open after this
+ * request: the default for HTTP/1.1 unless it sent `Connection: close`, and
+ * only on request for older versions.
+ */
+static bool wants_keep_alive(request_t *request) {
+    const char *connection = request_known_header(request, HEADER_CONNECTION);
+    if (strcmp(request->http_version, "HTTP/1.1") == 0) {
+        return !connection_has(connection, "close");
+    }
+    return connection_has(connection, "keep-alive");
+}
+
+/**
+ * Returns whether a segment's memory can be kept alive by taking a reference
+ * on it, rather than copied, if it has to wait to be sent.
+ */
+static bool segment_shared(const bytes_t *segment) {
+    return segment->kind == BYTES_SHARED && segment->retain != NULL;
+}
+
+/**
+ * Sends every segment of `response` with one gathering write. Shared segments
+ * that can't be sent right away are queued by reference instead of copied.
+ *
+ * Returns whether the whole response was sent.
+ */
+static bool send_response(connection_t *conn, bytes_t *response) {
+    size_t num_segments = 0;
+    bool shared = false;
+    for (bytes_t *segment = response; segment != NULL; segment = segment->next) {
+        num_segments++;
+        shared = shared || segment_shared(segment);
+    }
+    struct iovec inline_iov[SEND_IOV_INLINE];
+    nu_ref_t inline_refs[SEND_IOV_INLINE];
+    struct iovec *iov = inline_iov;
+    nu_ref_t *refs = shared ? inline_refs : NULL;
+    if (num_segments > SEND_IOV_INLINE) {
+        iov = malloc(num_segments * sizeof(struct iovec));
+        assert(iov);
+        if (shared) {
+            refs = malloc(num_segments * sizeof(nu_ref_t));
+            assert(refs);
+        }
+    }
+    /* In-memory segments are gathered until a file-backed one, which is sent
+     * with sendfile right behind them. */
+    bool sent = true;
+    size_t i = 0;
+    for (bytes_t *segment = response; segment != NULL && sent; segment = segment->next) {
+        if (segment->fd >= 0) {
+            sent = nu_send_file_refs(conn, iov, refs, i, segment->fd, segment->offset, segment->len) >= 0;
+            i = 0;
+            continue;
+        }
+        iov[i].iov_base = segment->data;
+        iov[i].iov_len = segment->len;
+        if (refs != NULL) {
+            refs[i] = segment_shared(segment)
+                ? (nu_ref_t) { .retain = segment->retain, .release = segment->release, .owner = segment->owner }
+                : (nu_ref_t) { 0 };
+        }
+        i++;
+    }
+    if (sent && i > 0) {
+        sent = nu_send_iov_refs(conn, iov, refs, i) >= 0;
+    }
+    if (iov != inline_iov) {
+        free(iov);
+        free(refs);
+    }
+    return sent;
+}
+
+/**
+ * Sends the headers of a streamed response and makes it the client's current
+ * stream, to be produced by client_stream. Takes ownership of `response`.
+ *
+ * Returns whether the headers were sent.
+ */
+static bool client_start_stream(client_t *client, bytes_t *response, bool chunked, bool keep_alive) {
+    // without chunked encoding, the end of the body is marked by the end of
+    // the connection
+    client->stream = response;
+    client->stream_keep_alive = keep_alive && chunked;
+    bytes_t *header = response_stream_header(response->stream, chunked);
+    bool sent = send_response(client->conn, header);
+    bytes_free(header);
+    return sent;
+}
+
+/**
+ * Dispatches a request, whose body has been received in full, through the
+ * router and sends the response. Takes ownership of `request`.
+ *
+ * A streamed response only has its headers sent here; its body follows from
+ * client_stream.
+ *
+ * Nothing the request and its response left in the client's arena is needed
+ * once the response has been sent or queued (which copies it), so the arena is
+ * reset for the next request.
+ *
+ * Returns whether the connection should be kept open for another request.
+ */
+static bool serve_request(client_t *client, request_t *request) {
+    client->num_requests++;
+    bool keep_alive = wants_keep_alive(request) && client->num_requests < KEEP_ALIVE_MAX_REQUESTS;
+    bool chunked = strcmp(request->http_version, "HTTP/1.1") == 0;
+
+    bytes_t *response = router_dispatch(client->server->router, request);
+    if (response->response != NULL) {
+        // a built response is only formatted now, so the client can still be
+        // told whether the connection stays open
+        if (!keep_alive) {
+            response_add_header(response->response, "Connection", "close");
+        } else if (!chunked) {
+            response_add_header(response->response, "Connection", "keep-alive");
+        }
+        response = response_serialize(response);
+    }
+    if (response->stream != NULL) {
+        keep_alive = client_start_stream(client, response, chunked, keep_alive);
+    } else {
+        if (!send_response(client->conn, response)) {
+            keep_alive = false;
+        }
+        bytes_free(response);
+    }
+    arena_reset(client->arena);
+    return keep_alive;
+}
+
+/**
+ * Produces and sends the client's streamed response a piece at a time for as
+ * long as each piece is sent right away. Once one has to be queued, the rest
+ * waits for on_client_writable, so at most one piece is ever buffered.
+ */
+static client_step_t client_stream(client_t *client) {
+    while (nu_pending_output(client->conn) == 0) {
+        bool done = false;
+        bytes_t *piece = response_stream_next(client->stream->stream, &done);
+        bool sent = piece->len == 0 || send_response(client->conn, piece);
+        bytes_free(piece);
+        if (!sent) {
+            return STEP_CLOSE;
+        }
+        if (done) {
+            bytes_free(client->stream);
+            client->stream = NULL;
+            return client->stream_keep_alive ? STEP_CONTINUE : STEP_CLOSE;
+        }
+    }
+    return STEP_WAIT;
+}
+
+/**
+ * Answers a request the server won't serve with an empty error response. The
+ * connection is closed afterwards, since whatever follows can't be trusted to
+ * be the start of another request, and the response says so, so that the
+ * client doesn't send its next request down it.
+ */
+static void send_error(client_t *client, response_code_t code) {
+    response_t *error = response_init(client->arena, code, MIME_PLAIN);
+    response_add_header(error, "Connection", "close");
+    bytes_t *response = response_serialize(response_finish(error));
+    send_response(client->conn, response);
+    bytes_free(response);
+}
+
+/**
+ * Sets up `request` to receive the body its headers announce, if any, with the
+ * size limit of the route it is for.
+ *
+ * Returns false, after answering with an error, if the body can't be accepted.
+ */
+static bool client_start_body(client_t *client, request_t *request) {
+    const char *transfer_encoding = request_known_header(request, HEADER_TRANSFER_ENCODING);
+    const char *content_length = request_known_header(request, HEADER_CONTENT_LENGTH);
+    // a length sent twice is only trusted if it is the same both times, since
+    // a proxy in front might have gone by the other one
+    size_t cursor = 0;
+    const char *other_length = NULL;
+    while ((other_length = header_map_next_value(request->headers, "Content-Length", &cursor)) != NULL) {
+        if (strcmp(other_length, content_length) != 0) {
+            send_error(client, HTTP_BAD_REQUEST);
+            return false;
+        }
+    }
+    bool chunked = transfer_encoding != NULL && strcasecmp(transfer_encoding, "chunked") == 0;
+    if (transfer_encoding != NULL && !chunked) {
+        send_error(client, HTTP_BAD_REQUEST);
+        return false;
+    }
+
+    size_t length = 0;
+    if (!chunked && content_length != NULL) {
+        char *end = NULL;
+        errno = 0;
+        length = strtoull(content_length, &end, 10);
+        if (end == content_length || *end != '\0' || errno != 0 || content_length[0] == '-') {
+            send_error(client, HTTP_BAD_REQUEST);
+            return false;
+        }
+    }
+    if (!chunked && length == 0) {
+        return true;
+    }
+
+    http_server_t *server = client->server;
+    size_t max_body = router_max_body(server->router, request_path(request));
+    if (!chunked && length > max_body) {
+        send_error(client, HTTP_PAYLOAD_TOO_LARGE);
+        return false;
+    }
+    const char *expect = request_known_header(request, HEADER_EXPECT);
+    if (expect != NULL && strcasecmp(expect, "100-continue") == 0) {
+        struct iovec iov = { .iov_base = (char *) CONTINUE_RESPONSE, .iov_len = strlen(CONTINUE_RESPONSE) };
+        nu_send_iov(client->conn, &iov, 1);
+    }
+    request->body = request_body_init(chunked, length, max_body, server->options.body_memory_limit);
+    return true;
+}
+
+/**
+ * Parses as much of the next request's header as has been received. The
+ * client's parser picks up where it left off last time, so a header that
+ * trickles in is still only looked at once, and a malformed one is answered
+ * as soon as it goes wrong rather than once it ends. The header is parsed in
+ * place in the connection's input buffer, copied out into a request once it
+ * is complete, and then consumed. Requests without a body are served right
+ * away.
+ */
+static client_step_t client_read_header(client_t *client) {
+    size_t len = 0;
+    char *data = nu_peek_input(client->conn, &len);
+    if (data == NULL) {
+        return STEP_WAIT;
+    }
+    switch (request_parser_feed(&client->parser, data, len)) {
+        case PARSE_INCOMPLETE:
+            return STEP_WAIT;
+        case PARSE_ERROR:
+            send_error(client, client->parser.error);
+            return STEP_CLOSE;
+        case PARSE_COMPLETE:
+            break;
+    }
+    // the next header gets a deadline of its own
+    client->timeout = TIMEOUT_NONE;
+    request_view_t view;
+    request_parser_view(&client->parser, data, &view);
+    request_t *request = request_from_view_arena(&view, client->arena);
+    request_view_free(&view);
+    nu_consume_input(client->conn, request_parser_length(&client->parser));
+    request_parser_free(&client->parser);
+    request_parser_init(&client->parser);
+    if (request_path(request) == NULL) {
+        // routes and files are found by the decoded path, so a path that
+        // can't be decoded can't be served
+        send_error(client, HTTP_BAD_REQUEST);
+        request_free(request);
+        return STEP_CLOSE;
+    }
+    if (!client_start_body(client, request)) {
+        request_free(request);
+        return STEP_CLOSE;
+    }
+    if (request->body != NULL) {
+        client->request = request;
+        return STEP_CONTINUE;
+    }
+    return serve_request(client, request) ? STEP_CONTINUE : STEP_CLOSE;
+}
+
+/**
+ * Feeds whatever has been received of the current request's body to it, and
+ * serves the request once the body is complete.
+ */
+static client_step_t client_read_body(client_t *client) {
+    size_t len = 0;
+    char *data = nu_peek_input(client->conn, &len);
+    if (data == NULL) {
+        return STEP_WAIT;
+    }
+    size_t consumed = 0;
+    body_status_t status = request_body_feed(client->request->body, data, len, &consumed);
+    nu_consume_input(client->conn, consumed);
+
+    request_t *request = client->request;
+    switch (status) {
+        case BODY_INCOMPLETE:
+            return STEP_WAIT;
+        case BODY_COMPLETE:
+            client->request = NULL;
+            return serve_request(client, request) ? STEP_CONTINUE : STEP_CLOSE;
+        case BODY_TOO_LARGE:
+            send_error(client, HTTP_PAYLOAD_TOO_LARGE);
+            return STEP_CLOSE;
+        case BODY_INVALID:
+            send_error(client, HTTP_BAD_REQUEST);
+            return STEP_CLOSE;
+        default:
+            return STEP_CLOSE;
+    }
+}
+
+/**
+ * Closes a client which has taken too long over whatever it was doing, unless
+ * it was reading its responses and has made progress since the last check.
+ */
+static void on_client_timeout(nu_loop_t *loop, connection_t *conn, void *aux) {
+    client_t *client = aux;
+    if (client->timeout == TIMEOUT_WRITE && nu_pending_output(conn) > 0 && nu_output_progress(conn) != client->out_progress) {
+        client->out_progress = nu_output_progress(conn);
+        nu_set_timeout(conn, WRITE_STALL_MS, on_client_timeout);
+        return;
+    }
+    // lingering to send the rest would only give a stalled client more time
+    if (client->timeout == TIMEOUT_WRITE) {
+        nu_loop_abort(loop, conn);
+    }
+    client_close(client);
+}
+
+/**
+ * Sets the deadline for what the client is now waiting on. Waiting for the
+ * next request or more of a body restarts the clock each time, but a header
+ * has to arrive in full within HEADER_TIMEOUT_MS of its first byte, however
+ * slowly it trickles in, and pending output is only given more time if some
+ * of it has been sent.
+ */
+static void client_wait(client_t *client) {
+    connection_t *conn = client->conn;
+    size_t input_len = 0;
+    client_timeout_t timeout = TIMEOUT_IDLE;
+    int timeout_ms = KEEP_ALIVE_IDLE_MS;
+    if (nu_pending_output(conn) > 0) {
+        timeout = TIMEOUT_WRITE;
+        timeout_ms = WRITE_STALL_MS;
+    } else if (client->request != NULL) {
+        timeout = TIMEOUT_BODY;
+        timeout_ms = BODY_TIMEOUT_MS;
+    } else if (nu_peek_input(conn, &input_len) != NULL) {
+        timeout = TIMEOUT_HEADER;
+        timeout_ms = HEADER_TIMEOUT_MS;
+    }
+    if (timeout == client->timeout && (timeout == TIMEOUT_HEADER || timeout == TIMEOUT_WRITE)) {
+        return;
+    }
+    client->timeout = timeout;
+    client->out_progress = nu_output_progress(conn);
+    nu_set_timeout(conn, timeout_ms, on_client_timeout);
+}
+
+/**
+ * Returns whether more of the client's responses are waiting to be sent than
+ * the server is willing to buffer.
+ */
+static bool client_backlogged(client_t *client) {
+    return nu_pending_output(client->conn) > client->server->options.output_high_water;
+}
+
+/**
+ * Answers every complete request the client has sent, in order, then waits to
+ * be called again when more arrives. Pipelined requests are taken out of the
+ * connection's input buffer one at a time. A request with a body is answered
+ * once all of it has arrived, which may take several calls.
+ *
+ * If the client's responses back up past the high-water mark, or a streamed
+ * response is waiting for its last piece to be sent, its requests are left
+ * unread (in the input buffer and the socket) until on_client_writable finds
+ * the output drained.
+ */
+static void on_client_readable(nu_loop_t *loop, connection_t *conn, void *aux) {
+    (void) loop;
+    client_t *client = aux;
+    while (true) {
+        client_step_t step = STEP_CONTINUE;
+        while (step == STEP_CONTINUE) {
+            // a body being received is always read, so that its request can
+            // be answered and the client's output drained
+            if (client->request == NULL && client_backlogged(client)) {
+                client->backlogged = true;
+                client_wait(client);
+                return;
+            }
+            // the next request isn't read until the streamed response before
+            // it is done, which on_client_writable picks back up
+            if (client->stream != NULL) {
+                step = client_stream(client);
+                if (step == STEP_WAIT) {
+                    client_wait(client);
+                    return;
+                }
+                continue;
+            }
+            step = client->request != NULL ? client_read_body(client) : client_read_header(client);
+        }
+        if (step == STEP_CLOSE) {
+            client_shutdown(client);
+            return;
+        }
+        // a header that doesn't fit in the input buffer is never going to
+        // be completed
+        if (client->request == NULL && nu_input_full(conn)) {
+            send_error(client, HTTP_HEADER_FIELDS_TOO_LARGE);
+            client_shutdown(client);
+            return;
+        }
+        ssize_t received = nu_recv(conn);
+        if (received < 0) {
+            client_close(client);
+            return;
+        }
+        if (received == 0) {
+            client_wait(client);
+            return;
+        }
+    }
+}
+
+/**
+ * Resumes a streamed response, or reading from a client, once the responses it
+ * was behind on have all been sent.
+ */
+static void on_client_writable(nu_loop_t *loop, connection_t *conn, void *aux) {
+    client_t *client = aux;
+    if (client->backlogged || client->stream != NULL) {
+        client->backlogged = false;
+        on_client_readable(loop, conn, client);
+    } else {
+        client_wait(client);
+    }
+}
+
+static void on_date_tick(nu_loop_t *loop, void *aux) {
+    (void) loop;
+    (void) aux;
+    // the tick runs on the loop's own thread, whose responses use the date
+    response_date_refresh(time(NULL));
+}
+
+static void on_accept(nu_loop_t *loop, nu_listener_t *listener, void *aux) {
+    http_server_t *server = aux;
+    connection_t *clients[ACCEPT_BATCH];
+    size_t num_clients = nu_accept(listener, clients, ACCEPT_BATCH);
+    for (size_t i = 0; i < num_clients; i++) {
+        client_t *client = client_init(server, clients[i]);
+        if (nu_loop_add(loop, clients[i], on_client_readable, on_client_writable, client) < 0) {
+            client_free(client);
+            nu_close_connection(clients[i]);
+            continue;
+        }
+        client_wait(client);
+    }
+}
+
+/**
+ * Creates a server accepting clients from `listener`, taking ownership of it.
+ * On failure the listener is freed and NULL is returned.
+ */
+static http_server_t *http_server_init_listener(nu_listener_t *listener, router_t *router, const http_server_options_t *options) {
+    // unlike sendmsg, sendfile can't be told MSG_NOSIGNAL, so a client hanging
+    // up mid-file would otherwise kill the process
+    signal(SIGPIPE, SIG_IGN);
+
+    nu_loop_t *loop = nu_loop_init(options->backend);
+    if (loop == NULL) {
+        nu_listener_free(listener);
+        return NULL;
+    }
+
+    http_server_t *server = malloc(sizeof(http_server_t));
+    assert(server);
+    server->router = router;
+    server->options = *options;
+    server->listener = listener;
+    server->loop = loop;
+    server->client_head = NULL;
+    server->client_tail = NULL;
+    if (nu_loop_add_listener(loop, listener, on_accept, server) < 0) {
+        http_server_free(server);
+        return NULL;
+    }
+    nu_loop_set_tick(loop, DATE_TICK_MS, on_date_tick, NULL);
+    return server;
+}
+
+http_server_options_t http_server_default_options(void) {
+    http_server_options_t options = {
+        .backend = NU_BACKEND_EPOLL,
+        .output_high_water = DEFAULT_OUTPUT_HIGH_WATER,
+        .body_memory_limit = DEFAULT_BODY_MEMORY_LIMIT,
+    };
+    return options;
+}
+
+http_server_t *http_server_init(int port, router_t *router, const http_server_options_t *options) {
+    nu_listener_t *listener = nu_listen(port);
+    if (listener == NULL) {
+        return NULL;
+    }
+    return http_server_init_listener(listener, router, options);
+}
+
+void http_server_run(http_server_t *server) {
+    nu_loop_run(server->loop);
+}
+
+static void *worker_run(void *aux) {
+    http_server_run(aux);
+    return NULL;
+}
+
+int http_server_run_workers(int port, router_t *router, size_t num_workers, const http_server_options_t *options) {
+    assert(num_workers > 0);
+    worker_t *workers = calloc(num_workers, sizeof(worker_t));
+    assert(workers);
+
+    // bind every listener before starting any threads, so that a bad port is
+    // reported to the caller instead of killing a worker
+    int ret = 0;
+    size_t num_ready = 0;
+    for (; num_ready < num_workers; num_ready++) {
+        nu_listener_t *listener = nu_listen_shared(port);
+        if (listener == NULL) {
+            ret = -1;
+            break;
+        }
+        router_t *worker_router = router_copy(router);
+        http_server_t *server = http_server_init_listener(listener, worker_router, options);
+        if (server == NULL) {
+            router_free(worker_router);
+            ret = -1;
+            break;
+        }
+        workers[num_ready].server = server;
+        workers[num_ready].router = worker_router;
+    }
+
+    size_t num_started = 0;
+    if (ret == 0) {
+        // the calling thread serves as the first worker
+        for (num_started = 1; num_started < num_workers; num_started++) {
+            worker_t *worker = &workers[num_started];
+            if (pthread_create(&worker->thread, NULL, worker_run, worker->server) != 0) {
+                perror("pthread_create");
+                break;
+            }
+        }
+        http_server_run(workers[0].server);
+        for (size_t i = 1; i < num_started; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+
+    for (size_t i = 0; i < num_ready; i++) {
+        http_server_free(workers[i].server);
+        router_free(workers[i].router);
+    }
+    free(workers);
+    return ret;
+}
+
+void http_server_free(http_server_t *server) {
+    while (server->client_head != NULL) {
+        client_close(server->client_head);
+    }
+    nu_loop_free(server->loop);
+    nu_listener_free(server->listener);
+    free(server);
+}
@@ -0,0 +1,53 @@
+#include <stdint.h>
+#include <assert.h>
+
+#include "known_headers.h"
+#include "mystr.h"
+
+// the size of the hash table, a power of two
+#define KNOWN_HEADERS_TABLE_SIZE 32
+
+/*
+ * The perfect hash: a name's length and its first and last letters (in
+ * lowercase), weighted so that no two known headers land in the same slot.
+ * The weights were found by trying small ones until every header had a slot
+ * of its own.
+ */
+#define KNOWN_HEADER_HASH(len, first, last) (((len) + 7 * (first) + 24 * (last)) & (KNOWN_HEADERS_TABLE_SIZE - 1))
+
+#define KNOWN_HEADER_SLOT(id, name, first, last) [KNOWN_HEADER_HASH(sizeof(name) - 1, first, last)] = HEADER_##id,
+#define KNOWN_HEADER_NAME(id, name, first, last) [HEADER_##id] = name,
+#define KNOWN_HEADER_LENGTH(id, name, first, last) [HEADER_##id] = sizeof(name) - 1,
+
+// which known header each hash belongs to; the rest are HEADER_UNKNOWN (0)
+static const uint8_t KNOWN_HEADER_TABLE[KNOWN_HEADERS_TABLE_SIZE] = {
+    KNOWN_HEADERS(KNOWN_HEADER_SLOT)
+};
+
+static const char *const KNOWN_HEADER_NAMES[KNOWN_HEADERS_END] = {
+    [HEADER_UNKNOWN] = NULL,
+    KNOWN_HEADERS(KNOWN_HEADER_NAME)
+};
+
+static const uint8_t KNOWN_HEADER_LENGTHS[KNOWN_HEADERS_END] = {
+    KNOWN_HEADERS(KNOWN_HEADER_LENGTH)
+};
+
+known_header_t known_header_lookup(const char *name, size_t len) {
+    if (len == 0) {
+        return HEADER_UNKNOWN;
+    }
+    // setting 0x20 lowercases letters, and the check below rejects anything
+    // else that it happens to make match
+    size_t hash = KNOWN_HEADER_HASH(len, (unsigned char) name[0] | 0x20, (unsigned char) name[len - 1] | 0x20);
+    known_header_t id = KNOWN_HEADER_TABLE[hash];
+    if (id == HEADER_UNKNOWN || KNOWN_HEADER_LENGTHS[id] != len) {
+        return HEADER_UNKNOWN;
+    }
+    return mystr_equal_nocase(KNOWN_HEADER_NAMES[id], name, len) ? id : HEADER_UNKNOWN;
+}
+
+const char *known_header_name(known_header_t id) {
+    assert(id != HEADER_UNKNOWN && id < KNOWN_HEADERS_END);
+    return KNOWN_HEADER_NAMES[id];
+}
@@ -14,6 +14,8 @@ typedef struct node {
 typedef struct ll_map {
     size_t length;
     node_t *head;
+    // where the nodes come from, or NULL if they and the entries are on the heap
+    arena_t *arena;
 } ll_map_t;
 
 /**
@@ -22,7 +24,7 @@ typedef struct ll_map {
  * The returned node should be heap-allocated with malloc and it takes ownership
  * of the arguments so the caller should not modify or free them afterward.
  */
-static node_t *node_init(char *key, char* value);
+static node_t *node_init(ll_map_t *dict, char *key, char* value);
 
 /**
  * Frees a linked list node and all nodes it points to.
@@ -33,8 +35,8 @@ static node_t *node_init(char *key, char* value);
  */
 static void node_free(node_t *curr);
 
-static node_t *node_init(char *key, char* value) {
-    node_t *node = malloc(sizeof(node_t));
+static node_t *node_init(ll_map_t *dict, char *key, char* value) {
+    node_t *node = dict->arena != NULL ? arena_alloc(dict->arena, sizeof(node_t)) : malloc(sizeof(node_t));
     assert(node);
     node->entry.key = key;
     node->entry.value = value;
@@ -61,10 +63,22 @@ ll_map_t *ll_init(void) {
 
     linked_list->length = 0;
     linked_list->head = NULL;
+    linked_list->arena = NULL;
+    return linked_list;
+}
+
+ll_map_t *ll_init_arena(arena_t *arena) {
+    ll_map_t *linked_list = arena_alloc(arena, sizeof(ll_map_t));
+    linked_list->length = 0;
+    linked_list->head = NULL;
+    linked_list->arena = arena;
     return linked_list;
 }
 
 void ll_free(ll_map_t *dict) {
+    if (dict->arena != NULL) {
+        return;
+    }
     node_free(dict->head);
     free(dict);
 }
@@ -74,7 +88,9 @@ char *ll_put(ll_map_t *dict, char *key, char *value) {
     if (curr != NULL){
         while (curr->next != NULL){
             if (strcmp(curr->entry.key, key) == 0){
-                free(key);
+                if (dict->arena == NULL) {
+                    free(key);
+                }
                 char *old_value = curr->entry.value;
                 curr->entry.value = value;
                 return old_value;
@@ -82,20 +98,22 @@ char *ll_put(ll_map_t *dict, char *key, char *value) {
             curr = curr->next;
         }
         if (strcmp(curr->entry.key, key) == 0){
-            free(key);
+            if (dict->arena == NULL) {
+                free(key);
+            }
                 char *old_value = curr->entry.value;
                 curr->entry.value = value;
                 return old_value;
         }
         else {
-            curr->next = node_init(key, value);
+            curr->next = node_init(dict, key, value);
             dict->length++;
             return NULL;
         }
     }
 
     else {
-        dict->head = node_init(key, value);
+        dict->head = node_init(dict, key, value);
         dict->length++;
         return NULL;
     }
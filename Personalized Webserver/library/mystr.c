@@ -7,49 +7,389 @@
 #include "strarray.h"
 #include "mystr.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#define MYSTR_X86 1
+#include <immintrin.h>
+#endif
+
 ssize_t mystr_indexof(const char *str, const char sep, size_t start) {
-    for(size_t i = start; i < strlen(str); i++){
-        if(str[i] == sep){
-            return i;
-        }
+    // only as much of the string as is needed is measured and searched
+    if (sep == '\0' || strnlen(str, start) < start) {
+        return -1;
+    }
+    const char *found = strchr(str + start, sep);
+    return found != NULL ? found - str : -1;
+}
+
+void mystr_tokenizer_init(mystr_tokenizer_t *tok, const char *str, const char sep) {
+    char seps[2] = {sep, '\0'};
+    mystr_tokenizer_init_any(tok, str, seps);
+}
+
+void mystr_tokenizer_init_any(mystr_tokenizer_t *tok, const char *str, const char *seps) {
+    assert(strlen(seps) <= MYSTR_MAX_SEPS);
+    tok->next = str;
+    tok->end = str + strlen(str);
+    strcpy(tok->seps, seps);
+}
+
+bool mystr_next_token(mystr_tokenizer_t *tok, const char **token, size_t *len) {
+    const char *start = tok->next;
+    // runs of separators are short, so they are skipped a byte at a time
+    while (start < tok->end && strchr(tok->seps, *start) != NULL) {
+        start++;
+    }
+    if (start == tok->end) {
+        tok->next = start;
+        return false;
     }
-    return -1;
+    const char *stop = start + mystr_find_any(start, tok->end - start, tok->seps);
+    *token = start;
+    *len = stop - start;
+    tok->next = stop;
+    return true;
 }
 
 strarray_t *mystr_split(const char *str, const char sep) {
-    
+    // the pieces are counted and measured first, so that the array and all
+    // of them fit in a single allocation
+    mystr_tokenizer_t start;
+    mystr_tokenizer_init(&start, str, sep);
+    mystr_tokenizer_t tok = start;
+    const char *token;
+    size_t len;
     size_t counter = 0;
+    size_t size = 0;
+    while (mystr_next_token(&tok, &token, &len)) {
+        counter++;
+        size += len + 1;
+    }
+
+    char *storage;
+    strarray_t *final = strarray_init_contiguous(counter, size, &storage);
+    size_t array_idx = 0;
+    tok = start;
+    while (mystr_next_token(&tok, &token, &len)) {
+        memcpy(storage, token, len);
+        storage[len] = '\0';
+        final->data[array_idx++] = storage;
+        storage += len + 1;
+    }
+    return final;
+}
+
+// "00" to "99", for writing numbers two digits at a time
+static const char DIGIT_PAIRS[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const uint64_t POWERS_OF_TEN[MYSTR_UTOA_MAX] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+    1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+    100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+    1000000000000000000ull, 10000000000000000000ull,
+};
+
+size_t mystr_utoa_length(uint64_t n) {
+    // 1233 / 4096 is just under log10(2), so this is one less than the number
+    // of digits of n, or of the largest number with as many bits; the table
+    // tells which. n | 1 has as many digits as n, except that 0 gets one.
+    size_t bits = 64 - __builtin_clzll(n | 1);
+    size_t digits = (bits * 1233) >> 12;
+    return digits + ((n | 1) >= POWERS_OF_TEN[digits]);
+}
+
+size_t mystr_utoa(char *dst, uint64_t n) {
+    size_t len = mystr_utoa_length(n);
+    char *end = dst + len;
+    while (n >= 100) {
+        end -= 2;
+        memcpy(end, &DIGIT_PAIRS[2 * (n % 100)], 2);
+        n /= 100;
+    }
+    if (n >= 10) {
+        memcpy(dst, &DIGIT_PAIRS[2 * n], 2);
+    } else {
+        dst[0] = '0' + n;
+    }
+    return len;
+}
+
+/*
+ * The kernels' implementations. The vector versions handle whole blocks of 16
+ * (SSE2) or 32 (AVX2) bytes and leave what's left to the next narrower
+ * version, down to the scalar one.
+ *
+ * SSE2 and AVX2 only compare bytes as signed, so bytes past ASCII are
+ * negative, which conveniently puts them outside every range of ASCII
+ * characters tested for.
+ */
+
+static char fold(char c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static bool is_tchar(unsigned char c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        return true;
+    }
+    return c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != NULL;
+}
 
-    for (size_t i = 0; i < strlen(str); i++) {
-        if (str[i] != sep && (i == 0 || str[i - 1] == sep)) {
-            counter++;
+static size_t find_any_scalar(const char *buf, size_t len, const char *seps, size_t num_seps) {
+    for (size_t i = 0; i < len; i++) {
+        if (memchr(seps, buf[i], num_seps) != NULL) {
+            return i;
         }
     }
-    
-    strarray_t *final = strarray_init(counter);
-    size_t array_idx = 0;
-    size_t temp_idx = 0;
+    return len;
+}
 
-    char *temp = malloc(strlen(str) + 1);
-    assert(temp);
+static bool equal_nocase_scalar(const char *a, const char *b, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (fold(a[i]) != fold(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    for (size_t i = 0; i < strlen(str); i++){
-        if (str[i] != sep){
-            temp[temp_idx] = str[i];
-            temp_idx++;
-            if (str[i + 1] == sep || str[i + 1] == '\0'){
-                temp[temp_idx] = '\0';
-                final->data[array_idx] = malloc(strlen(temp) + 1);
-                assert(final->data[array_idx]);
-                strcpy(final->data[array_idx], temp);
-                array_idx++;
-                temp_idx = 0;
-                temp[0] = '\0';
-             }
+static size_t token_length_scalar(const char *buf, size_t len) {
+    size_t i = 0;
+    while (i < len && is_tchar(buf[i])) {
+        i++;
+    }
+    return i;
+}
 
+#ifdef MYSTR_X86
+__attribute__((target("sse2")))
+static size_t find_any_sse2(const char *buf, size_t len, const char *seps, size_t num_seps) {
+    __m128i sep[MYSTR_MAX_SEPS];
+    for (size_t j = 0; j < num_seps; j++) {
+        sep[j] = _mm_set1_epi8(seps[j]);
+    }
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *) (buf + i));
+        __m128i match = _mm_setzero_si128();
+        for (size_t j = 0; j < num_seps; j++) {
+            match = _mm_or_si128(match, _mm_cmpeq_epi8(b, sep[j]));
+        }
+        unsigned mask = _mm_movemask_epi8(match);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
         }
     }
+    return i + find_any_scalar(buf + i, len - i, seps, num_seps);
+}
 
-    free(temp);
-    return final;
-}
\ No newline at end of file
+/**
+ * Lowercases the ASCII letters in a block.
+ */
+__attribute__((target("sse2")))
+static __m128i fold_sse2(__m128i b) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(b, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(b, _mm_set1_epi8('Z' + 1)));
+    return _mm_add_epi8(b, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+
+__attribute__((target("sse2")))
+static bool equal_nocase_sse2(const char *a, const char *b, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = fold_sse2(_mm_loadu_si128((const __m128i *) (a + i)));
+        __m128i y = fold_sse2(_mm_loadu_si128((const __m128i *) (b + i)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff) {
+            return false;
+        }
+    }
+    return equal_nocase_scalar(a + i, b + i, len - i);
+}
+
+/**
+ * Returns a mask of the bytes in `b` in the range [lo, hi].
+ */
+__attribute__((target("sse2")))
+static __m128i in_range_sse2(__m128i b, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(b, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(b, _mm_set1_epi8(hi + 1)));
+}
+
+/*
+ * The token characters are the visible ASCII characters ('!' to '~') other
+ * than the delimiters "(),/:;<=>?@[\]{}, which are three ranges and five
+ * single characters.
+ */
+__attribute__((target("sse2")))
+static size_t token_length_sse2(const char *buf, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *) (buf + i));
+        __m128i delim = _mm_or_si128(in_range_sse2(b, ':', '@'),
+                                     _mm_or_si128(in_range_sse2(b, '[', ']'), in_range_sse2(b, '(', ')')));
+        delim = _mm_or_si128(delim, _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('"')),
+                                                 _mm_cmpeq_epi8(b, _mm_set1_epi8(','))));
+        delim = _mm_or_si128(delim, _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('/')),
+                                                 _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('{')),
+                                                              _mm_cmpeq_epi8(b, _mm_set1_epi8('}')))));
+        __m128i token = _mm_andnot_si128(delim, in_range_sse2(b, '!', '~'));
+        unsigned mask = ~_mm_movemask_epi8(token) & 0xffff;
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + token_length_scalar(buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t find_any_avx2(const char *buf, size_t len, const char *seps, size_t num_seps) {
+    __m256i sep[MYSTR_MAX_SEPS];
+    for (size_t j = 0; j < num_seps; j++) {
+        sep[j] = _mm256_set1_epi8(seps[j]);
+    }
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i *) (buf + i));
+        __m256i match = _mm256_setzero_si256();
+        for (size_t j = 0; j < num_seps; j++) {
+            match = _mm256_or_si256(match, _mm256_cmpeq_epi8(b, sep[j]));
+        }
+        unsigned mask = _mm256_movemask_epi8(match);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    // the narrower kernels that finish the job are not VEX-encoded, so the
+    // upper halves of the registers are cleared first to keep them from stalling
+    _mm256_zeroupper();
+    return i + find_any_sse2(buf + i, len - i, seps, num_seps);
+}
+
+__attribute__((target("avx2")))
+static __m256i in_range_avx2(__m256i b, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(b, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), b));
+}
+
+__attribute__((target("avx2")))
+static bool equal_nocase_avx2(const char *a, const char *b, size_t len) {
+    const __m256i case_bit = _mm256_set1_epi8('a' - 'A');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+        x = _mm256_add_epi8(x, _mm256_and_si256(in_range_avx2(x, 'A', 'Z'), case_bit));
+        y = _mm256_add_epi8(y, _mm256_and_si256(in_range_avx2(y, 'A', 'Z'), case_bit));
+        if ((unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xffffffff) {
+            return false;
+        }
+    }
+    _mm256_zeroupper();
+    return equal_nocase_sse2(a + i, b + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t token_length_avx2(const char *buf, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i *) (buf + i));
+        __m256i delim = _mm256_or_si256(in_range_avx2(b, ':', '@'),
+                                        _mm256_or_si256(in_range_avx2(b, '[', ']'), in_range_avx2(b, '(', ')')));
+        delim = _mm256_or_si256(delim, _mm256_or_si256(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('"')),
+                                                       _mm256_cmpeq_epi8(b, _mm256_set1_epi8(','))));
+        delim = _mm256_or_si256(delim, _mm256_or_si256(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('/')),
+                                                       _mm256_or_si256(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('{')),
+                                                                       _mm256_cmpeq_epi8(b, _mm256_set1_epi8('}')))));
+        __m256i token = _mm256_andnot_si256(delim, in_range_avx2(b, '!', '~'));
+        unsigned mask = ~(unsigned) _mm256_movemask_epi8(token);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    _mm256_zeroupper();
+    return i + token_length_sse2(buf + i, len - i);
+}
+#endif
+
+typedef struct mystr_kernels {
+    const char *name;
+    size_t (*find_any)(const char *buf, size_t len, const char *seps, size_t num_seps);
+    bool (*equal_nocase)(const char *a, const char *b, size_t len);
+    size_t (*token_length)(const char *buf, size_t len);
+} mystr_kernels_t;
+
+// from slowest to fastest
+static const mystr_kernels_t KERNELS[] = {
+    {"scalar", find_any_scalar, equal_nocase_scalar, token_length_scalar},
+#ifdef MYSTR_X86
+    {"sse2", find_any_sse2, equal_nocase_sse2, token_length_sse2},
+    {"avx2", find_any_avx2, equal_nocase_avx2, token_length_avx2},
+#endif
+};
+#define NUM_KERNELS (sizeof(KERNELS) / sizeof(KERNELS[0]))
+
+bool mystr_impl_supported(const char *impl) {
+    if (strcmp(impl, "scalar") == 0) {
+        return true;
+    }
+#ifdef MYSTR_X86
+    __builtin_cpu_init();
+    if (strcmp(impl, "sse2") == 0) {
+        return __builtin_cpu_supports("sse2");
+    }
+    if (strcmp(impl, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return false;
+}
+
+// NULL until the first call picks the fastest implementation; racing threads
+// all store the same pointer
+static const mystr_kernels_t *kernels_impl = NULL;
+
+static const mystr_kernels_t *kernels(void) {
+    const mystr_kernels_t *impl = __atomic_load_n(&kernels_impl, __ATOMIC_RELAXED);
+    if (impl == NULL) {
+        for (size_t i = 0; i < NUM_KERNELS; i++) {
+            if (mystr_impl_supported(KERNELS[i].name)) {
+                impl = &KERNELS[i];
+            }
+        }
+        __atomic_store_n(&kernels_impl, impl, __ATOMIC_RELAXED);
+    }
+    return impl;
+}
+
+const char *mystr_impl(void) {
+    return kernels()->name;
+}
+
+bool mystr_set_impl(const char *impl) {
+    for (size_t i = 0; i < NUM_KERNELS; i++) {
+        if (strcmp(KERNELS[i].name, impl) == 0 && mystr_impl_supported(impl)) {
+            __atomic_store_n(&kernels_impl, &KERNELS[i], __ATOMIC_RELAXED);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t mystr_find_any(const char *buf, size_t len, const char *seps) {
+    size_t num_seps = strlen(seps);
+    assert(num_seps <= MYSTR_MAX_SEPS);
+    if (num_seps == 1) {
+        // the C library's search for a single byte is as fast as it gets
+        const char *found = memchr(buf, seps[0], len);
+        return found != NULL ? (size_t) (found - buf) : len;
+    }
+    return kernels()->find_any(buf, len, seps, num_seps);
+}
+
+bool mystr_equal_nocase(const char *a, const char *b, size_t len) {
+    return kernels()->equal_nocase(a, b, len);
+}
+
+size_t mystr_token_length(const char *buf, size_t len) {
+    return kernels()->token_length(buf, len);
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -5,31 +6,270 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/io_uring.h>
+#include <time.h>
 
 #include "network_util.h"
+#include "header_scan.h"
+#include "timer_wheel.h"
 
-#define INITIAL_BUFFER_SIZE 10000
+/* Connection input buffers start small and double, up to a maximum, only when
+ * a header doesn't fit. */
+#define INPUT_BUFFER_INITIAL 2048
+#define INPUT_BUFFER_MAX 16384
 #define RESIZE_MULTIPLIER 2
-#define LISTENQ 50
+/* Empty initial-sized input buffers kept per loop for reuse. */
+#define INPUT_POOL_MAX 1024
+#define LISTENQ SOMAXCONN
+#define MAX_EVENTS 256
+#define TRY_READ_TIMEOUT_MS 10
+/* How long a closed connection may take to drain its queued output before it
+ * is dropped anyway. */
+#define LINGER_TIMEOUT_MS 30000
+/* How long a connection closed with nu_loop_shutdown waits for its peer to
+ * close its end once its output has been sent, and how much of the peer's
+ * input it throws away meanwhile, before it is closed anyway. */
+#define DRAIN_TIMEOUT_MS 2000
+#define DRAIN_MAX_BYTES (1 << 20)
 
-#define max(a,b) (a > b ? a : b)
+/* io_uring backend sizing, per loop. */
+#define URING_ENTRIES 1024
+#define URING_CQ_ENTRIES 8192
+#define URING_NUM_BUFS 256
+#define URING_BUF_SIZE 4096
+#define URING_BUF_GROUP 0
+#define URING_MAX_FIXED_FILES 4096
+#define URING_ACCEPT_PENDING 64
+/* Larger files are read and sent this many bytes at a time. */
+#define URING_FILE_CHUNK (64 * 1024)
+
+/**
+ * Tags the structs registered with the event loop, so that the pointer stored
+ * in each epoll event can be told apart when it comes back.
+ */
+typedef enum source_kind {
+    SOURCE_LISTENER,
+    SOURCE_CONNECTION,
+} source_kind_t;
+
+/**
+ * A buffer waiting to be sent on a connection. If fd is not -1, the bytes come
+ * from that file, starting at offset, instead of from data; the io_uring loop
+ * reads them into chunk a piece at a time, chunk_start being where the piece
+ * starts. If ext is set, they are someone else's memory, kept alive by a
+ * reference on owner which is dropped with release once they have been sent.
+ */
+typedef struct nu_out {
+    struct nu_out *next;
+    size_t len;
+    size_t sent;
+    int fd;
+    off_t offset;
+    char *chunk;
+    size_t chunk_start;
+    const char *ext;
+    void (*release)(void *owner);
+    void *owner;
+    char data[];
+} nu_out_t;
 
 struct connection {
+    source_kind_t kind;
+    int fd;
+    /* Event loop registration, set by nu_loop_add. */
+    nu_loop_t *loop;
+    nu_conn_handler_t on_readable;
+    nu_conn_handler_t on_writable;
+    void *aux;
+    bool closed;
+    connection_t *next_closed;
+    /* Output waiting for the socket to have room, sent in order. */
+    nu_out_t *out_head;
+    nu_out_t *out_tail;
+    size_t num_out_bytes;
+    /* Bytes of queued output sent so far, to tell a slow client from a
+     * stalled one. */
+    uint64_t out_progress;
+    bool send_failed;
+    /* The handler's deadline, see nu_set_timeout, or, once closed, how long
+     * the connection may linger. */
+    wheel_timer_t timer;
+    nu_conn_handler_t on_timeout;
+    /* Closed connections still draining their output (epoll backend), or
+     * their peer's input. */
+    connection_t *linger_prev;
+    connection_t *linger_next;
+    /* Set by nu_loop_shutdown, after which the peer's input is drained once
+     * the output has been sent: draining is set once writing has been shut
+     * down, and drained counts the bytes thrown away since. */
+    bool drain_input;
+    bool draining;
+    size_t drained;
+    /* io_uring backend state. The connection is only freed once none of its
+     * operations are in flight, since their completions point at it. */
+    int fixed_slot;
+    unsigned inflight;
+    bool peer_closed;
+    bool send_inflight;
+    bool recv_inflight;
+    bool close_submitted;
+    /* Set while the receive waits for a provided buffer to be returned, see
+     * nu_uring_park. It still counts as in flight. */
+    bool recv_parked;
+    connection_t *parked_prev;
+    connection_t *parked_next;
+    int rx_bid;
+    char *rx_data;
+    size_t rx_len;
+    /* Input buffer: in_len bytes received but not yet consumed, starting
+     * in_start bytes into in_buf. It is NULL while there are none. */
+    char *in_buf;
+    size_t in_cap;
+    size_t in_start;
+    size_t in_len;
+    /* Bytes at the front of the input already searched for a header
+     * terminator, so each byte is only scanned once. */
+    size_t in_scanned;
+    /* Byte overwritten at in_buf[in_nul] to NUL-terminate a header handed
+     * out in place, restored once it is consumed. */
+    bool in_terminated;
+    size_t in_nul;
+    char in_saved;
+};
+
+struct nu_listener {
+    source_kind_t kind;
+    int fd;
+    int port;
+    nu_accept_handler_t on_accept;
+    void *aux;
+    /* Clients accepted by the io_uring backend, handed out by nu_accept. */
+    bool uring;
+    size_t num_pending;
+    int pending[URING_ACCEPT_PENDING];
+};
+
+/**
+ * The rings and buffers of an io_uring instance.
+ */
+typedef struct nu_uring {
     int fd;
-    size_t num_extra_chars;
-    char extra_chars[INITIAL_BUFFER_SIZE];
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    /* SQEs prepared locally but not yet submitted. */
+    unsigned sq_local_tail;
+    unsigned sq_submitted;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    /* Provided buffers that the kernel receives into. */
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *bufs;
+    unsigned short buf_tail;
+    /* Buffers received into and not yet handed back. */
+    unsigned num_bufs_taken;
+    /* Connections whose receive found no buffer, oldest first, re-armed as
+     * buffers are returned. */
+    connection_t *parked_head;
+    connection_t *parked_tail;
+    /* Registered file table, or NULL if unsupported. */
+    int *free_slots;
+    size_t num_free_slots;
+    /* Connections closed but waiting on in-flight operations. */
+    size_t num_closing;
+} nu_uring_t;
+
+struct nu_loop {
+    nu_backend_t backend;
+    int epfd;
+    nu_uring_t *uring;
+    bool running;
+    /* Monotonic time in milliseconds, refreshed once per wakeup. */
+    uint64_t now_ms;
+    /* Connection deadlines and the tick, in milliseconds. */
+    timer_wheel_t *timers;
+    wheel_timer_t tick_timer;
+    int tick_interval_ms;
+    nu_tick_handler_t on_tick;
+    void *tick_aux;
+    /* Connections closed while dispatching the current batch of events. They
+     * are freed once the batch is done since later events may still point at
+     * them. */
+    connection_t *closed;
+    /* Closed connections waiting for their output, or their peer's input, to
+     * drain, oldest first. */
+    connection_t *linger_head;
+    connection_t *linger_tail;
+    /* Free input buffers of INPUT_BUFFER_INITIAL bytes, chained through
+     * their first bytes. */
+    char *input_pool;
+    size_t input_pool_size;
 };
 
 static connection_t *connection_init(int fd) {
     connection_t *conn = calloc(1, sizeof(connection_t));
+    conn->kind = SOURCE_CONNECTION;
     conn->fd = fd;
-    conn->num_extra_chars = 0;
+    conn->fixed_slot = -1;
+    conn->rx_bid = -1;
     return conn;
 }
 
-int nu_server_listen(int port) {
+/**
+ * Returns whether conn is driven by an io_uring loop.
+ */
+static bool is_uring_conn(connection_t *conn) {
+    return conn->loop != NULL && conn->loop->backend == NU_BACKEND_URING;
+}
+
+static void nu_conn_timeout(wheel_timer_t *timer, void *aux);
+static void nu_loop_tick(wheel_timer_t *timer, void *aux);
+static void nu_uring_flush(connection_t *conn);
+static void nu_uring_recv(connection_t *conn);
+static void nu_uring_recycle(nu_uring_t *uring, int bid);
+static void nu_linger_add(nu_loop_t *loop, connection_t *conn);
+static void nu_linger_end(nu_loop_t *loop, connection_t *conn);
+static void nu_epoll_drain(nu_loop_t *loop, connection_t *conn);
+
+/**
+ * Waits up to timeout_ms (or forever if negative) for fd to be ready for
+ * `events` (POLLIN or POLLOUT). Used to wait out EAGAIN on non-blocking sockets
+ * in the blocking API.
+ *
+ * Returns 1 once ready, 0 on timeout, or -1 on error.
+ */
+static int nu_wait_fd(int fd, short events, int timeout_ms) {
+    struct pollfd pfd = { .fd = fd, .events = events };
+    int result = -1;
+    while ((result = poll(&pfd, 1, timeout_ms)) < 0) {
+        if (errno != EINTR) {
+            perror("poll");
+            return -1;
+        }
+    }
+    return result;
+}
+
+int nu_server_listen(int port, bool reuse_port) {
     int myfd = 0;
-    if ((myfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    if ((myfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
         perror("socket");
         return -1;
     }
@@ -37,6 +277,12 @@ int nu_server_listen(int port) {
     int optval = 1;
     if (setsockopt(myfd, SOL_SOCKET, SO_REUSEADDR, (const void *) &optval, sizeof(int)) < 0) {
         perror("setsockopt");
+        close(myfd);
+        return -1;
+    }
+    if (reuse_port && setsockopt(myfd, SOL_SOCKET, SO_REUSEPORT, (const void *) &optval, sizeof(int)) < 0) {
+        perror("setsockopt");
+        close(myfd);
         return -1;
     }
 
@@ -60,22 +306,92 @@ int nu_server_listen(int port) {
 }
 
 connection_t *nu_wait_client(int port) {
-    int myfd = nu_server_listen(port);
-    if (myfd < 0) {
+    nu_listener_t *listener = nu_listen(port);
+    if (listener == NULL) {
         return NULL;
     }
 
-    struct sockaddr_in client_addr; 
-    socklen_t client_addr_size = sizeof(struct sockaddr_in);
-    int clientfd = accept(myfd, (struct sockaddr *) &client_addr, &client_addr_size); 
-    if (clientfd < 0) {
-        fprintf(stderr, "accept failed\n");
+    connection_t *client = NULL;
+    nu_wait_clients(listener, &client, 1);
+    nu_listener_free(listener);
+    return client;
+}
+
+/**
+ * Opens a non-blocking listener, see nu_listen and nu_listen_shared.
+ */
+static nu_listener_t *nu_listener_init(int port, bool reuse_port) {
+    int myfd = nu_server_listen(port, reuse_port);
+    if (myfd < 0) {
+        return NULL;
+    }
+    /* The listener itself is non-blocking so that nu_accept can drain every
+     * pending connection and stop on EAGAIN instead of blocking. */
+    if (fcntl(myfd, F_SETFL, fcntl(myfd, F_GETFL) | O_NONBLOCK) < 0) {
+        perror("fcntl");
         close(myfd);
         return NULL;
     }
 
-    close(myfd);
-    return connection_init(clientfd);
+    nu_listener_t *listener = calloc(1, sizeof(nu_listener_t));
+    assert(listener);
+    listener->kind = SOURCE_LISTENER;
+    listener->fd = myfd;
+    listener->port = port;
+    return listener;
+}
+
+nu_listener_t *nu_listen(int port) {
+    return nu_listener_init(port, false);
+}
+
+nu_listener_t *nu_listen_shared(int port) {
+    return nu_listener_init(port, true);
+}
+
+size_t nu_accept(nu_listener_t *listener, connection_t **clients, size_t max_clients) {
+    size_t accepted = 0;
+    if (listener->uring) {
+        /* The loop has already accepted these, so no system calls needed. */
+        while (accepted < max_clients && accepted < listener->num_pending) {
+            clients[accepted] = connection_init(listener->pending[accepted]);
+            accepted++;
+        }
+        listener->num_pending -= accepted;
+        memmove(listener->pending, listener->pending + accepted, listener->num_pending * sizeof(int));
+        return accepted;
+    }
+    while (accepted < max_clients) {
+        int clientfd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientfd < 0) {
+            /* The client gave up while waiting in the backlog; try the next. */
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept4");
+            }
+            break;
+        }
+        clients[accepted] = connection_init(clientfd);
+        accepted++;
+    }
+    return accepted;
+}
+
+size_t nu_wait_clients(nu_listener_t *listener, connection_t **clients, size_t max_clients) {
+    size_t accepted = 0;
+    while ((accepted = nu_accept(listener, clients, max_clients)) == 0) {
+        if (nu_wait_fd(listener->fd, POLLIN, -1) < 0) {
+            return 0;
+        }
+    }
+    return accepted;
+}
+
+void nu_listener_free(nu_listener_t *listener) {
+    close(listener->fd);
+    free(listener);
 }
 
 connection_t *nu_connect_server(const char *ip, int port) {
@@ -111,127 +427,680 @@ int nu_send_str(connection_t *conn, const char *str) {
 }
 
 int nu_send_bytes(connection_t *conn, const char *bytes, size_t bytes_len) {
-    size_t sent = -1;
-    while ((sent = send(conn->fd, bytes, bytes_len, 0)) < 0);
+    struct iovec iov = { .iov_base = (char *) bytes, .iov_len = bytes_len };
+    return nu_send_iov(conn, &iov, 1);
+}
+
+/*
+ * Output queue.
+ */
+
+static nu_out_t *nu_out_init(size_t len) {
+    nu_out_t *out = malloc(sizeof(nu_out_t) + len);
+    assert(out);
+    out->next = NULL;
+    out->len = len;
+    out->sent = 0;
+    out->fd = -1;
+    out->offset = 0;
+    out->chunk = NULL;
+    out->chunk_start = 0;
+    out->ext = NULL;
+    out->release = NULL;
+    out->owner = NULL;
+    return out;
+}
+
+static void nu_out_free(nu_out_t *out) {
+    if (out->fd >= 0) {
+        close(out->fd);
+    }
+    if (out->release != NULL) {
+        out->release(out->owner);
+    }
+    free(out->chunk);
+    free(out);
+}
+
+/**
+ * Returns the bytes of an in-memory buffer, wherever they are.
+ */
+static const char *nu_out_bytes(const nu_out_t *out) {
+    return out->ext != NULL ? out->ext : out->data;
+}
+
+/**
+ * Returns whether any of the iov_len segments described by refs (which may be
+ * NULL) has a reference.
+ */
+static bool nu_has_refs(const nu_ref_t *refs, size_t iov_len) {
+    for (size_t i = 0; refs != NULL && i < iov_len; i++) {
+        if (refs[i].owner != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void nu_push_output(connection_t *conn, nu_out_t *out) {
+    if (conn->out_tail != NULL) {
+        conn->out_tail->next = out;
+    } else {
+        conn->out_head = out;
+    }
+    conn->out_tail = out;
+    conn->num_out_bytes += out->len;
+}
+
+/**
+ * Removes the front of conn's output queue once it has been sent.
+ */
+static void nu_pop_output(connection_t *conn) {
+    nu_out_t *out = conn->out_head;
+    conn->out_head = out->next;
+    if (conn->out_head == NULL) {
+        conn->out_tail = NULL;
+    }
+    nu_out_free(out);
+}
+
+static void nu_drop_output(connection_t *conn) {
+    while (conn->out_head != NULL) {
+        nu_pop_output(conn);
+    }
+    conn->num_out_bytes = 0;
+}
+
+/**
+ * Puts the segments of iov at the back of conn's output queue: those with a
+ * reference in refs (which may be NULL) by reference, taking another one on
+ * their owner, and each run of the others copied into one buffer. Empty
+ * segments are skipped.
+ *
+ * Returns the number of bytes queued.
+ */
+static size_t nu_queue_iov(connection_t *conn, const struct iovec *iov, const nu_ref_t *refs, size_t iov_len) {
+    size_t queued = 0;
+    size_t i = 0;
+    while (i < iov_len) {
+        if (refs != NULL && refs[i].owner != NULL) {
+            if (iov[i].iov_len > 0) {
+                nu_out_t *out = nu_out_init(0);
+                out->len = iov[i].iov_len;
+                out->ext = iov[i].iov_base;
+                refs[i].retain(refs[i].owner);
+                out->release = refs[i].release;
+                out->owner = refs[i].owner;
+                nu_push_output(conn, out);
+                queued += out->len;
+            }
+            i++;
+            continue;
+        }
+        size_t run_end = i;
+        size_t total = 0;
+        while (run_end < iov_len && (refs == NULL || refs[run_end].owner == NULL)) {
+            total += iov[run_end].iov_len;
+            run_end++;
+        }
+        if (total > 0) {
+            nu_out_t *out = nu_out_init(total);
+            size_t used = 0;
+            for (; i < run_end; i++) {
+                memcpy(out->data + used, iov[i].iov_base, iov[i].iov_len);
+                used += iov[i].iov_len;
+            }
+            nu_push_output(conn, out);
+            queued += total;
+        }
+        i = run_end;
+    }
+    return queued;
+}
+
+/**
+ * Queues `len` bytes of the file open at fd, from offset, to be sent with
+ * sendfile once the socket has room (or, by the io_uring loop, read and sent a
+ * chunk at a time). The queue holds its own duplicate of fd.
+ *
+ * Returns 0 on success, or -1 if fd couldn't be duplicated.
+ */
+static int nu_queue_file(connection_t *conn, int fd, off_t offset, size_t len) {
+    int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dup_fd < 0) {
+        return -1;
+    }
+    nu_out_t *out = nu_out_init(0);
+    out->len = len;
+    out->fd = dup_fd;
+    out->offset = offset;
+    nu_push_output(conn, out);
+    return 0;
+}
+
+/**
+ * Returns the length of the piece of a file segment starting at chunk_start.
+ */
+static size_t nu_out_chunk_len(const nu_out_t *out) {
+    size_t rest = out->len - out->chunk_start;
+    return rest < URING_FILE_CHUNK ? rest : URING_FILE_CHUNK;
+}
+
+/**
+ * Reads the next piece of a file segment into its chunk, unless some of the
+ * piece read before is still to be sent.
+ *
+ * Returns false if the file couldn't be read.
+ */
+static bool nu_out_fill_chunk(nu_out_t *out) {
+    if (out->chunk != NULL && out->sent < out->chunk_start + nu_out_chunk_len(out)) {
+        return true;
+    }
+    if (out->chunk == NULL) {
+        out->chunk = malloc(URING_FILE_CHUNK);
+        assert(out->chunk);
+    }
+    out->chunk_start = out->sent;
+    size_t chunk_len = nu_out_chunk_len(out);
+    size_t used = 0;
+    while (used < chunk_len) {
+        ssize_t tried_read = pread(out->fd, out->chunk + used, chunk_len - used, out->offset);
+        if (tried_read < 0 && errno == EINTR) continue;
+        if (tried_read <= 0) {
+            return false;
+        }
+        used += tried_read;
+        out->offset += tried_read;
+    }
+    return true;
+}
+
+/**
+ * Copies the segments of iov, followed by `file_len` bytes of the file open at
+ * fd from `offset` (if fd is not -1), into one buffer at the back of conn's
+ * output queue, for the io_uring loop to send. Segments with a reference in
+ * refs (which may be NULL) are queued by reference instead, with the file
+ * copied after them. A file larger than URING_FILE_CHUNK is queued on its own,
+ * to be read a chunk at a time as the socket takes it.
+ *
+ * Returns the number of bytes queued, or -1 if the file couldn't be read.
+ */
+static ssize_t nu_uring_queue(connection_t *conn, const struct iovec *iov, const nu_ref_t *refs, size_t iov_len,
+                              int fd, off_t offset, size_t file_len) {
+    bool large_file = fd >= 0 && file_len > URING_FILE_CHUNK;
+    if (nu_has_refs(refs, iov_len) || large_file) {
+        size_t queued = nu_queue_iov(conn, iov, refs, iov_len);
+        ssize_t file_queued = 0;
+        if (large_file) {
+            if (nu_queue_file(conn, fd, offset, file_len) < 0 || !nu_out_fill_chunk(conn->out_tail)) {
+                return -1;
+            }
+            file_queued = file_len;
+        } else if (fd >= 0) {
+            file_queued = nu_uring_queue(conn, NULL, NULL, 0, fd, offset, file_len);
+        }
+        if (file_queued < 0) {
+            return -1;
+        }
+        nu_uring_flush(conn);
+        return queued + file_queued;
+    }
+    size_t total = fd >= 0 ? file_len : 0;
+    for (size_t i = 0; i < iov_len; i++) {
+        total += iov[i].iov_len;
+    }
+    nu_out_t *out = nu_out_init(total);
+    size_t used = 0;
+    for (size_t i = 0; i < iov_len; i++) {
+        memcpy(out->data + used, iov[i].iov_base, iov[i].iov_len);
+        used += iov[i].iov_len;
+    }
+    while (used < total) {
+        ssize_t tried_read = pread(fd, out->data + used, total - used, offset);
+        if (tried_read < 0 && errno == EINTR) continue;
+        if (tried_read <= 0) {
+            nu_out_free(out);
+            return -1;
+        }
+        used += tried_read;
+        offset += tried_read;
+    }
+    nu_push_output(conn, out);
+    nu_uring_flush(conn);
+    return total;
+}
+
+/**
+ * Sends as much of iov as the socket takes without blocking, passing `flags`
+ * (along with MSG_NOSIGNAL) to sendmsg. *iov and *iov_len are advanced past
+ * what was sent, so that they describe what is left.
+ *
+ * Returns the number of bytes sent, or -1 on error.
+ */
+static ssize_t nu_sendmsg_some(connection_t *conn, struct iovec **iov, size_t *iov_len, int flags) {
+    size_t sent = 0;
+    while (*iov_len > 0) {
+        struct msghdr msg = { .msg_iov = *iov, .msg_iovlen = *iov_len };
+        ssize_t tried_send = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | flags);
+        if (tried_send < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        sent += tried_send;
+        /* Skip the segments that were sent completely and resume partway
+         * through the one that wasn't. */
+        size_t remaining = tried_send;
+        while (*iov_len > 0 && remaining >= (*iov)->iov_len) {
+            remaining -= (*iov)->iov_len;
+            (*iov)++;
+            (*iov_len)--;
+        }
+        if (*iov_len > 0) {
+            (*iov)->iov_base = (char *) (*iov)->iov_base + remaining;
+            (*iov)->iov_len -= remaining;
+        }
+    }
     return sent;
 }
 
-char *nu_check_for_terminator(char *buf, size_t len) {
-    for (size_t i = 3; i < len; i++) {
-        if (buf[i - 3] == '\r' && buf[i - 2] == '\n' && buf[i - 1] == '\r' && buf[i] == '\n') {
-            return buf + i + 1;
+/**
+ * Sends as much of the `*len` bytes of the file open at fd, from *offset, as
+ * the socket takes without blocking, using sendfile (or splice, if fd is a
+ * pipe). *offset and *len are advanced past what was sent.
+ *
+ * Returns the number of bytes sent, or -1 on error or if the file turns out to
+ * be shorter than promised (e.g., truncated since).
+ */
+static ssize_t nu_sendfile_some(connection_t *conn, int fd, off_t *offset, size_t *len) {
+    struct stat file_stat;
+    bool is_pipe = fstat(fd, &file_stat) == 0 && S_ISFIFO(file_stat.st_mode);
+    size_t sent = 0;
+    while (*len > 0) {
+        ssize_t tried_send;
+        if (is_pipe) {
+            tried_send = splice(fd, NULL, conn->fd, NULL, *len, SPLICE_F_MOVE | SPLICE_F_MORE);
+        } else {
+            tried_send = sendfile(conn->fd, fd, offset, *len);
+        }
+        if (tried_send < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        if (tried_send == 0) {
+            return -1;
         }
+        sent += tried_send;
+        *len -= tried_send;
     }
-    return NULL;
+    return sent;
 }
 
-char *nu_read_header(connection_t *conn) {
-    size_t current_buffer_size = INITIAL_BUFFER_SIZE;
-    char *buf = malloc(current_buffer_size);
+/**
+ * Sends the segments of iov followed by the file (if fd is not -1) on a
+ * connection that isn't registered with a loop, waiting out EAGAIN.
+ */
+static ssize_t nu_send_blocking(connection_t *conn, struct iovec *iov, size_t iov_len,
+                                int fd, off_t offset, size_t len) {
+    size_t sent = 0;
+    while (iov_len > 0 || (fd >= 0 && len > 0)) {
+        /* MSG_MORE holds the headers back so they leave in the same segment
+         * as the start of the file. */
+        ssize_t tried_send = iov_len > 0
+            ? nu_sendmsg_some(conn, &iov, &iov_len, fd >= 0 && len > 0 ? MSG_MORE : 0)
+            : nu_sendfile_some(conn, fd, &offset, &len);
+        if (tried_send < 0) {
+            return -1;
+        }
+        sent += tried_send;
+        if ((iov_len > 0 || (fd >= 0 && len > 0)) && nu_wait_fd(conn->fd, POLLOUT, -1) < 0) {
+            return -1;
+        }
+    }
+    return sent;
+}
 
-    memcpy(buf, conn->extra_chars, conn->num_extra_chars);
-    char *curr = buf + conn->num_extra_chars;
-    while (true) {
-        /* If the block of bytes has a null terminator in it, then we need
-         * to finish the string and save the rest for the next call to
-         * this function. */
-        char *terminator = nu_check_for_terminator(buf, current_buffer_size);
-        if (terminator) {
-            conn->num_extra_chars = terminator - buf + 1;
-            memcpy(conn->extra_chars, terminator, conn->num_extra_chars);
-            curr = terminator;
-            *curr = '\0';
-            return buf;
-        }
-        size_t to_read = INITIAL_BUFFER_SIZE - conn->num_extra_chars;
-        conn->num_extra_chars = 0;
-        ssize_t tried_read = read(conn->fd, conn->extra_chars, to_read);
-
-        /* If there was an error, destroy the buffer and indicate 
-         * an error has occurred. */
-        if (tried_read < 0) {
-            perror("recv");
-            free(buf);
-            return NULL;
+/**
+ * Sends the segments of iov followed by the file (if fd is not -1) on a
+ * connection registered with an epoll loop. Whatever the socket doesn't take
+ * right away is queued and sent by the loop once there is room.
+ */
+static ssize_t nu_send_queued(connection_t *conn, struct iovec *iov, const nu_ref_t *refs, size_t iov_len,
+                              int fd, off_t offset, size_t len) {
+    size_t total = fd >= 0 ? len : 0;
+    for (size_t i = 0; i < iov_len; i++) {
+        total += iov[i].iov_len;
+    }
+    /* Anything already queued has to go first. */
+    if (conn->out_head == NULL) {
+        struct iovec *first = iov;
+        if (nu_sendmsg_some(conn, &iov, &iov_len, fd >= 0 && len > 0 ? MSG_MORE : 0) < 0) {
+            conn->send_failed = true;
+            return -1;
+        }
+        // the references follow the segments they belong to
+        if (refs != NULL) {
+            refs += iov - first;
+        }
+        if (iov_len == 0 && fd >= 0 && nu_sendfile_some(conn, fd, &offset, &len) < 0) {
+            conn->send_failed = true;
+            return -1;
         }
-        size_t actually_read = tried_read;
+    }
+    nu_queue_iov(conn, iov, refs, iov_len);
+    if (fd >= 0 && len > 0 && nu_queue_file(conn, fd, offset, len) < 0) {
+        conn->send_failed = true;
+        return -1;
+    }
+    return total;
+}
+
+static ssize_t nu_send(connection_t *conn, struct iovec *iov, const nu_ref_t *refs, size_t iov_len,
+                       int fd, off_t offset, size_t len) {
+    if (conn->send_failed) {
+        return -1;
+    }
+    if (conn->loop == NULL) {
+        return nu_send_blocking(conn, iov, iov_len, fd, offset, len);
+    }
+    if (is_uring_conn(conn)) {
+        return nu_uring_queue(conn, iov, refs, iov_len, fd, offset, len);
+    }
+    return nu_send_queued(conn, iov, refs, iov_len, fd, offset, len);
+}
+
+ssize_t nu_send_iov(connection_t *conn, struct iovec *iov, size_t iov_len) {
+    return nu_send(conn, iov, NULL, iov_len, -1, 0, 0);
+}
+
+ssize_t nu_send_iov_refs(connection_t *conn, struct iovec *iov, const nu_ref_t *refs, size_t iov_len) {
+    return nu_send(conn, iov, refs, iov_len, -1, 0, 0);
+}
+
+ssize_t nu_send_file(connection_t *conn, struct iovec *iov, size_t iov_len, int fd, off_t offset, size_t len) {
+    return nu_send(conn, iov, NULL, iov_len, fd, offset, len);
+}
+
+ssize_t nu_send_file_refs(connection_t *conn, struct iovec *iov, const nu_ref_t *refs, size_t iov_len,
+                          int fd, off_t offset, size_t len) {
+    return nu_send(conn, iov, refs, iov_len, fd, offset, len);
+}
+
+size_t nu_pending_output(connection_t *conn) {
+    return conn->num_out_bytes;
+}
 
-        /* If we're out of space, realloc the buffer to include 
-         * more space. */
-        if ((curr - buf) + actually_read > current_buffer_size) {
-            buf = realloc(buf, current_buffer_size * RESIZE_MULTIPLIER); 
-            curr = buf + current_buffer_size; 
-            current_buffer_size *= RESIZE_MULTIPLIER;
+uint64_t nu_output_progress(connection_t *conn) {
+    return conn->out_progress;
+}
+
+/**
+ * Sends queued output until the socket is full or the queue is empty. On
+ * error, the rest of the queue is dropped and the connection's sends fail
+ * from then on.
+ */
+static void nu_epoll_flush(connection_t *conn) {
+    while (conn->out_head != NULL) {
+        nu_out_t *out = conn->out_head;
+        size_t remaining = out->len - out->sent;
+        ssize_t sent;
+        if (out->fd >= 0) {
+            sent = nu_sendfile_some(conn, out->fd, &out->offset, &remaining);
+        } else {
+            struct iovec iov = { .iov_base = (char *) nu_out_bytes(out) + out->sent, .iov_len = remaining };
+            struct iovec *iovp = &iov;
+            size_t iov_len = 1;
+            sent = nu_sendmsg_some(conn, &iovp, &iov_len, out->next != NULL ? MSG_MORE : 0);
+        }
+        if (sent < 0) {
+            conn->send_failed = true;
+            nu_drop_output(conn);
+            return;
+        }
+        out->sent += sent;
+        conn->num_out_bytes -= sent;
+        conn->out_progress += sent;
+        if (out->sent < out->len) {
+            return;
         }
+        nu_pop_output(conn);
+    }
+}
+
+/*
+ * Input buffer.
+ */
 
-        memcpy(curr, conn->extra_chars, actually_read);
-        curr += actually_read;
+static char *nu_input_alloc(connection_t *conn) {
+    nu_loop_t *loop = conn->loop;
+    if (loop != NULL && loop->input_pool != NULL) {
+        char *buf = loop->input_pool;
+        memcpy(&loop->input_pool, buf, sizeof(char *));
+        loop->input_pool_size--;
+        return buf;
     }
+    char *buf = malloc(INPUT_BUFFER_INITIAL);
+    assert(buf);
+    return buf;
+}
 
-    // Execution should never reach here...
-    assert(false);
+/**
+ * Gives up conn's input buffer, returning it to the loop's pool if it never
+ * grew. Idle connections hold no buffer at all.
+ */
+static void nu_input_release(connection_t *conn) {
+    if (conn->in_buf == NULL) {
+        return;
+    }
+    nu_loop_t *loop = conn->loop;
+    if (loop != NULL && conn->in_cap == INPUT_BUFFER_INITIAL && loop->input_pool_size < INPUT_POOL_MAX) {
+        memcpy(conn->in_buf, &loop->input_pool, sizeof(char *));
+        loop->input_pool = conn->in_buf;
+        loop->input_pool_size++;
+    } else {
+        free(conn->in_buf);
+    }
+    conn->in_buf = NULL;
+    conn->in_cap = 0;
+    conn->in_start = 0;
+    conn->in_len = 0;
+    conn->in_scanned = 0;
+}
+
+/**
+ * Makes room at the end of conn's input buffer, allocating it, sliding its
+ * contents back to the front or doubling it as needed. One byte is kept spare
+ * so that a header ending at the very end can be NUL-terminated in place.
+ *
+ * Returns how many bytes may be appended, which is 0 once the buffer is full
+ * at INPUT_BUFFER_MAX.
+ */
+static size_t nu_input_reserve(connection_t *conn) {
+    assert(!conn->in_terminated);
+    if (conn->in_buf == NULL) {
+        conn->in_buf = nu_input_alloc(conn);
+        conn->in_cap = INPUT_BUFFER_INITIAL;
+    }
+    if (conn->in_start + conn->in_len + 1 == conn->in_cap && conn->in_start > 0) {
+        memmove(conn->in_buf, conn->in_buf + conn->in_start, conn->in_len);
+        conn->in_start = 0;
+    }
+    if (conn->in_len + 1 == conn->in_cap && conn->in_cap < INPUT_BUFFER_MAX) {
+        conn->in_cap *= RESIZE_MULTIPLIER;
+        conn->in_buf = realloc(conn->in_buf, conn->in_cap);
+        assert(conn->in_buf);
+    }
+    return conn->in_cap - 1 - conn->in_start - conn->in_len;
+}
+
+char *nu_read_header(connection_t *conn) {
+    while (true) {
+        char *header = nu_take_header(conn);
+        if (header != NULL) {
+            return header;
+        }
+        /* The header is larger than the input buffer can ever hold. */
+        if (nu_input_full(conn)) {
+            return NULL;
+        }
+        /* Accepted sockets are non-blocking, so nothing received just means
+         * we have to wait for the rest of the header. */
+        ssize_t received = nu_recv(conn);
+        if (received < 0) {
+            return NULL;
+        }
+        if (received == 0 && nu_wait_fd(conn->fd, POLLIN, -1) < 0) {
+            return NULL;
+        }
+    }
 }
 
 char *nu_try_read_header(connection_t *conn) {
-    fd_set rd;
-    FD_ZERO(&rd);
-    FD_SET(conn->fd, &rd);
+    char *header = nu_take_header(conn);
+    if (header != NULL) {
+        return header;
+    }
+    if (nu_wait_fd(conn->fd, POLLIN, TRY_READ_TIMEOUT_MS) > 0) {
+        return nu_read_header(conn);
+    }
+    return NULL;
+}
 
-    struct timeval tv;
+/**
+ * Moves bytes the io_uring loop has received for conn into its input buffer,
+ * re-arming the receive once the provided buffer has been drained.
+ */
+static ssize_t nu_uring_take_rx(connection_t *conn) {
+    if (conn->rx_bid < 0) {
+        return conn->peer_closed ? -1 : 0;
+    }
+    size_t space = nu_input_reserve(conn);
+    size_t amount = conn->rx_len < space ? conn->rx_len : space;
+    memcpy(conn->in_buf + conn->in_start + conn->in_len, conn->rx_data, amount);
+    conn->in_len += amount;
+    conn->rx_data += amount;
+    conn->rx_len -= amount;
+    if (conn->rx_len == 0) {
+        nu_uring_recycle(conn->loop->uring, conn->rx_bid);
+        conn->rx_bid = -1;
+        nu_uring_recv(conn);
+    }
+    return amount;
+}
 
-    tv.tv_sec = 0;
-    tv.tv_usec = 10000;
+ssize_t nu_recv(connection_t *conn) {
+    if (is_uring_conn(conn)) {
+        return nu_uring_take_rx(conn);
+    }
+    size_t received = 0;
+    size_t space = 0;
+    while ((space = nu_input_reserve(conn)) > 0) {
+        ssize_t tried_read = read(conn->fd, conn->in_buf + conn->in_start + conn->in_len, space);
+        if (tried_read < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        if (tried_read == 0) {
+            /* Hand back what was read; the next call reports the close. */
+            return received > 0 ? (ssize_t) received : -1;
+        }
+        conn->in_len += tried_read;
+        received += tried_read;
+    }
+    /* Don't hold on to a buffer for a connection with nothing to say. */
+    if (conn->in_len == 0) {
+        nu_input_release(conn);
+    }
+    return received;
+}
 
-    int result = -1;
-    if ((result = select(conn->fd + 1, &rd, NULL, NULL, &tv)) < 0) {
+char *nu_peek_header(connection_t *conn, size_t *header_len) {
+    if (conn->in_len == 0) {
         return NULL;
     }
-    if (FD_ISSET(conn->fd, &rd)) {
-        return nu_read_header(conn);
+    char *start = conn->in_buf + conn->in_start;
+    char *terminator = (char *) header_scan_terminator_from(start, conn->in_len, &conn->in_scanned);
+    if (terminator == NULL) {
+        return NULL;
     }
-    return NULL;
+    if (!conn->in_terminated) {
+        conn->in_terminated = true;
+        conn->in_nul = terminator - conn->in_buf;
+        conn->in_saved = *terminator;
+        *terminator = '\0';
+    }
+    *header_len = terminator - start;
+    return start;
+}
+
+char *nu_peek_input(connection_t *conn, size_t *len) {
+    *len = conn->in_len;
+    return conn->in_len > 0 ? conn->in_buf + conn->in_start : NULL;
+}
+
+void nu_consume_input(connection_t *conn, size_t amount) {
+    assert(amount <= conn->in_len);
+    if (conn->in_terminated) {
+        conn->in_buf[conn->in_nul] = conn->in_saved;
+        conn->in_terminated = false;
+    }
+    conn->in_start += amount;
+    conn->in_len -= amount;
+    conn->in_scanned = 0;
+    if (conn->in_len == 0) {
+        nu_input_release(conn);
+    }
+}
+
+char *nu_take_header(connection_t *conn) {
+    size_t header_len = 0;
+    char *start = nu_peek_header(conn, &header_len);
+    if (start == NULL) {
+        return NULL;
+    }
+    char *header = malloc(header_len + 1);
+    assert(header);
+    memcpy(header, start, header_len + 1);
+    nu_consume_input(conn, header_len);
+    return header;
+}
+
+bool nu_input_full(connection_t *conn) {
+    return conn->in_len == INPUT_BUFFER_MAX - 1;
 }
 
 char *nu_read_bytes(connection_t *conn, size_t amount) {
     char *buf = malloc(amount);
-    if (conn->num_extra_chars >= amount) {
-        memcpy(buf, conn->extra_chars, amount);
-        memmove(conn->extra_chars, conn->extra_chars + amount, conn->num_extra_chars - amount);
-        conn->num_extra_chars -= amount;
-        return buf;
+    size_t buffered = conn->in_len < amount ? conn->in_len : amount;
+    if (buffered > 0) {
+        memcpy(buf, conn->in_buf + conn->in_start, buffered);
+        nu_consume_input(conn, buffered);
     }
-    memcpy(buf, conn->extra_chars, conn->num_extra_chars);
-    char *curr = buf + conn->num_extra_chars;
-    size_t to_read = amount - conn->num_extra_chars;
-    conn->num_extra_chars = 0;
+    char *curr = buf + buffered;
+    size_t to_read = amount - buffered;
     while (to_read) {
         ssize_t tried_read = read(conn->fd, curr, to_read);
         if (tried_read < 0) {
-            if (errno == EAGAIN || errno == EINTR) continue;
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && nu_wait_fd(conn->fd, POLLIN, -1) > 0) continue;
             perror("recv");
             free(buf);
             return NULL;
         }
+        if (tried_read == 0) {
+            free(buf);
+            return NULL;
+        }
+        curr += tried_read;
         to_read -= tried_read;
     }
     return buf;
 }
 
 char *nu_try_read_bytes(connection_t *conn, size_t amount) {
-    fd_set rd;
-    FD_ZERO(&rd);
-    FD_SET(conn->fd, &rd);
-
-    struct timeval tv;
-
-    tv.tv_sec = 0;
-    tv.tv_usec = 10000;
-
-    int result = -1;
-    if ((result = select(conn->fd + 1, &rd, NULL, NULL, &tv)) < 0) {
-        return NULL;
-    }
-    if (FD_ISSET(conn->fd, &rd)) {
+    if (nu_wait_fd(conn->fd, POLLIN, TRY_READ_TIMEOUT_MS) > 0) {
         return nu_read_bytes(conn, amount);
     }
     return NULL;
@@ -239,27 +1108,982 @@ char *nu_try_read_bytes(connection_t *conn, size_t amount) {
 
 void nu_close_connection(connection_t *conn) {
     close(conn->fd);
+    nu_drop_output(conn);
+    nu_input_release(conn);
     free(conn);
 }
 
 int nu_multiplex(connection_t *local, connection_t *remote, nu_callback on_local_write, nu_callback on_remote_write) {
-    fd_set rd;
+    struct pollfd pfds[2] = {
+        { .fd = local->fd, .events = POLLIN },
+        { .fd = remote->fd, .events = POLLIN },
+    };
 
     while (1) {
-        FD_ZERO(&rd);
-        FD_SET(local->fd, &rd);
-        FD_SET(remote->fd, &rd);
-
-        int result = -1;
-        if ((result = select(max(local->fd, remote->fd) + 1, &rd, NULL, NULL, NULL)) < 0) {
-            perror("select");
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
             return -1;
         }
-        if (FD_ISSET(remote->fd, &rd)) {
+        if (pfds[1].revents & POLLIN) {
             on_remote_write(remote->fd, nu_read_header(remote));
         }
-        if (FD_ISSET(local->fd, &rd)) {
+        if (pfds[0].revents & POLLIN) {
             on_local_write(remote->fd, nu_read_header(local));
         }
     }
 }
+
+/**
+ * Reads the monotonic clock in milliseconds. The coarse clock is read from the
+ * vDSO without a syscall and is only a few milliseconds behind, which is
+ * plenty for timeouts.
+ */
+static uint64_t nu_monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * io_uring backend.
+ *
+ * Instead of waiting for readiness, the loop keeps a multishot accept armed on
+ * each listener and a receive armed on each connection, with the kernel
+ * picking a buffer from a ring of provided buffers. Sends are queued on the
+ * connection and submitted from the loop, and closes are linked behind the
+ * final send. Connections are entered into the ring's registered file table
+ * where possible so the kernel doesn't have to look up the fd on every
+ * operation. Everything prepared by the handlers is submitted together the
+ * next time the loop waits.
+ */
+
+/**
+ * The operation a completion belongs to, stored in the low bits of its
+ * user_data next to the pointer to the listener or connection.
+ */
+typedef enum uring_op {
+    URING_ACCEPT,
+    URING_FILES_UPDATE,
+    URING_RECV,
+    URING_SEND,
+    URING_CLOSE,
+} uring_op_t;
+
+#define URING_OP_MASK 7
+
+static uint64_t nu_uring_data(void *ptr, uring_op_t op) {
+    return (uint64_t) (uintptr_t) ptr | op;
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t arg_size) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned num_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, num_args);
+}
+
+/**
+ * Queues conn's receive, which failed because every provided buffer is in use,
+ * until one is returned. Re-arming it straight away would only fail again.
+ */
+static void nu_uring_park(nu_uring_t *uring, connection_t *conn) {
+    conn->recv_parked = true;
+    conn->recv_inflight = true;
+    conn->inflight++;
+    conn->parked_prev = uring->parked_tail;
+    conn->parked_next = NULL;
+    if (uring->parked_tail != NULL) {
+        uring->parked_tail->parked_next = conn;
+    } else {
+        uring->parked_head = conn;
+    }
+    uring->parked_tail = conn;
+}
+
+static void nu_uring_unpark(nu_uring_t *uring, connection_t *conn) {
+    if (conn->parked_prev != NULL) {
+        conn->parked_prev->parked_next = conn->parked_next;
+    } else {
+        uring->parked_head = conn->parked_next;
+    }
+    if (conn->parked_next != NULL) {
+        conn->parked_next->parked_prev = conn->parked_prev;
+    } else {
+        uring->parked_tail = conn->parked_prev;
+    }
+    conn->recv_parked = false;
+    conn->recv_inflight = false;
+    conn->inflight--;
+}
+
+/**
+ * Hands buffer `bid` back to the kernel to receive into, and re-arms the
+ * receive of the connection that has waited longest for one.
+ */
+static void nu_uring_recycle(nu_uring_t *uring, int bid) {
+    struct io_uring_buf *buf = &uring->buf_ring->bufs[uring->buf_tail & (URING_NUM_BUFS - 1)];
+    buf->addr = (uintptr_t) (uring->bufs + (size_t) bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    uring->buf_tail++;
+    __atomic_store_n(&uring->buf_ring->tail, uring->buf_tail, __ATOMIC_RELEASE);
+    uring->num_bufs_taken--;
+    if (uring->parked_head != NULL) {
+        connection_t *conn = uring->parked_head;
+        nu_uring_unpark(uring, conn);
+        nu_uring_recv(conn);
+    }
+}
+
+static void nu_uring_free(nu_uring_t *uring) {
+    if (uring->sqes != NULL) munmap(uring->sqes, uring->sqes_size);
+    if (uring->cq_ring != NULL && uring->cq_ring != uring->sq_ring) munmap(uring->cq_ring, uring->cq_ring_size);
+    if (uring->sq_ring != NULL) munmap(uring->sq_ring, uring->sq_ring_size);
+    if (uring->buf_ring != NULL) munmap(uring->buf_ring, uring->buf_ring_size);
+    free(uring->bufs);
+    free(uring->free_slots);
+    close(uring->fd);
+    free(uring);
+}
+
+/**
+ * Sets up an io_uring instance with its provided buffers and registered file
+ * table. Returns NULL if the kernel lacks any of the features the backend
+ * relies on (timed waits, provided buffer rings and, implied by those,
+ * multishot accept).
+ */
+static nu_uring_t *nu_uring_init(void) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = URING_CQ_ENTRIES;
+    int fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (fd < 0) {
+        return NULL;
+    }
+    nu_uring_t *uring = calloc(1, sizeof(nu_uring_t));
+    assert(uring);
+    uring->fd = fd;
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        nu_uring_free(uring);
+        return NULL;
+    }
+
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && uring->cq_ring_size > uring->sq_ring_size) {
+        uring->sq_ring_size = uring->cq_ring_size;
+    }
+    void *sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        nu_uring_free(uring);
+        return NULL;
+    }
+    uring->sq_ring = sq_ring;
+    void *cq_ring = sq_ring;
+    if (!single_mmap) {
+        cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            nu_uring_free(uring);
+            return NULL;
+        }
+    }
+    uring->cq_ring = cq_ring;
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        nu_uring_free(uring);
+        return NULL;
+    }
+    uring->sqes = sqes;
+
+    char *sq = sq_ring;
+    uring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    uring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    uring->sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+    uring->sq_entries = params.sq_entries;
+    unsigned *sq_array = (unsigned *) (sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) {
+        sq_array[i] = i;
+    }
+    uring->sq_local_tail = *uring->sq_tail;
+    uring->sq_submitted = *uring->sq_tail;
+    char *cq = cq_ring;
+    uring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    uring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    uring->cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    uring->buf_ring_size = URING_NUM_BUFS * sizeof(struct io_uring_buf);
+    void *buf_ring = mmap(NULL, uring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf_ring == MAP_FAILED) {
+        nu_uring_free(uring);
+        return NULL;
+    }
+    uring->buf_ring = buf_ring;
+    struct io_uring_buf_reg reg = {
+        .ring_addr = (uintptr_t) buf_ring,
+        .ring_entries = URING_NUM_BUFS,
+        .bgid = URING_BUF_GROUP,
+    };
+    if (sys_io_uring_register(fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        nu_uring_free(uring);
+        return NULL;
+    }
+    uring->bufs = malloc((size_t) URING_NUM_BUFS * URING_BUF_SIZE);
+    assert(uring->bufs);
+    uring->num_bufs_taken = URING_NUM_BUFS;
+    for (int bid = 0; bid < URING_NUM_BUFS; bid++) {
+        nu_uring_recycle(uring, bid);
+    }
+
+    /* Registered files are an optimization, so carry on without them. */
+    struct io_uring_rsrc_register files = {
+        .nr = URING_MAX_FIXED_FILES,
+        .flags = IORING_RSRC_REGISTER_SPARSE,
+    };
+    if (sys_io_uring_register(fd, IORING_REGISTER_FILES2, &files, sizeof(files)) == 0) {
+        uring->free_slots = malloc(URING_MAX_FIXED_FILES * sizeof(int));
+        assert(uring->free_slots);
+        for (int i = 0; i < URING_MAX_FIXED_FILES; i++) {
+            uring->free_slots[i] = URING_MAX_FIXED_FILES - 1 - i;
+        }
+        uring->num_free_slots = URING_MAX_FIXED_FILES;
+    }
+    return uring;
+}
+
+/**
+ * Submits everything prepared so far and, if `wait`, waits up to timeout_ms
+ * (or forever if negative) for at least one completion.
+ *
+ * Returns the result of io_uring_enter.
+ */
+static int nu_uring_enter(nu_uring_t *uring, bool wait, int timeout_ms) {
+    __atomic_store_n(uring->sq_tail, uring->sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = uring->sq_local_tail - uring->sq_submitted;
+    if (!wait && to_submit == 0) {
+        return 0;
+    }
+    unsigned flags = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (wait) {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            arg.ts = (uintptr_t) &ts;
+        }
+    }
+    int ret = sys_io_uring_enter(uring->fd, to_submit, wait ? 1 : 0, flags, wait ? &arg : NULL, wait ? sizeof(arg) : 0);
+    if (ret > 0) {
+        uring->sq_submitted += ret;
+    }
+    return ret;
+}
+
+/**
+ * Makes room for `count` SQEs, submitting what is queued if necessary, so that
+ * a linked chain is never split across two submissions.
+ */
+static void nu_uring_reserve(nu_uring_t *uring, unsigned count) {
+    unsigned head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+    if (uring->sq_local_tail - head + count > uring->sq_entries) {
+        nu_uring_enter(uring, false, 0);
+    }
+}
+
+static struct io_uring_sqe *nu_uring_sqe(nu_uring_t *uring) {
+    nu_uring_reserve(uring, 1);
+    struct io_uring_sqe *sqe = &uring->sqes[uring->sq_local_tail & uring->sq_mask];
+    uring->sq_local_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/**
+ * Points sqe at conn's socket, through the registered file table if it has a
+ * slot there.
+ */
+static void nu_uring_set_fd(struct io_uring_sqe *sqe, connection_t *conn) {
+    if (conn->fixed_slot >= 0) {
+        sqe->fd = conn->fixed_slot;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = conn->fd;
+    }
+}
+
+static void nu_uring_accept(nu_uring_t *uring, nu_listener_t *listener) {
+    struct io_uring_sqe *sqe = nu_uring_sqe(uring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listener->fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = nu_uring_data(listener, URING_ACCEPT);
+}
+
+static void nu_uring_recv(connection_t *conn) {
+    if ((conn->closed && !conn->draining) || conn->peer_closed) {
+        return;
+    }
+    struct io_uring_sqe *sqe = nu_uring_sqe(conn->loop->uring);
+    sqe->opcode = IORING_OP_RECV;
+    nu_uring_set_fd(sqe, conn);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->len = URING_BUF_SIZE;
+    sqe->user_data = nu_uring_data(conn, URING_RECV);
+    conn->inflight++;
+    conn->recv_inflight = true;
+}
+
+/**
+ * Registers conn in the file table (if there is a free slot) and arms its first
+ * receive, linked so that the receive already uses the slot.
+ */
+static void nu_uring_add(nu_uring_t *uring, connection_t *conn) {
+    nu_uring_reserve(uring, 2);
+    if (uring->num_free_slots > 0) {
+        uring->num_free_slots--;
+        conn->fixed_slot = uring->free_slots[uring->num_free_slots];
+        struct io_uring_sqe *sqe = nu_uring_sqe(uring);
+        sqe->opcode = IORING_OP_FILES_UPDATE;
+        sqe->fd = -1;
+        sqe->addr = (uintptr_t) &conn->fd;
+        sqe->len = 1;
+        sqe->off = conn->fixed_slot;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = nu_uring_data(conn, URING_FILES_UPDATE);
+        conn->inflight++;
+    }
+    nu_uring_recv(conn);
+}
+
+/**
+ * Submits the shutdown and closes of a connection. They are hard-linked so
+ * that each runs even if the one before it fails. The caller must have
+ * reserved room for them.
+ */
+static void nu_uring_close(connection_t *conn) {
+    nu_uring_t *uring = conn->loop->uring;
+    conn->close_submitted = true;
+    if (conn->recv_parked) {
+        nu_uring_unpark(uring, conn);
+    }
+
+    struct io_uring_sqe *sqe = nu_uring_sqe(uring);
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    nu_uring_set_fd(sqe, conn);
+    sqe->len = SHUT_RDWR;
+    sqe->flags |= IOSQE_IO_HARDLINK;
+    sqe->user_data = nu_uring_data(conn, URING_CLOSE);
+    conn->inflight++;
+
+    if (conn->fixed_slot >= 0) {
+        sqe = nu_uring_sqe(uring);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = conn->fixed_slot + 1;
+        sqe->flags = IOSQE_IO_HARDLINK;
+        sqe->user_data = nu_uring_data(conn, URING_CLOSE);
+        conn->inflight++;
+    }
+
+    sqe = nu_uring_sqe(uring);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = conn->fd;
+    sqe->user_data = nu_uring_data(conn, URING_CLOSE);
+    conn->inflight++;
+}
+
+/**
+ * Shuts a closed connection down for writing and keeps a receive armed, whose
+ * completions are thrown away, until the peer closes its end (see
+ * nu_loop_shutdown). The caller must have reserved room.
+ */
+static void nu_uring_drain(connection_t *conn) {
+    nu_loop_t *loop = conn->loop;
+    conn->draining = true;
+    nu_linger_add(loop, conn);
+    timer_wheel_schedule(loop->timers, &conn->timer, loop->now_ms + DRAIN_TIMEOUT_MS);
+
+    struct io_uring_sqe *sqe = nu_uring_sqe(loop->uring);
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    nu_uring_set_fd(sqe, conn);
+    sqe->len = SHUT_WR;
+    sqe->user_data = nu_uring_data(conn, URING_CLOSE);
+    conn->inflight++;
+    if (!conn->recv_inflight) {
+        nu_uring_recv(conn);
+    }
+}
+
+/**
+ * Submits a send for the next queued buffer, or the next chunk of a queued
+ * file, unless one is already in flight. Once the connection has been closed,
+ * the final send is linked to the close so both go out in one submission.
+ */
+static void nu_uring_flush(connection_t *conn) {
+    if (conn->send_inflight || conn->close_submitted || conn->draining) {
+        return;
+    }
+    nu_uring_t *uring = conn->loop->uring;
+    nu_uring_reserve(uring, 4);
+    if (conn->out_head != NULL && conn->out_head->fd >= 0 && !nu_out_fill_chunk(conn->out_head)) {
+        /* As when a send fails, the rest of the output is dropped. */
+        conn->send_failed = true;
+        nu_drop_output(conn);
+    }
+    if (conn->out_head == NULL) {
+        if (conn->closed && conn->drain_input && !conn->send_failed && !conn->peer_closed) {
+            nu_uring_drain(conn);
+        } else if (conn->closed) {
+            nu_uring_close(conn);
+        }
+        return;
+    }
+
+    nu_out_t *out = conn->out_head;
+    const char *bytes = nu_out_bytes(out) + out->sent;
+    size_t len = out->len - out->sent;
+    if (out->fd >= 0) {
+        bytes = out->chunk + (out->sent - out->chunk_start);
+        len = out->chunk_start + nu_out_chunk_len(out) - out->sent;
+    }
+    /* A connection draining its peer's input isn't closed behind its last
+     * send, but shut down for writing once it completes. */
+    bool last = conn->closed && out->next == NULL && out->sent + len == out->len && !conn->drain_input;
+    struct io_uring_sqe *sqe = nu_uring_sqe(uring);
+    sqe->opcode = IORING_OP_SEND;
+    nu_uring_set_fd(sqe, conn);
+    sqe->addr = (uintptr_t) bytes;
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL | (last ? MSG_WAITALL : 0);
+    sqe->user_data = nu_uring_data(conn, URING_SEND);
+    conn->inflight++;
+    conn->send_inflight = true;
+    if (last) {
+        sqe->flags |= IOSQE_IO_HARDLINK;
+        nu_uring_close(conn);
+    }
+}
+
+/**
+ * Frees a closed connection once its last operation has completed.
+ */
+static void nu_uring_release(nu_uring_t *uring, connection_t *conn) {
+    if (conn->fixed_slot >= 0) {
+        uring->free_slots[uring->num_free_slots] = conn->fixed_slot;
+        uring->num_free_slots++;
+    }
+    nu_drop_output(conn);
+    nu_input_release(conn);
+    uring->num_closing--;
+    free(conn);
+}
+
+static void nu_uring_complete_accept(nu_loop_t *loop, nu_listener_t *listener, int res, unsigned flags) {
+    if (res >= 0) {
+        if (listener->num_pending == URING_ACCEPT_PENDING) {
+            listener->on_accept(loop, listener, listener->aux);
+        }
+        /* A handler that took none of them (e.g., one at its limit of
+         * clients) leaves no room, so the new client is turned away. */
+        if (listener->num_pending == URING_ACCEPT_PENDING) {
+            close(res);
+        } else {
+            listener->pending[listener->num_pending] = res;
+            listener->num_pending++;
+            listener->on_accept(loop, listener, listener->aux);
+        }
+    } else if (res != -ECANCELED) {
+        fprintf(stderr, "accept failed (%s)\n", strerror(-res));
+    }
+    /* The kernel ends a multishot accept on errors, so re-arm it. */
+    if (!(flags & IORING_CQE_F_MORE)) {
+        nu_uring_accept(loop->uring, listener);
+    }
+}
+
+static void nu_uring_complete(nu_loop_t *loop, uint64_t user_data, int res, unsigned flags) {
+    nu_uring_t *uring = loop->uring;
+    uring_op_t op = user_data & URING_OP_MASK;
+    void *ptr = (void *) (uintptr_t) (user_data & ~(uint64_t) URING_OP_MASK);
+    if (op == URING_ACCEPT) {
+        nu_uring_complete_accept(loop, ptr, res, flags);
+        return;
+    }
+
+    connection_t *conn = ptr;
+    conn->inflight--;
+    if (op == URING_RECV) {
+        conn->recv_inflight = false;
+        if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+            int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+            uring->num_bufs_taken++;
+            if (conn->closed) {
+                nu_uring_recycle(uring, bid);
+            } else {
+                conn->rx_bid = bid;
+                conn->rx_data = uring->bufs + (size_t) bid * URING_BUF_SIZE;
+                conn->rx_len = res;
+            }
+        } else if (res == -ENOBUFS) {
+            /* Every buffer was in use. Unless one has been returned since,
+             * try again once one is. */
+            if ((!conn->closed || conn->draining) && !conn->close_submitted) {
+                if (uring->num_bufs_taken < URING_NUM_BUFS) {
+                    nu_uring_recv(conn);
+                } else {
+                    nu_uring_park(uring, conn);
+                }
+            }
+        } else {
+            conn->peer_closed = true;
+        }
+        if (!conn->closed && conn->on_readable && (conn->rx_bid >= 0 || conn->peer_closed)) {
+            conn->on_readable(loop, conn, conn->aux);
+        }
+        if (conn->draining && !conn->close_submitted) {
+            conn->drained += res > 0 ? res : 0;
+            if (conn->peer_closed || conn->drained > DRAIN_MAX_BYTES) {
+                nu_linger_end(loop, conn);
+            } else if (!conn->recv_inflight) {
+                nu_uring_recv(conn);
+            }
+        }
+    } else if (op == URING_SEND) {
+        conn->send_inflight = false;
+        if (res < 0) {
+            conn->send_failed = true;
+            nu_drop_output(conn);
+            if (!conn->closed) {
+                /* Let the handler find out on its next nu_recv. */
+                conn->peer_closed = true;
+                if (conn->on_readable) {
+                    conn->on_readable(loop, conn, conn->aux);
+                }
+            }
+        } else if (conn->out_head != NULL) {
+            nu_out_t *out = conn->out_head;
+            out->sent += res;
+            conn->num_out_bytes -= res;
+            conn->out_progress += res;
+            if (out->sent == out->len) {
+                nu_pop_output(conn);
+                if (conn->out_head == NULL && !conn->closed && conn->on_writable) {
+                    conn->on_writable(loop, conn, conn->aux);
+                }
+            }
+        }
+        nu_uring_flush(conn);
+    }
+
+    if (conn->closed && conn->inflight == 0) {
+        nu_uring_release(uring, conn);
+    }
+}
+
+/**
+ * Dispatches every completion the kernel has posted.
+ */
+static void nu_uring_reap(nu_loop_t *loop) {
+    nu_uring_t *uring = loop->uring;
+    unsigned head = *uring->cq_head;
+    while (head != __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &uring->cqes[head & uring->cq_mask];
+        uint64_t user_data = cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        head++;
+        __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+        nu_uring_complete(loop, user_data, res, flags);
+    }
+}
+
+/*
+ * Event loop.
+ */
+
+nu_loop_t *nu_loop_init(nu_backend_t backend) {
+    nu_loop_t *loop = malloc(sizeof(nu_loop_t));
+    assert(loop);
+    loop->backend = backend;
+    loop->epfd = -1;
+    loop->uring = NULL;
+    loop->running = false;
+    loop->now_ms = nu_monotonic_ms();
+    loop->timers = timer_wheel_init(loop->now_ms);
+    wheel_timer_init(&loop->tick_timer, nu_loop_tick, loop);
+    loop->tick_interval_ms = -1;
+    loop->on_tick = NULL;
+    loop->tick_aux = NULL;
+    loop->closed = NULL;
+    loop->linger_head = NULL;
+    loop->linger_tail = NULL;
+    loop->input_pool = NULL;
+    loop->input_pool_size = 0;
+
+    if (backend == NU_BACKEND_URING) {
+        loop->uring = nu_uring_init();
+        if (loop->uring != NULL) {
+            return loop;
+        }
+        fprintf(stderr, "io_uring is unavailable, falling back to epoll\n");
+        loop->backend = NU_BACKEND_EPOLL;
+    }
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        perror("epoll_create1");
+        timer_wheel_free(loop->timers);
+        free(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+nu_backend_t nu_loop_backend(nu_loop_t *loop) {
+    return loop->backend;
+}
+
+int nu_loop_add_listener(nu_loop_t *loop, nu_listener_t *listener, nu_accept_handler_t on_accept, void *aux) {
+    listener->on_accept = on_accept;
+    listener->aux = aux;
+    if (loop->backend == NU_BACKEND_URING) {
+        listener->uring = true;
+        nu_uring_accept(loop->uring, listener);
+        return 0;
+    }
+    /* Level-triggered, so a wakeup that accepts only part of the backlog is
+     * followed by another one for the rest. */
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = listener };
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, listener->fd, &event) < 0) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+int nu_loop_add(nu_loop_t *loop, connection_t *conn, nu_conn_handler_t on_readable, nu_conn_handler_t on_writable, void *aux) {
+    conn->loop = loop;
+    conn->on_readable = on_readable;
+    conn->on_writable = on_writable;
+    conn->aux = aux;
+    wheel_timer_init(&conn->timer, nu_conn_timeout, conn);
+    if (loop->backend == NU_BACKEND_URING) {
+        nu_uring_add(loop->uring, conn);
+        return 0;
+    }
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+        .data.ptr = conn,
+    };
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, conn->fd, &event) < 0) {
+        perror("epoll_ctl");
+        conn->loop = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void nu_loop_close(nu_loop_t *loop, connection_t *conn) {
+    if (conn->closed) {
+        return;
+    }
+    conn->closed = true;
+    timer_wheel_cancel(loop->timers, &conn->timer);
+    if (loop->backend == NU_BACKEND_URING) {
+        if (conn->rx_bid >= 0) {
+            nu_uring_recycle(loop->uring, conn->rx_bid);
+            conn->rx_bid = -1;
+        }
+        loop->uring->num_closing++;
+        /* Sends still queued go out first, followed by the close. */
+        nu_uring_flush(conn);
+        return;
+    }
+    if (conn->out_head != NULL) {
+        /* Keep the socket open until the queued output has been sent. */
+        timer_wheel_schedule(loop->timers, &conn->timer, loop->now_ms + LINGER_TIMEOUT_MS);
+        nu_linger_add(loop, conn);
+        return;
+    }
+    if (conn->drain_input) {
+        nu_linger_add(loop, conn);
+        nu_epoll_drain(loop, conn);
+        return;
+    }
+    /* Closing the fd also removes it from the epoll set. */
+    close(conn->fd);
+    conn->next_closed = loop->closed;
+    loop->closed = conn;
+}
+
+void nu_loop_shutdown(nu_loop_t *loop, connection_t *conn) {
+    if (conn->closed) {
+        return;
+    }
+    conn->drain_input = true;
+    nu_loop_close(loop, conn);
+}
+
+void nu_loop_abort(nu_loop_t *loop, connection_t *conn) {
+    if (conn->closed) {
+        return;
+    }
+    /* Shutting the socket down fails any send in flight on it, so the close
+     * isn't left waiting on a peer that has stopped reading. */
+    shutdown(conn->fd, SHUT_RDWR);
+    if (loop->backend == NU_BACKEND_EPOLL) {
+        nu_drop_output(conn);
+    }
+    nu_loop_close(loop, conn);
+}
+
+/**
+ * Adds a closed connection to those lingering before they are closed.
+ */
+static void nu_linger_add(nu_loop_t *loop, connection_t *conn) {
+    conn->linger_prev = loop->linger_tail;
+    if (loop->linger_tail != NULL) {
+        loop->linger_tail->linger_next = conn;
+    } else {
+        loop->linger_head = conn;
+    }
+    loop->linger_tail = conn;
+}
+
+/**
+ * Reads and throws away whatever conn's peer has sent (epoll backend), until
+ * there is no more for now. Returns whether the connection is done draining:
+ * the peer has closed its end, the read failed, or it has sent more than
+ * DRAIN_MAX_BYTES, which a peer waiting for a response wouldn't.
+ */
+static bool nu_discard_input(connection_t *conn) {
+    char buf[16384];
+    while (conn->drained <= DRAIN_MAX_BYTES) {
+        ssize_t n = read(conn->fd, buf, sizeof(buf));
+        if (n > 0) {
+            conn->drained += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return !(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+        }
+    }
+    return true;
+}
+
+/**
+ * Shuts a closed, lingering connection down for writing, now that its output
+ * has been sent, and starts draining its peer's input (epoll backend; see
+ * nu_loop_shutdown).
+ */
+static void nu_epoll_drain(nu_loop_t *loop, connection_t *conn) {
+    conn->draining = true;
+    shutdown(conn->fd, SHUT_WR);
+    timer_wheel_schedule(loop->timers, &conn->timer, loop->now_ms + DRAIN_TIMEOUT_MS);
+    if (nu_discard_input(conn)) {
+        nu_linger_end(loop, conn);
+    }
+}
+
+/**
+ * Finishes closing a connection that was draining its output, or its peer's
+ * input.
+ */
+static void nu_linger_end(nu_loop_t *loop, connection_t *conn) {
+    if (conn->linger_prev != NULL) {
+        conn->linger_prev->linger_next = conn->linger_next;
+    } else {
+        loop->linger_head = conn->linger_next;
+    }
+    if (conn->linger_next != NULL) {
+        conn->linger_next->linger_prev = conn->linger_prev;
+    } else {
+        loop->linger_tail = conn->linger_prev;
+    }
+    timer_wheel_cancel(loop->timers, &conn->timer);
+    if (loop->backend == NU_BACKEND_URING) {
+        /* Only a connection draining its peer's input lingers here; the
+         * shutdown that starts its close fails the receive in flight. */
+        nu_uring_reserve(loop->uring, 3);
+        nu_uring_close(conn);
+        return;
+    }
+    nu_drop_output(conn);
+    close(conn->fd);
+    conn->next_closed = loop->closed;
+    loop->closed = conn;
+}
+
+/**
+ * Fires when a connection's timer expires: the handler's timeout for an open
+ * connection, or, for a closed one which has failed to drain its output within
+ * LINGER_TIMEOUT_MS, the end of its lingering.
+ */
+static void nu_conn_timeout(wheel_timer_t *timer, void *aux) {
+    (void) timer;
+    connection_t *conn = aux;
+    if (conn->closed) {
+        nu_linger_end(conn->loop, conn);
+    } else if (conn->on_timeout != NULL) {
+        conn->on_timeout(conn->loop, conn, conn->aux);
+    }
+}
+
+/**
+ * Frees the connections closed by nu_loop_close since the last call.
+ */
+static void nu_loop_reap(nu_loop_t *loop) {
+    while (loop->closed != NULL) {
+        connection_t *conn = loop->closed;
+        loop->closed = conn->next_closed;
+        nu_drop_output(conn);
+        nu_input_release(conn);
+        free(conn);
+    }
+}
+
+/**
+ * Returns how long the loop may sleep before its next timer is due.
+ */
+static int nu_loop_timeout(nu_loop_t *loop) {
+    uint64_t wake_ms = timer_wheel_next(loop->timers);
+    if (wake_ms == UINT64_MAX) {
+        return -1;
+    }
+    return wake_ms > loop->now_ms ? wake_ms - loop->now_ms : 0;
+}
+
+static void nu_loop_tick(wheel_timer_t *timer, void *aux) {
+    nu_loop_t *loop = aux;
+    timer_wheel_schedule(loop->timers, timer, loop->now_ms + loop->tick_interval_ms);
+    loop->on_tick(loop, loop->tick_aux);
+}
+
+static void nu_epoll_dispatch(nu_loop_t *loop, struct epoll_event *events, int num_events) {
+    for (int i = 0; i < num_events; i++) {
+        source_kind_t *kind = events[i].data.ptr;
+        if (*kind == SOURCE_LISTENER) {
+            nu_listener_t *listener = (nu_listener_t *) kind;
+            listener->on_accept(loop, listener, listener->aux);
+            continue;
+        }
+        connection_t *conn = (connection_t *) kind;
+        uint32_t flags = events[i].events;
+        if (conn->draining) {
+            if (nu_discard_input(conn)) {
+                nu_linger_end(loop, conn);
+            }
+            continue;
+        }
+        /* Hangups and errors are reported to both handlers so that their
+         * next read or write observes them. */
+        if ((flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && !conn->closed && conn->on_readable) {
+            conn->on_readable(loop, conn, conn->aux);
+        }
+        if (!(flags & (EPOLLOUT | EPOLLHUP | EPOLLERR))) {
+            continue;
+        }
+        bool had_output = conn->out_head != NULL;
+        nu_epoll_flush(conn);
+        if (conn->closed) {
+            /* A lingering connection is done once its output is gone, unless
+             * it is to drain its peer's input next. */
+            if (had_output && conn->out_head == NULL && conn->drain_input && !conn->send_failed &&
+                !(flags & (EPOLLHUP | EPOLLERR))) {
+                nu_epoll_drain(loop, conn);
+            } else if (had_output && (conn->out_head == NULL || (flags & (EPOLLHUP | EPOLLERR)))) {
+                nu_linger_end(loop, conn);
+            }
+        } else if (conn->out_head == NULL && conn->on_writable) {
+            conn->on_writable(loop, conn, conn->aux);
+        }
+    }
+}
+
+void nu_loop_run(nu_loop_t *loop) {
+    struct epoll_event events[MAX_EVENTS];
+    loop->running = true;
+    while (loop->running) {
+        int timeout_ms = nu_loop_timeout(loop);
+        if (loop->backend == NU_BACKEND_URING) {
+            int result = nu_uring_enter(loop->uring, true, timeout_ms);
+            loop->now_ms = nu_monotonic_ms();
+            if (result < 0 && errno != EINTR && errno != ETIME && errno != EBUSY) {
+                perror("io_uring_enter");
+                break;
+            }
+            nu_uring_reap(loop);
+        } else {
+            int num_events = epoll_wait(loop->epfd, events, MAX_EVENTS, timeout_ms);
+            loop->now_ms = nu_monotonic_ms();
+            if (num_events < 0) {
+                if (errno == EINTR) continue;
+                perror("epoll_wait");
+                break;
+            }
+            nu_epoll_dispatch(loop, events, num_events);
+        }
+        timer_wheel_advance(loop->timers, loop->now_ms);
+        nu_loop_reap(loop);
+    }
+    loop->running = false;
+}
+
+void nu_loop_set_tick(nu_loop_t *loop, int interval_ms, nu_tick_handler_t on_tick, void *aux) {
+    loop->tick_interval_ms = interval_ms;
+    loop->on_tick = on_tick;
+    loop->tick_aux = aux;
+    timer_wheel_schedule(loop->timers, &loop->tick_timer, loop->now_ms + interval_ms);
+}
+
+void nu_set_timeout(connection_t *conn, int timeout_ms, nu_conn_handler_t on_timeout) {
+    nu_loop_t *loop = conn->loop;
+    if (timeout_ms < 0) {
+        timer_wheel_cancel(loop->timers, &conn->timer);
+        return;
+    }
+    conn->on_timeout = on_timeout;
+    timer_wheel_schedule(loop->timers, &conn->timer, loop->now_ms + timeout_ms);
+}
+
+uint64_t nu_loop_now(nu_loop_t *loop) {
+    return loop->now_ms;
+}
+
+void nu_loop_stop(nu_loop_t *loop) {
+    loop->running = false;
+}
+
+void nu_loop_free(nu_loop_t *loop) {
+    while (loop->linger_head != NULL) {
+        nu_linger_end(loop, loop->linger_head);
+    }
+    nu_loop_reap(loop);
+    if (loop->uring != NULL) {
+        /* Give connections that are still closing a moment to finish, since
+         * their completions point at them. */
+        for (int i = 0; i < 10 && loop->uring->num_closing > 0; i++) {
+            nu_uring_enter(loop->uring, true, 100);
+            nu_uring_reap(loop);
+        }
+        nu_uring_free(loop->uring);
+    }
+    while (loop->input_pool != NULL) {
+        char *buf = loop->input_pool;
+        memcpy(&loop->input_pool, buf, sizeof(char *));
+        free(buf);
+    }
+    if (loop->epfd >= 0) {
+        close(loop->epfd);
+    }
+    timer_wheel_free(loop->timers);
+    free(loop);
+}
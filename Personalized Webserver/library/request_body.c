@@ -0,0 +1,319 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "request_body.h"
+
+#define INITIAL_BODY_CAPACITY 1024
+#define RESIZE_MULTIPLIER 2
+// bytes of chunk extensions and trailer fields (which are skipped) allowed in
+// a whole body
+#define MAX_CHUNK_EXTRA_BYTES 8192
+
+/**
+ * Where the chunked decoder is within the body.
+ */
+typedef enum chunk_state {
+    CHUNK_SIZE,      // reading a chunk's hexadecimal size
+    CHUNK_EXTENSION, // skipping a chunk extension, up to the end of the line
+    CHUNK_SIZE_LF,   // expecting the '\n' ending the size line
+    CHUNK_DATA,      // inside a chunk's payload
+    CHUNK_DATA_CR,   // expecting the "\r\n" after a chunk's payload
+    CHUNK_DATA_LF,
+    CHUNK_TRAILER,   // at the start of a trailer line, or the final empty line
+    CHUNK_TRAILER_LINE,
+    CHUNK_FINAL_LF,  // expecting the '\n' of the final empty line
+    CHUNK_DONE,
+} chunk_state_t;
+
+struct request_body {
+    bool chunked;
+    size_t max_len;
+    size_t memory_limit;
+    // payload bytes still expected: the rest of the body if it has a
+    // Content-Length, or the rest of the current chunk
+    size_t remaining;
+    chunk_state_t state;
+    size_t num_size_digits;
+    size_t num_extra_bytes;
+    // the payload, in memory or, once spilled, in fd
+    size_t len;
+    char *data;
+    size_t capacity;
+    int fd;
+    size_t read_offset;
+};
+
+request_body_t *request_body_init(bool chunked, size_t content_length, size_t max_len, size_t memory_limit) {
+    request_body_t *body = malloc(sizeof(request_body_t));
+    assert(body);
+    body->chunked = chunked;
+    body->max_len = max_len;
+    body->memory_limit = memory_limit;
+    body->remaining = chunked ? 0 : content_length;
+    body->state = CHUNK_SIZE;
+    body->num_size_digits = 0;
+    body->num_extra_bytes = 0;
+    body->len = 0;
+    body->data = NULL;
+    body->capacity = 0;
+    body->fd = -1;
+    body->read_offset = 0;
+    return body;
+}
+
+/**
+ * Opens an anonymous temporary file, which disappears once it is closed.
+ */
+static int open_temp_file(void) {
+    const char *dir = getenv("TMPDIR");
+    if (dir == NULL) {
+        dir = "/tmp";
+    }
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0 || errno != EOPNOTSUPP) {
+        return fd;
+    }
+    // the file system doesn't support O_TMPFILE, so name it and unlink it
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/body-XXXXXX", dir);
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0) {
+        unlink(path);
+    }
+    return fd;
+}
+
+static bool write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+/**
+ * Appends payload bytes to the body, spilling it to a temporary file once it
+ * outgrows memory. Returns false on I/O errors.
+ */
+static bool body_append(request_body_t *body, const char *data, size_t len) {
+    if (len == 0) {
+        return true;
+    }
+    if (body->fd < 0 && body->len + len > body->memory_limit) {
+        body->fd = open_temp_file();
+        if (body->fd < 0 || !write_all(body->fd, body->data, body->len)) {
+            return false;
+        }
+        free(body->data);
+        body->data = NULL;
+        body->capacity = 0;
+    }
+    if (body->fd >= 0) {
+        if (!write_all(body->fd, data, len)) {
+            return false;
+        }
+    } else {
+        if (body->len + len > body->capacity) {
+            size_t capacity = body->capacity > 0 ? body->capacity : INITIAL_BODY_CAPACITY;
+            while (capacity < body->len + len) {
+                capacity *= RESIZE_MULTIPLIER;
+            }
+            body->data = realloc(body->data, capacity);
+            assert(body->data);
+            body->capacity = capacity;
+        }
+        memcpy(body->data + body->len, data, len);
+    }
+    body->len += len;
+    return true;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Advances the chunked decoder over one byte of framing (anything but chunk
+ * payload). Returns the body's state afterwards.
+ */
+static body_status_t chunk_step(request_body_t *body, char c) {
+    switch (body->state) {
+        case CHUNK_SIZE: {
+            int digit = hex_value(c);
+            if (digit >= 0) {
+                // a chunk this large is over the limit anyway (checked before
+                // it can overflow)
+                if (body->remaining > (body->max_len - body->len) / 16) {
+                    return BODY_TOO_LARGE;
+                }
+                body->remaining = body->remaining * 16 + digit;
+                body->num_size_digits++;
+                return BODY_INCOMPLETE;
+            }
+            if (body->num_size_digits == 0) {
+                return BODY_INVALID;
+            }
+            if (c == ';' || c == ' ' || c == '\t') {
+                body->state = CHUNK_EXTENSION;
+            } else if (c == '\r') {
+                body->state = CHUNK_SIZE_LF;
+            } else {
+                return BODY_INVALID;
+            }
+            return BODY_INCOMPLETE;
+        }
+        case CHUNK_EXTENSION:
+            if (c == '\r') {
+                body->state = CHUNK_SIZE_LF;
+            } else if (++body->num_extra_bytes > MAX_CHUNK_EXTRA_BYTES) {
+                return BODY_TOO_LARGE;
+            }
+            return BODY_INCOMPLETE;
+        case CHUNK_SIZE_LF:
+            if (c != '\n') {
+                return BODY_INVALID;
+            }
+            if (body->remaining > body->max_len - body->len) {
+                return BODY_TOO_LARGE;
+            }
+            body->state = body->remaining > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+            return BODY_INCOMPLETE;
+        case CHUNK_DATA_CR:
+            if (c != '\r') {
+                return BODY_INVALID;
+            }
+            body->state = CHUNK_DATA_LF;
+            return BODY_INCOMPLETE;
+        case CHUNK_DATA_LF:
+            if (c != '\n') {
+                return BODY_INVALID;
+            }
+            body->state = CHUNK_SIZE;
+            body->num_size_digits = 0;
+            return BODY_INCOMPLETE;
+        case CHUNK_TRAILER:
+            // trailer fields are ignored
+            if (c == '\r') {
+                body->state = CHUNK_FINAL_LF;
+            } else if (++body->num_extra_bytes > MAX_CHUNK_EXTRA_BYTES) {
+                return BODY_TOO_LARGE;
+            } else {
+                body->state = CHUNK_TRAILER_LINE;
+            }
+            return BODY_INCOMPLETE;
+        case CHUNK_TRAILER_LINE:
+            if (c == '\n') {
+                body->state = CHUNK_TRAILER;
+            } else if (++body->num_extra_bytes > MAX_CHUNK_EXTRA_BYTES) {
+                return BODY_TOO_LARGE;
+            }
+            return BODY_INCOMPLETE;
+        case CHUNK_FINAL_LF:
+            if (c != '\n') {
+                return BODY_INVALID;
+            }
+            body->state = CHUNK_DONE;
+            return BODY_COMPLETE;
+        default:
+            return BODY_INVALID;
+    }
+}
+
+body_status_t request_body_feed(request_body_t *body, const char *data, size_t len, size_t *consumed) {
+    size_t used = 0;
+    body_status_t status = BODY_INCOMPLETE;
+    if (!body->chunked) {
+        if (body->remaining > body->max_len) {
+            status = BODY_TOO_LARGE;
+        } else {
+            size_t amount = len < body->remaining ? len : body->remaining;
+            if (!body_append(body, data, amount)) {
+                status = BODY_IO_ERROR;
+            } else {
+                used = amount;
+                body->remaining -= amount;
+                if (body->remaining == 0) {
+                    status = BODY_COMPLETE;
+                }
+            }
+        }
+        *consumed = used;
+        return status;
+    }
+
+    while (used < len && status == BODY_INCOMPLETE) {
+        if (body->state == CHUNK_DATA) {
+            size_t amount = len - used < body->remaining ? len - used : body->remaining;
+            if (!body_append(body, data + used, amount)) {
+                status = BODY_IO_ERROR;
+                break;
+            }
+            used += amount;
+            body->remaining -= amount;
+            if (body->remaining == 0) {
+                body->state = CHUNK_DATA_CR;
+            }
+            continue;
+        }
+        status = chunk_step(body, data[used]);
+        used++;
+    }
+    *consumed = used;
+    return status;
+}
+
+size_t request_body_length(request_body_t *body) {
+    return body->len;
+}
+
+bool request_body_spilled(request_body_t *body) {
+    return body->fd >= 0;
+}
+
+ssize_t request_body_read(request_body_t *body, char *buf, size_t len) {
+    size_t left = body->len - body->read_offset;
+    size_t amount = len < left ? len : left;
+    if (amount == 0) {
+        return 0;
+    }
+    if (body->fd >= 0) {
+        ssize_t tried_read;
+        do {
+            tried_read = pread(body->fd, buf, amount, body->read_offset);
+        } while (tried_read < 0 && errno == EINTR);
+        if (tried_read < 0) {
+            return -1;
+        }
+        amount = tried_read;
+    } else {
+        memcpy(buf, body->data + body->read_offset, amount);
+    }
+    body->read_offset += amount;
+    return amount;
+}
+
+void request_body_free(request_body_t *body) {
+    if (body == NULL) {
+        return;
+    }
+    if (body->fd >= 0) {
+        close(body->fd);
+    }
+    free(body->data);
+    free(body);
+}
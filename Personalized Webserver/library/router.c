@@ -18,13 +18,23 @@ struct router {
     route_t routes[];
 };
 
+/**
+ * Returns the routes' body size limits, which are stored in the same
+ * allocation right after the routes: one per route, then the fallback's.
+ */
+static size_t *router_max_bodies(router_t *router) {
+    return (size_t *) (router->routes + router->max_routes);
+}
+
 router_t *router_init(size_t max_routes, route_handler_t fallback) {
-    router_t *ret = malloc(sizeof(router_t) + (sizeof(route_t) * max_routes));
+    router_t *ret = malloc(sizeof(router_t) + (sizeof(route_t) * max_routes) +
+                           (sizeof(size_t) * (max_routes + 1)));
     assert(ret);
 
     ret->max_routes = max_routes;
     ret->fallback = fallback;
     ret->num_routes = 0;
+    router_max_bodies(ret)[max_routes] = ROUTER_DEFAULT_MAX_BODY;
     
     return ret;
 }
@@ -44,13 +54,16 @@ void router_register(router_t *router, const char *path, route_handler_t handler
         
         strcpy(path_cpy, path);
         router->routes[router->num_routes].path = path_cpy;
+        router_max_bodies(router)[router->num_routes] = ROUTER_DEFAULT_MAX_BODY;
         router->num_routes++;
     }
 }
 
 bytes_t *router_dispatch(router_t *router, request_t *request) {
-    for (size_t i = 0; i < router->num_routes; i++) {
-        if (strcmp(request->path, router->routes[i].path) == 0) {
+    // a path that can't be decoded matches no route
+    const char *path = request_path(request);
+    for (size_t i = 0; i < router->num_routes && path != NULL; i++) {
+        if (strcmp(path, router->routes[i].path) == 0) {
             bytes_t *ret = router->routes[i].handler(request);
             if (ret == NULL) {
                 ret = router->fallback(request);
@@ -65,6 +78,37 @@ bytes_t *router_dispatch(router_t *router, request_t *request) {
     return ret;
 }
 
+void router_set_max_body(router_t *router, const char *path, size_t max_body) {
+    if (path == NULL) {
+        router_max_bodies(router)[router->max_routes] = max_body;
+        return;
+    }
+    for (size_t i = 0; i < router->num_routes; i++) {
+        if (strcmp(path, router->routes[i].path) == 0) {
+            router_max_bodies(router)[i] = max_body;
+        }
+    }
+}
+
+size_t router_max_body(router_t *router, const char *path) {
+    for (size_t i = 0; i < router->num_routes; i++) {
+        if (strcmp(path, router->routes[i].path) == 0) {
+            return router_max_bodies(router)[i];
+        }
+    }
+    return router_max_bodies(router)[router->max_routes];
+}
+
+router_t *router_copy(router_t *router) {
+    router_t *ret = router_init(router->max_routes, router->fallback);
+    for (size_t i = 0; i < router->num_routes; i++) {
+        router_register(ret, router->routes[i].path, router->routes[i].handler);
+        router_max_bodies(ret)[i] = router_max_bodies(router)[i];
+    }
+    router_max_bodies(ret)[ret->max_routes] = router_max_bodies(router)[router->max_routes];
+    return ret;
+}
+
 void router_free(router_t *router) {
     for (size_t i = 0; i < router->num_routes; i++) {
         route_t curr = router->routes[i];
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <assert.h>
 #include "strarray.h"
 
 strarray_t *strarray_init(size_t length) {
@@ -12,11 +13,31 @@ strarray_t *strarray_init(size_t length) {
     }
     stringarray->length = length;
     stringarray->data = data;
+    stringarray->contiguous = false;
+
+    return stringarray;
+}
+
+strarray_t *strarray_init_contiguous(size_t length, size_t size, char **storage) {
+    strarray_t *stringarray = malloc(sizeof(strarray_t) + sizeof(char *) * length + size);
+    assert(stringarray);
+    char **data = (char **) (stringarray + 1);
+    for (size_t i = 0; i < length; i++){
+        data[i] = NULL;
+    }
+    stringarray->length = length;
+    stringarray->data = data;
+    stringarray->contiguous = true;
+    *storage = (char *) (data + length);
 
     return stringarray;
 }
 
 void strarray_free(strarray_t *arr) {
+    if (arr->contiguous) {
+        free(arr);
+        return;
+    }
     for (size_t i = 0; i < arr->length; i++){
         free(arr->data[i]);
     }
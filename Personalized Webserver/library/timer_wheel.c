@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "timer_wheel.h"
+
+/*
+ * The wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots. A slot on level L
+ * covers a block of WHEEL_SLOTS^L ticks, and a timer is filed on the lowest
+ * level whose span reaches its deadline. As the clock enters a new block on
+ * level L, that block's slot is emptied and its timers are filed again, now
+ * on lower levels, until they reach level 0, where each slot is a single tick
+ * and its timers are fired as the clock reaches it.
+ *
+ * A bitmap of occupied slots per level lets the clock skip over empty blocks
+ * rather than visit every tick.
+ */
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+// deadlines further out than this are parked on the top level and filed again
+// each time they come round
+#define WHEEL_SPAN ((uint64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+struct timer_wheel {
+    uint64_t now;
+    wheel_timer_t *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t occupied[WHEEL_LEVELS];
+};
+
+timer_wheel_t *timer_wheel_init(uint64_t now) {
+    timer_wheel_t *wheel = calloc(1, sizeof(timer_wheel_t));
+    assert(wheel);
+    wheel->now = now;
+    return wheel;
+}
+
+void wheel_timer_init(wheel_timer_t *timer, wheel_timer_fn_t fn, void *aux) {
+    timer->deadline = 0;
+    timer->fn = fn;
+    timer->aux = aux;
+    timer->pending = false;
+    timer->level = 0;
+    timer->slot = 0;
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+bool wheel_timer_pending(const wheel_timer_t *timer) {
+    return timer->pending;
+}
+
+/**
+ * Files a timer in the slot for its deadline, or for `earliest` if its deadline
+ * is before that.
+ */
+static void wheel_insert(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t earliest) {
+    uint64_t when = timer->deadline < earliest ? earliest : timer->deadline;
+    if (when - wheel->now >= WHEEL_SPAN) {
+        when = wheel->now + WHEEL_SPAN - 1;
+    }
+    uint64_t delta = when - wheel->now;
+    unsigned level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (uint64_t) 1 << (WHEEL_BITS * (level + 1))) {
+        level++;
+    }
+    unsigned slot = (when >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+    wheel_timer_t **head = &wheel->slots[level][slot];
+    timer->prev = NULL;
+    timer->next = *head;
+    if (*head != NULL) {
+        (*head)->prev = timer;
+    }
+    *head = timer;
+    wheel->occupied[level] |= (uint64_t) 1 << slot;
+    timer->level = level;
+    timer->slot = slot;
+    timer->pending = true;
+}
+
+static void wheel_remove(timer_wheel_t *wheel, wheel_timer_t *timer) {
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        wheel->slots[timer->level][timer->slot] = timer->next;
+        if (timer->next == NULL) {
+            wheel->occupied[timer->level] &= ~((uint64_t) 1 << timer->slot);
+        }
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->pending = false;
+}
+
+void timer_wheel_schedule(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t deadline) {
+    if (timer->pending) {
+        wheel_remove(wheel, timer);
+    }
+    timer->deadline = deadline;
+    // the current tick's slot has already been fired
+    wheel_insert(wheel, timer, wheel->now + 1);
+}
+
+void timer_wheel_cancel(timer_wheel_t *wheel, wheel_timer_t *timer) {
+    if (timer->pending) {
+        wheel_remove(wheel, timer);
+    }
+}
+
+/**
+ * Empties a slot above level 0 as the clock enters its block, filing its
+ * timers again closer to their deadlines.
+ */
+static void wheel_cascade(timer_wheel_t *wheel, unsigned level, unsigned slot) {
+    wheel_timer_t *timer = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~((uint64_t) 1 << slot);
+    while (timer != NULL) {
+        wheel_timer_t *next = timer->next;
+        wheel_insert(wheel, timer, wheel->now);
+        timer = next;
+    }
+}
+
+void timer_wheel_advance(timer_wheel_t *wheel, uint64_t now) {
+    while (wheel->now < now) {
+        // nothing can happen before the next block boundary of the lowest
+        // occupied level, so the clock can jump straight there
+        unsigned lowest = 0;
+        while (lowest < WHEEL_LEVELS && wheel->occupied[lowest] == 0) {
+            lowest++;
+        }
+        if (lowest == WHEEL_LEVELS) {
+            wheel->now = now;
+            break;
+        }
+        uint64_t next = (wheel->now | (((uint64_t) 1 << (WHEEL_BITS * lowest)) - 1)) + 1;
+        if (next > now) {
+            wheel->now = now;
+            break;
+        }
+        wheel->now = next;
+
+        for (unsigned level = WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((next & (((uint64_t) 1 << (WHEEL_BITS * level)) - 1)) == 0) {
+                wheel_cascade(wheel, level, (next >> (WHEEL_BITS * level)) & WHEEL_MASK);
+            }
+        }
+        // callbacks may schedule and cancel timers, including ones in this
+        // slot, so it is emptied one timer at a time
+        wheel_timer_t **head = &wheel->slots[0][next & WHEEL_MASK];
+        while (*head != NULL) {
+            wheel_timer_t *timer = *head;
+            wheel_remove(wheel, timer);
+            timer->fn(timer, timer->aux);
+        }
+    }
+}
+
+uint64_t timer_wheel_now(timer_wheel_t *wheel) {
+    return wheel->now;
+}
+
+uint64_t timer_wheel_next(timer_wheel_t *wheel) {
+    uint64_t next = UINT64_MAX;
+    for (unsigned level = 0; level < WHEEL_LEVELS; level++) {
+        uint64_t occupied = wheel->occupied[level];
+        if (occupied == 0) {
+            continue;
+        }
+        // the slots after the current one come up in order; the current one
+        // only comes round again after a full turn
+        unsigned shift = WHEEL_BITS * level;
+        unsigned start = ((wheel->now >> shift) + 1) & WHEEL_MASK;
+        uint64_t rotated = start == 0 ? occupied : (occupied >> start) | (occupied << (WHEEL_SLOTS - start));
+        uint64_t distance = __builtin_ctzll(rotated) + 1;
+        uint64_t when = level == 0 ? wheel->now + distance : ((wheel->now >> shift) + distance) << shift;
+        if (when < next) {
+            next = when;
+        }
+    }
+    return next;
+}
+
+void timer_wheel_free(timer_wheel_t *wheel) {
+    for (unsigned level = 0; level < WHEEL_LEVELS; level++) {
+        for (unsigned slot = 0; slot < WHEEL_SLOTS; slot++) {
+            wheel_timer_t *timer = wheel->slots[level][slot];
+            while (timer != NULL) {
+                wheel_timer_t *next = timer->next;
+                timer->pending = false;
+                timer->prev = NULL;
+                timer->next = NULL;
+                timer = next;
+            }
+        }
+    }
+    free(wheel);
+}
@@ -1,4 +1,6 @@
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "web_util.h"
 
@@ -19,12 +21,34 @@ ssize_t wutil_get_file_size(FILE *f) {
     return s.st_size;
 }
 
+// opens a regular file for reading and stores its size, returning -1 for
+// anything that can't be served (missing files, directories, ...)
+int wutil_open_file(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat s;
+    if (fstat(fd, &s) || !S_ISREG(s.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    *size = s.st_size;
+    return fd;
+}
+
 char *wutil_get_resolved_path(request_t *request) {
-    size_t request_path_len = strlen(request->path);
+    // the file is named by the decoded path, e.g., "my%20file.txt" is
+    // "my file.txt"
+    const char *request_path_decoded = request_path(request);
+    if (request_path_decoded == NULL) {
+        return NULL;
+    }
+    size_t request_path_len = strlen(request_path_decoded);
     size_t path_len = strlen(PATH_PREFIX) + request_path_len;
     char *path = calloc(path_len + 1, sizeof(char));
     strcpy(path, PATH_PREFIX);
-    strcat(path, request->path);
+    strcat(path, request_path_decoded);
     // canonicalize the path
     char *resolved_path = realpath(path, NULL);
     free(path);
@@ -32,21 +56,18 @@ char *wutil_get_resolved_path(request_t *request) {
 }
 
 response_code_t wutil_check_resolved_path(char* resolved_path) {
-    char *expected_path_prefix = NULL;
-    size_t expected_path_prefix_len = 0;
+    char *expected_path_prefix = realpath(PATH_PREFIX, NULL);
     if (!expected_path_prefix) {
-        expected_path_prefix = realpath(PATH_PREFIX, NULL);
-        if (!expected_path_prefix) {
-            return HTTP_BAD_REQUEST;
-        }
-        expected_path_prefix_len = strlen(expected_path_prefix);
-    }
-    else if (strncmp(expected_path_prefix, resolved_path, expected_path_prefix_len) != 0) {
-        // the canonicalized path doesn't start inside the data dir.
-        // this means it is trying to access files it's not supposed to access
-        return HTTP_FORBIDDEN;
+        return HTTP_BAD_REQUEST;
     }
-    return HTTP_OK;
+    size_t expected_path_prefix_len = strlen(expected_path_prefix);
+    // the canonicalized path must be the data dir or inside it, or it is
+    // trying to access files it's not supposed to access (e.g., through "..",
+    // which may arrive encoded as "%2e%2e")
+    bool inside = strncmp(expected_path_prefix, resolved_path, expected_path_prefix_len) == 0 &&
+                  (resolved_path[expected_path_prefix_len] == '/' || resolved_path[expected_path_prefix_len] == '\0');
+    free(expected_path_prefix);
+    return inside ? HTTP_OK : HTTP_FORBIDDEN;
 }
 
 mime_type_t wutil_get_mime_from_extension(char *ext) {
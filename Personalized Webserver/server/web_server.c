@@ -3,6 +3,10 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <router.h>
 
@@ -10,80 +14,160 @@
 #include "http_request.h"
 #include "http_response.h"
 #include "web_util.h"
+#include "http_server.h"
 
 char *HELLO_RESPONSE = "Hello, world!";
 char *ERROR_MESSAGE_ONE = "Path is Null";
 char *ERROR_MESSAGE_TWO = "Wrong response code";
+char *ERROR_MESSAGE_THREE = "File not found";
 const char *HELLO_PATH = "/hello";
 const char *ROLL_PATH = "/roll";
+const char *UPLOAD_PATH = "/upload";
+const char *COUNT_PATH = "/count";
+size_t UPLOAD_MAX_BODY = 64 << 20;
+size_t UPLOAD_READ_SIZE = 4096;
+unsigned COUNT_TO = 100000;
+unsigned COUNT_LINES_PER_CHUNK = 1000;
 int DICE_NUMBER = 6;
 int TO_ASCII = 49;
 
 
-bytes_t *hello_handler() {
-    bytes_t *body = bytes_init(strlen(HELLO_RESPONSE), HELLO_RESPONSE);
-    return response_type_format(HTTP_OK, MIME_HTML, body);
+/**
+ * Makes a response in the request's arena whose body is `data`, a global,
+ * which is sent as it is rather than copied for every request.
+ */
+bytes_t *respond(request_t *req, response_code_t code, mime_type_t type, const char *data) {
+    response_t *resp = response_init(req->arena, code, type);
+    response_add_body_borrowed(resp, data, strlen(data));
+    return response_finish(resp);
 }
 
-bytes_t *roll_handler() {
-    char random = (rand() % DICE_NUMBER) + TO_ASCII;
+/**
+ * Makes a response in the request's arena with a copy of the `len` bytes at
+ * `data` as its body, so that serving it never calls malloc.
+ */
+bytes_t *respond_copy(request_t *req, response_code_t code, mime_type_t type, const char *data, size_t len) {
+    response_t *resp = response_init(req->arena, code, type);
+    response_add_body_copy(resp, data, len);
+    return response_finish(resp);
+}
+
+bytes_t *hello_handler(request_t *req) {
+    return respond(req, HTTP_OK, MIME_HTML, HELLO_RESPONSE);
+}
+
+bytes_t *roll_handler(request_t *req) {
+    // rand() shares one state between all worker threads, so each thread
+    // keeps its own seed for rand_r instead
+    static _Thread_local unsigned int seed = 0;
+    if (seed == 0) {
+        seed = time(NULL) ^ (unsigned int) (uintptr_t) &seed;
+    }
+    char random = (rand_r(&seed) % DICE_NUMBER) + TO_ASCII;
     // add 49 to get to the ascii value
-    bytes_t *body = bytes_init(1, &random);
-    return response_type_format(HTTP_OK, MIME_HTML, body);
+    return respond_copy(req, HTTP_OK, MIME_HTML, &random, 1);
+}
+
+bytes_t *upload_handler(request_t *req) {
+    // the body is read a piece at a time, so a large upload (which the server
+    // has spilled to disk) is never held in memory
+    size_t received = 0;
+    if (req->body != NULL) {
+        char buf[UPLOAD_READ_SIZE];
+        ssize_t tried_read = 0;
+        while ((tried_read = request_body_read(req->body, buf, sizeof(buf))) > 0) {
+            received += tried_read;
+        }
+    }
+    char message[64];
+    int len = snprintf(message, sizeof(message), "Received %zu bytes", received);
+    return respond_copy(req, HTTP_OK, MIME_PLAIN, message, len);
+}
+
+bool count_producer(response_stream_t *stream, void *state) {
+    unsigned *next = state;
+    char line[16];
+    for (unsigned i = 0; i < COUNT_LINES_PER_CHUNK && *next <= COUNT_TO; i++, (*next)++) {
+        int len = snprintf(line, sizeof(line), "%u\n", *next);
+        response_stream_write(stream, line, len);
+    }
+    return *next <= COUNT_TO;
+}
+
+bytes_t *count_handler(request_t *req) {
+    (void) req;
+    // the numbers are produced a chunk at a time as the client reads them,
+    // rather than formatted into one large body
+    unsigned *next = malloc(sizeof(unsigned));
+    assert(next);
+    *next = 1;
+    return response_type_format_stream(HTTP_OK, MIME_PLAIN, count_producer, next, free);
 }
 
 bytes_t *default_handler(request_t *req) {
     char *path = wutil_get_resolved_path(req);
     if (path == NULL) {
-        bytes_t *body = bytes_init(strlen(ERROR_MESSAGE_ONE), ERROR_MESSAGE_ONE);
-        return response_type_format(HTTP_FORBIDDEN, MIME_PLAIN, body);
+        return respond(req, HTTP_FORBIDDEN, MIME_PLAIN, ERROR_MESSAGE_ONE);
     }
 
     response_code_t response = wutil_check_resolved_path(path);
     if (response != HTTP_OK) {
-        bytes_t *body = bytes_init(strlen(ERROR_MESSAGE_TWO), ERROR_MESSAGE_TWO);
-        return response_type_format(response, MIME_PLAIN, body);
+        free(path);
+        return respond(req, response, MIME_PLAIN, ERROR_MESSAGE_TWO);
     }
 
-    FILE *f = fopen(path, "r");
-    ssize_t file_size = wutil_get_file_size(f);
-    char *copy = malloc(sizeof(char) * file_size);
-    fread(copy, sizeof(char), file_size, f);
+    size_t file_size = 0;
+    int fd = wutil_open_file(path, &file_size);
+    if (fd < 0) {
+        free(path);
+        return respond(req, HTTP_NOT_FOUND, MIME_PLAIN, ERROR_MESSAGE_THREE);
+    }
 
     char *name = wutil_get_filename_ext(path);
     mime_type_t mime = wutil_get_mime_from_extension(name);
-    bytes_t *body = bytes_init(file_size, copy);
-    return response_type_format(response, mime, body);
+    free(path);
+    // the file is never read into memory: the body segment refers to it and
+    // is sent straight from the page cache after the header
+    response_t *resp = response_init(req->arena, response, mime);
+    response_add_body_file(resp, fd, 0, file_size);
+    return response_finish(resp);
 }
 
 int main(int argc, char **argv) {
-    if (argc != 2) {
-        fprintf(stderr, "USAGE:  %s <server port>\n", argv[0]);
+    size_t num_workers = 1;
+    http_server_options_t options = http_server_default_options();
+    bool valid_args = argc >= 2;
+    for (int i = 2; i < argc && valid_args; i++) {
+        if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            num_workers = strtoul(argv[++i], NULL, 10);
+            valid_args = num_workers > 0;
+        } else if (strcmp(argv[i], "--io-uring") == 0) {
+            options.backend = NU_BACKEND_URING;
+        } else if (strcmp(argv[i], "--high-water") == 0 && i + 1 < argc) {
+            options.output_high_water = strtoul(argv[++i], NULL, 10);
+        } else {
+            valid_args = false;
+        }
+    }
+    if (!valid_args) {
+        fprintf(stderr, "USAGE:  %s <server port> [--workers N] [--io-uring] [--high-water BYTES]\n", argv[0]);
         exit(1);
     }
     
     int port = atoi(argv[1]);
 
-    router_t *router = router_init(2, default_handler);
+    router_t *router = router_init(4, default_handler);
     router_register(router, HELLO_PATH, hello_handler);
     router_register(router, ROLL_PATH, roll_handler);
+    router_register(router, UPLOAD_PATH, upload_handler);
+    router_register(router, COUNT_PATH, count_handler);
+    router_set_max_body(router, UPLOAD_PATH, UPLOAD_MAX_BODY);
 
-    while (1){
-        char *input = NULL;
-        connection_t *log_in = nu_wait_client(port);
-
-        while (input == NULL){
-            input = nu_try_read_header(log_in);
-        }
-        
-        request_t *parsed_input = request_parse(input);
-        bytes_t *dispatch = router_dispatch(router, parsed_input);
-        nu_send_bytes(log_in, dispatch->data, dispatch->len);
-
-        free(input);
-        nu_close_connection(log_in);
+    if (http_server_run_workers(port, router, num_workers, &options) < 0) {
+        router_free(router);
+        exit(1);
     }
 
+    router_free(router);
     return 0;
 }
-
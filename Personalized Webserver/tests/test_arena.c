@@ -0,0 +1,86 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdalign.h>
+#include <string.h>
+#include "test_util.h"
+#include "arena.h"
+
+void test_arena_alloc() {
+    arena_t *arena = arena_init(256);
+    char *prev = NULL;
+    // allocations are aligned, don't overlap, and survive later ones
+    for (size_t size = 0; size < 100; size++) {
+        char *block = arena_alloc(arena, size);
+        assert((uintptr_t) block % alignof(max_align_t) == 0);
+        memset(block, size, size);
+        if (prev != NULL && size > 1) {
+            for (size_t i = 0; i < size - 1; i++) {
+                assert(prev[i] == (char) (size - 1));
+            }
+        }
+        prev = block;
+    }
+    arena_free(arena);
+}
+
+void test_arena_strndup() {
+    arena_t *arena = arena_init(64);
+    char *copy = arena_strndup(arena, "Host: localhost", 4);
+    assert_streq("Host", copy);
+    char *empty = arena_strndup(arena, "", 0);
+    assert_streq("", empty);
+    assert_streq("Host", copy);
+    arena_free(arena);
+}
+
+void test_arena_reset_reuses() {
+    arena_t *arena = arena_init(1024);
+    char *first[8];
+    for (size_t i = 0; i < 8; i++) {
+        first[i] = arena_alloc(arena, 500);
+    }
+    // the same allocations after a reset come out of the same chunks
+    for (size_t round = 0; round < 10; round++) {
+        arena_reset(arena);
+        for (size_t i = 0; i < 8; i++) {
+            char *block = arena_alloc(arena, 500);
+            bool reused = false;
+            for (size_t j = 0; j < 8; j++) {
+                reused = reused || block == first[j];
+            }
+            assert(reused);
+            memset(block, 0, 500);
+        }
+    }
+    arena_free(arena);
+}
+
+void test_arena_large() {
+    arena_t *arena = arena_init(128);
+    char *small = arena_alloc(arena, 16);
+    strcpy(small, "small");
+    // bigger than a chunk, so it gets a block of its own
+    char *large = arena_alloc(arena, 10000);
+    memset(large, 'x', 10000);
+    char *after = arena_alloc(arena, 16);
+    assert(after == small + 16);
+    assert_streq("small", small);
+    // large blocks are freed on reset (which ASAN checks isn't a leak)
+    arena_reset(arena);
+    large = arena_alloc(arena, 20000);
+    memset(large, 'y', 20000);
+    arena_free(arena);
+}
+
+int main(int argc, char *argv[]) {
+    // Run all tests? True if there are no command-line arguments
+    bool all_tests = argc == 1;
+    char **testnames = argv + 1;
+
+    DO_TEST(test_arena_alloc)
+    DO_TEST(test_arena_strndup)
+    DO_TEST(test_arena_reset_reuses)
+    DO_TEST(test_arena_large)
+    puts("test_arena PASS");
+}
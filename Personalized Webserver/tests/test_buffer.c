@@ -0,0 +1,148 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "test_util.h"
+#include "buffer.h"
+
+#define NUM_THREADS 4
+#define REFS_PER_THREAD 100000
+
+void test_buffer_copy() {
+    char data[] = "Hello, world!";
+    buffer_t *buffer = buffer_copy(data, strlen(data));
+    // the buffer has a copy of its own
+    data[0] = 'J';
+    assert(buffer_len(buffer) == 13);
+    assert(memcmp(buffer_data(buffer), "Hello, world!", 13) == 0);
+    assert(buffer_data(buffer) != data);
+    buffer_release(buffer);
+
+    buffer_t *empty = buffer_copy("", 0);
+    assert(buffer_len(empty) == 0);
+    buffer_release(empty);
+}
+
+void test_buffer_wrap() {
+    char *data = strdup("wrapped");
+    buffer_t *buffer = buffer_wrap(data, strlen(data));
+    assert(buffer_data(buffer) == data);
+    assert(buffer_len(buffer) == 7);
+    // the data is freed along with the buffer, which asan checks
+    buffer_release(buffer);
+}
+
+void test_buffer_refs() {
+    buffer_t *buffer = buffer_copy("shared", 6);
+    assert(buffer_retain(buffer) == buffer);
+    buffer_retain(buffer);
+    buffer_release(buffer);
+    buffer_release(buffer);
+    // still alive with one reference left
+    assert(memcmp(buffer_data(buffer), "shared", 6) == 0);
+    buffer_release(buffer);
+}
+
+void test_buffer_slice() {
+    buffer_t *buffer = buffer_copy("Hello, world!", 13);
+    buffer_t *world = buffer_slice(buffer, 7, 5);
+    assert(buffer_len(world) == 5);
+    assert(buffer_data(world) == buffer_data(buffer) + 7);
+    // a slice keeps its parent alive
+    buffer_release(buffer);
+    assert(memcmp(buffer_data(world), "world", 5) == 0);
+    buffer_t *orl = buffer_slice(world, 1, 3);
+    assert(memcmp(buffer_data(orl), "orl", 3) == 0);
+    buffer_release(world);
+    buffer_t *empty = buffer_slice(orl, 3, 0);
+    assert(buffer_len(empty) == 0);
+    buffer_release(orl);
+    buffer_release(empty);
+}
+
+void test_buffer_map_file() {
+    char path[] = "/tmp/test_buffer_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    unlink(path);
+    char contents[10000];
+    for (size_t i = 0; i < sizeof(contents); i++) {
+        contents[i] = 'a' + i % 26;
+    }
+    assert(write(fd, contents, sizeof(contents)) == (ssize_t) sizeof(contents));
+    buffer_t *buffer = buffer_map_file(fd);
+    assert(buffer != NULL);
+    // the mapping outlives the file descriptor
+    close(fd);
+    assert(buffer_len(buffer) == sizeof(contents));
+    assert(memcmp(buffer_data(buffer), contents, sizeof(contents)) == 0);
+    buffer_t *slice = buffer_slice(buffer, 9000, 1000);
+    buffer_release(buffer);
+    assert(memcmp(buffer_data(slice), contents + 9000, 1000) == 0);
+    buffer_release(slice);
+}
+
+void test_buffer_map_empty() {
+    char path[] = "/tmp/test_buffer_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    unlink(path);
+    buffer_t *buffer = buffer_map_file(fd);
+    assert(buffer != NULL && buffer_len(buffer) == 0);
+    buffer_release(buffer);
+    close(fd);
+}
+
+void test_buffer_map_invalid() {
+    assert(buffer_map_file(-1) == NULL);
+    assert(errno == EBADF);
+    int fd = open("/tmp", O_RDONLY);
+    assert(fd >= 0);
+    assert(buffer_map_file(fd) == NULL);
+    assert(errno == EINVAL);
+    close(fd);
+}
+
+void *hammer_refs(void *aux) {
+    buffer_t *buffer = aux;
+    for (size_t i = 0; i < REFS_PER_THREAD; i++) {
+        buffer_t *ref = buffer_retain(buffer);
+        assert(buffer_data(ref)[0] == 'x');
+        buffer_release(ref);
+    }
+    buffer_release(buffer);
+    return NULL;
+}
+
+void test_buffer_threads() {
+    // references taken and dropped on several threads at once all balance out,
+    // and whichever thread drops the last one frees the buffer
+    buffer_t *buffer = buffer_copy("x", 1);
+    pthread_t threads[NUM_THREADS];
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, hammer_refs, buffer_retain(buffer)) == 0);
+    }
+    buffer_release(buffer);
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // Run all tests? True if there are no command-line arguments
+    bool all_tests = argc == 1;
+    char **testnames = argv + 1;
+
+    DO_TEST(test_buffer_copy)
+    DO_TEST(test_buffer_wrap)
+    DO_TEST(test_buffer_refs)
+    DO_TEST(test_buffer_slice)
+    DO_TEST(test_buffer_map_file)
+    DO_TEST(test_buffer_map_empty)
+    DO_TEST(test_buffer_map_invalid)
+    DO_TEST(test_buffer_threads)
+    puts("test_buffer PASS");
+}
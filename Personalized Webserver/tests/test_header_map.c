@@ -0,0 +1,182 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "test_util.h"
+#include "header_map.h"
+
+void add_lit(header_map_t *map, const char *name, const char *value) {
+    header_map_add(map, name, strlen(name), value, strlen(value));
+}
+
+void test_header_map_simple() {
+    header_map_t *map = header_map_init(NULL);
+    assert(header_map_size(map) == 0);
+    assert(header_map_get(map, "Host") == NULL);
+    add_lit(map, "Host", "localhost:8080");
+    add_lit(map, "Accept", "*/*");
+    assert_streq("localhost:8080", header_map_get(map, "Host"));
+    assert_streq("*/*", header_map_get(map, "Accept"));
+    assert(header_map_get(map, "Hos") == NULL);
+    assert(header_map_get(map, "Hostt") == NULL);
+    assert(header_map_size(map) == 2);
+    header_map_free(map);
+}
+
+void test_header_map_case_insensitive() {
+    header_map_t *map = header_map_init(NULL);
+    add_lit(map, "Content-Length", "42");
+    assert_streq("42", header_map_get(map, "content-length"));
+    assert_streq("42", header_map_get(map, "CONTENT-LENGTH"));
+    assert_streq("42", header_map_get(map, "cOnTeNt-LeNgTh"));
+    // only letters are folded
+    assert(header_map_get(map, "Content_Length") == NULL);
+    // the name keeps the case it was sent in
+    const char *name = NULL;
+    assert_streq("42", header_map_entry(map, 0, &name));
+    assert_streq("Content-Length", name);
+    header_map_free(map);
+}
+
+void test_header_map_multi_value() {
+    header_map_t *map = header_map_init(NULL);
+    add_lit(map, "Accept", "text/html");
+    add_lit(map, "Host", "a");
+    add_lit(map, "accept", "text/plain");
+    add_lit(map, "ACCEPT", "image/png");
+    assert(header_map_count(map, "Accept") == 3);
+    assert(header_map_count(map, "Host") == 1);
+    assert(header_map_count(map, "Missing") == 0);
+    assert_streq("image/png", header_map_get(map, "Accept"));
+
+    const char *expected[] = {"text/html", "text/plain", "image/png"};
+    size_t cursor = 0;
+    for (size_t i = 0; i < 3; i++) {
+        assert_streq(expected[i], header_map_next_value(map, "accept", &cursor));
+    }
+    assert(header_map_next_value(map, "accept", &cursor) == NULL);
+    assert(header_map_next_value(map, "accept", &cursor) == NULL);
+    cursor = 0;
+    assert(header_map_next_value(map, "Missing", &cursor) == NULL);
+
+    // every header, in order
+    const char *names[] = {"Accept", "Host", "accept", "ACCEPT"};
+    assert(header_map_size(map) == 4);
+    for (size_t i = 0; i < 4; i++) {
+        const char *name = NULL;
+        header_map_entry(map, i, &name);
+        assert_streq(names[i], name);
+    }
+    header_map_free(map);
+}
+
+void test_header_map_binary() {
+    // names and values are copied by length, not up to a null-terminator
+    header_map_t *map = header_map_init(NULL);
+    char name[] = "X-Thing: junk";
+    char value[] = "value\r\nmore";
+    header_map_add(map, name, 7, value, 5);
+    memset(name, 0, sizeof(name));
+    memset(value, 0, sizeof(value));
+    assert_streq("value", header_map_get(map, "x-thing"));
+    add_lit(map, "Empty", "");
+    assert_streq("", header_map_get(map, "empty"));
+    header_map_free(map);
+}
+
+void test_header_map_many(arena_t *arena) {
+    // enough names to grow the map several times
+    const size_t num_names = 1000;
+    header_map_t *map = header_map_init(arena);
+    char name[32], value[32];
+    for (size_t round = 0; round < 2; round++) {
+        for (size_t i = 0; i < num_names; i++) {
+            snprintf(name, sizeof(name), round == 0 ? "header-%zu" : "HEADER-%zu", i);
+            snprintf(value, sizeof(value), "%zu-%zu", round, i);
+            add_lit(map, name, value);
+        }
+    }
+    assert(header_map_size(map) == 2 * num_names);
+    for (size_t i = 0; i < num_names; i++) {
+        snprintf(name, sizeof(name), "Header-%zu", i);
+        snprintf(value, sizeof(value), "1-%zu", i);
+        assert_streq(value, header_map_get(map, name));
+        assert(header_map_count(map, name) == 2);
+    }
+    header_map_free(map);
+}
+
+void test_header_map_heap() {
+    test_header_map_many(NULL);
+}
+
+void test_header_map_arena() {
+    arena_t *arena = arena_init(ARENA_DEFAULT_CHUNK_SIZE);
+    test_header_map_many(arena);
+    arena_reset(arena);
+    test_header_map_many(arena);
+    arena_free(arena);
+}
+
+void test_known_headers() {
+    // every known header hashes to its own slot, in any case
+    char name[64];
+    for (known_header_t id = HEADER_UNKNOWN + 1; id < KNOWN_HEADERS_END; id++) {
+        const char *known = known_header_name(id);
+        size_t len = strlen(known);
+        assert(known_header_lookup(known, len) == id);
+        for (size_t i = 0; i < len; i++) {
+            name[i] = i % 2 == 0 ? toupper(known[i]) : tolower(known[i]);
+        }
+        assert(known_header_lookup(name, len) == id);
+        // names that share a known header's hash, but aren't it
+        memcpy(name, known, len);
+        name[len / 2] = '_';
+        assert(known_header_lookup(name, len) == HEADER_UNKNOWN);
+        assert(known_header_lookup(known, len - 1) == HEADER_UNKNOWN);
+    }
+    assert(known_header_lookup("", 0) == HEADER_UNKNOWN);
+    assert(known_header_lookup("X-Forwarded-For", 15) == HEADER_UNKNOWN);
+    // '@' | 0x20 is '`', which isn't a letter
+    assert(known_header_lookup("@ccept", 6) == HEADER_UNKNOWN);
+}
+
+void test_header_map_known() {
+    header_map_t *map = header_map_init(NULL);
+    add_lit(map, "Host", "a");
+    header_map_add_known(map, HEADER_CONTENT_LENGTH, "content-length", 14, "5", 1);
+    header_map_add_known(map, HEADER_UNKNOWN, "X-Thing", 7, "x", 1);
+    add_lit(map, "CONTENT-LENGTH", "6");
+    // known headers are found either way, by name or by ID
+    assert_streq("a", header_map_get_known(map, HEADER_HOST));
+    assert_streq("6", header_map_get_known(map, HEADER_CONTENT_LENGTH));
+    assert_streq("6", header_map_get(map, "Content-Length"));
+    assert(header_map_count(map, "content-length") == 2);
+    assert(header_map_get_known(map, HEADER_ACCEPT) == NULL);
+    assert_streq("x", header_map_get(map, "x-thing"));
+    size_t cursor = 0;
+    assert_streq("5", header_map_next_value(map, "Content-Length", &cursor));
+    assert_streq("6", header_map_next_value(map, "Content-Length", &cursor));
+    assert(header_map_next_value(map, "Content-Length", &cursor) == NULL);
+    const char *name = NULL;
+    assert_streq("5", header_map_entry(map, 1, &name));
+    assert_streq("content-length", name);
+    header_map_free(map);
+}
+
+int main(int argc, char *argv[]) {
+    // Run all tests? True if there are no command-line arguments
+    bool all_tests = argc == 1;
+    char **testnames = argv + 1;
+
+    DO_TEST(test_header_map_simple)
+    DO_TEST(test_header_map_case_insensitive)
+    DO_TEST(test_header_map_multi_value)
+    DO_TEST(test_header_map_binary)
+    DO_TEST(test_header_map_heap)
+    DO_TEST(test_header_map_arena)
+    DO_TEST(test_known_headers)
+    DO_TEST(test_header_map_known)
+    puts("test_header_map PASS");
+}
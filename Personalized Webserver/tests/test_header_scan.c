@@ -0,0 +1,149 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+#include "header_scan.h"
+
+typedef const char *(*scan_fn_t)(const char *buf, size_t len);
+
+const char *IMPL_NAMES[] = {"scalar", "sse2", "avx2"};
+scan_fn_t IMPLS[] = {
+    header_scan_terminator_scalar,
+    header_scan_terminator_sse2,
+    header_scan_terminator_avx2,
+};
+#define NUM_IMPLS (sizeof(IMPLS) / sizeof(IMPLS[0]))
+
+void test_scan_simple() {
+    const char *header = "GET / HTTP/1.1\r\nHost: x\r\n\r\nleftover";
+    assert(header_scan_terminator(header, strlen(header)) == header + 27);
+    assert(header_scan_terminator(header, 27) == header + 27);
+    assert(header_scan_terminator(header, 26) == NULL);
+    assert(header_scan_terminator(header, 0) == NULL);
+}
+
+void test_scan_impls_agree() {
+    // terminators (and near misses) at every offset and length, so that each
+    // implementation's vector loop, block boundaries and scalar tail are all
+    // exercised
+    char buf[160];
+    for (size_t pos = 0; pos + 4 <= sizeof(buf); pos++) {
+        memset(buf, 'a', sizeof(buf));
+        // a near miss just before the real thing
+        if (pos >= 3) {
+            memcpy(buf + pos - 3, "\r\n\r", 3);
+        }
+        memcpy(buf + pos, "\r\n\r\n", 4);
+        for (size_t len = 0; len <= sizeof(buf); len++) {
+            const char *expected = pos + 4 <= len ? buf + pos + 4 : NULL;
+            for (size_t i = 0; i < NUM_IMPLS; i++) {
+                if (!header_scan_supported(IMPL_NAMES[i])) {
+                    continue;
+                }
+                assert(IMPLS[i](buf, len) == expected);
+            }
+            assert(header_scan_terminator(buf, len) == expected);
+        }
+    }
+}
+
+void test_scan_first_match() {
+    char buf[100];
+    memset(buf, 'x', sizeof(buf));
+    memcpy(buf + 40, "\r\n\r\n", 4);
+    memcpy(buf + 45, "\r\n\r\n", 4);
+    for (size_t i = 0; i < NUM_IMPLS; i++) {
+        if (header_scan_supported(IMPL_NAMES[i])) {
+            assert(IMPLS[i](buf, sizeof(buf)) == buf + 44);
+        }
+    }
+}
+
+void test_scan_random() {
+    // mostly '\r' and '\n', so there are lots of partial terminators
+    const char alphabet[] = "\r\n\r\na";
+    char buf[512];
+    srand(42);
+    for (size_t round = 0; round < 2000; round++) {
+        size_t len = rand() % sizeof(buf);
+        for (size_t i = 0; i < len; i++) {
+            buf[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        const char *expected = header_scan_terminator_scalar(buf, len);
+        for (size_t i = 1; i < NUM_IMPLS; i++) {
+            if (header_scan_supported(IMPL_NAMES[i])) {
+                assert(IMPLS[i](buf, len) == expected);
+            }
+        }
+    }
+}
+
+void test_scan_from() {
+    // feed a header in pieces, splitting the terminator too
+    const char *header = "GET /hello HTTP/1.1\r\nHost: localhost\r\nAccept: */*\r\n\r\n";
+    size_t header_len = strlen(header);
+    for (size_t step = 1; step < 20; step++) {
+        size_t scanned = 0;
+        const char *end = NULL;
+        size_t len = 0;
+        while (end == NULL) {
+            len = len + step < header_len ? len + step : header_len;
+            end = header_scan_terminator_from(header, len, &scanned);
+            assert(scanned <= len);
+            if (end == NULL) {
+                assert(len < header_len);
+            }
+        }
+        assert(end == header + header_len);
+    }
+}
+
+void test_scan_impl() {
+    const char *impl = header_scan_impl();
+    assert(header_scan_supported(impl));
+    assert(header_scan_supported("scalar"));
+    assert(!header_scan_supported("neon9000"));
+}
+
+void test_scan_text_and_token() {
+    const char *value = "text/html; q=0.9\t\r\nHost: x";
+    assert(header_scan_text(value, strlen(value)) == 17);
+    const char *line = "Content-Length: 42\r\n";
+    assert(header_scan_token(line, strlen(line), ':') == 14);
+    assert(header_scan_token(line, strlen(line), '\0') == 15);
+    assert(header_scan_text("", 0) == 0);
+    assert(header_scan_token("abc", 3, ':') == 3);
+
+    // every byte value, at every offset, against a checker written out byte
+    // by byte, so both the vector loop and the scalar tail are exercised
+    char buf[80];
+    for (int c = 0; c < 256; c++) {
+        bool in_text = (c >= 0x20 || c == '\t') && c != 0x7f;
+        bool in_token = c > 0x20 && c != 0x7f && c != ':';
+        for (size_t pos = 0; pos < sizeof(buf); pos++) {
+            memset(buf, 'a', sizeof(buf));
+            buf[pos] = (char) c;
+            for (size_t len = pos; len <= sizeof(buf); len += 7) {
+                size_t text = header_scan_text(buf, len);
+                size_t token = header_scan_token(buf, len, ':');
+                assert(text == (in_text || pos == len ? len : pos));
+                assert(token == (in_token || pos == len ? len : pos));
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // Run all tests? True if there are no command-line arguments
+    bool all_tests = argc == 1;
+    char **testnames = argv + 1;
+
+    DO_TEST(test_scan_simple)
+    DO_TEST(test_scan_impls_agree)
+    DO_TEST(test_scan_first_match)
+    DO_TEST(test_scan_random)
+    DO_TEST(test_scan_from)
+    DO_TEST(test_scan_impl)
+    DO_TEST(test_scan_text_and_token)
+    puts("test_header_scan PASS");
+}
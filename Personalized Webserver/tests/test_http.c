@@ -2,9 +2,18 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 #include "http_request.h"
 #include "http_response.h"
 
+// the date every response is pinned to (see main), RFC 9110's example
+#define PINNED_DATE 784111777
+#define DATE_HEADERS "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\nServer: Personalized-Server\r\n"
+
 char* response_format(response_code_t code, char *resp) {
     bytes_t *to_send;
     if (!resp) {
@@ -25,9 +34,7 @@ void test_init_simple() {
     assert_streq("GET", req->method);
     assert_streq("/index.html", req->path);
     assert_streq("HTTP/1.1", req->http_version);
-    strarray_t *header_keys = ll_get_keys(req->headers);
-    assert(header_keys->length == 0);
-    strarray_free(header_keys);
+    assert(header_map_size(req->headers) == 0);
     request_free(req);
 }
 
@@ -44,9 +51,7 @@ void test_init_copy() {
     assert_streq("GET", req->method);
     assert_streq("/index.html", req->path);
     assert_streq("HTTP/1.1", req->http_version);
-    strarray_t *header_keys = ll_get_keys(req->headers);
-    assert(header_keys->length == 0);
-    strarray_free(header_keys);
+    assert(header_map_size(req->headers) == 0);
     request_free(req);
     // if init is copying, this isn't a double-free
     free(method);
@@ -60,15 +65,11 @@ void test_init_multuple() {
     assert_streq("GET", req1->method);
     assert_streq("/index.html", req1->path);
     assert_streq("HTTP/1.1", req1->http_version);
-    strarray_t *header_keys = ll_get_keys(req1->headers);
-    assert(header_keys->length == 0);
-    strarray_free(header_keys);
+    assert(header_map_size(req1->headers) == 0);
     assert_streq("POST", req2->method);
     assert_streq("/index.html", req2->path);
     assert_streq("HTTP/1.1", req2->http_version);
-    header_keys = ll_get_keys(req2->headers);
-    assert(header_keys->length == 0);
-    strarray_free(header_keys);
+    assert(header_map_size(req2->headers) == 0);
     request_free(req1);
     request_free(req2);
 }
@@ -85,9 +86,9 @@ void test_parse_simple() {
     assert_streq("GET", req->method);
     assert_streq("/index.html", req->path);
     assert_streq("HTTP/1.1", req->http_version);
-    assert_streq("localhost:8080", ll_get(req->headers, "Host"));
-    assert_streq("curl/7.68.0", ll_get(req->headers, "User-Agent"));
-    assert_streq("*/*", ll_get(req->headers, "Accept"));
+    assert_streq("localhost:8080", request_header(req, "Host"));
+    assert_streq("curl/7.68.0", request_header(req, "User-Agent"));
+    assert_streq("*/*", request_header(req, "Accept"));
     request_free(req);
 }
 
@@ -105,9 +106,9 @@ void test_parse_copy() {
     assert_streq("GET", req->method);
     assert_streq("/index.html", req->path);
     assert_streq("HTTP/1.1", req->http_version);
-    assert_streq("localhost:8080", ll_get(req->headers, "Host"));
-    assert_streq("curl/7.68.0", ll_get(req->headers, "User-Agent"));
-    assert_streq("*/*", ll_get(req->headers, "Accept"));
+    assert_streq("localhost:8080", request_header(req, "Host"));
+    assert_streq("curl/7.68.0", request_header(req, "User-Agent"));
+    assert_streq("*/*", request_header(req, "Accept"));
     request_free(req);
     // if parse is copying, this isn't a double-free
     free(contents);
@@ -144,7 +145,7 @@ void test_parse_many_headers() {
         char key[6], value[6];
         snprintf(key, sizeof(key), "k%zu", i);
         snprintf(value, sizeof(value), "v%zu", i);
-        assert_streq(value, ll_get(req->headers, key));
+        assert_streq(value, request_header(req, key));
     }
     request_free(req);
     free(contents);
@@ -173,6 +174,443 @@ void test_parse_long_prefix() {
     request_free(req);
 }
 
+bool view_eq(str_view_t view, const char *str) {
+    return view.len == strlen(str) && memcmp(view.ptr, str, view.len) == 0;
+}
+
+void test_view_parse() {
+    const char *contents = "POST /upload HTTP/1.1\r\n"
+                           "Host: localhost:8080\r\n"
+                           "Accept:text/html, */*;q=0.8  \r\n"
+                           "X-Empty:\r\n"
+                           "content-length: \t 5\r\n"
+                           "\r\n"
+                           "hello";
+    request_view_t view;
+    assert(request_view_parse(contents, strlen(contents), &view));
+    // views point straight into the contents
+    assert(view.method.ptr == contents);
+    assert(view_eq(view.method, "POST"));
+    assert(view_eq(view.path, "/upload"));
+    assert(view_eq(view.http_version, "HTTP/1.1"));
+    assert(view.num_headers == 4);
+    assert(view_eq(view.headers[0].name, "Host"));
+    assert(view_eq(view.headers[0].value, "localhost:8080"));
+    // values keep inner whitespace but are trimmed at both ends
+    assert(view_eq(view.headers[1].value, "text/html, */*;q=0.8"));
+    assert(view_eq(view.headers[2].value, ""));
+    assert(view_eq(*request_view_header(&view, "Content-Length"), "5"));
+    assert(view_eq(*request_view_header(&view, "HOST"), "localhost:8080"));
+    assert(request_view_header(&view, "Hos") == NULL);
+    assert(request_view_header(&view, "Cookie") == NULL);
+    // known headers are tagged as they are parsed
+    assert(view.headers[0].id == HEADER_HOST);
+    assert(view.headers[1].id == HEADER_ACCEPT);
+    assert(view_eq(*request_view_known_header(&view, HEADER_CONTENT_LENGTH), "5"));
+    assert(request_view_known_header(&view, HEADER_COOKIE) == NULL);
+    request_view_free(&view);
+}
+
+void test_view_parse_line_endings() {
+    // bare newlines, and no empty line at the end
+    const char *contents = "GET / HTTP/1.0\nA: 1\r\nB: 2";
+    request_view_t view;
+    assert(request_view_parse(contents, strlen(contents), &view));
+    assert(view_eq(view.http_version, "HTTP/1.0"));
+    assert(view.num_headers == 2);
+    assert(view_eq(*request_view_header(&view, "a"), "1"));
+    assert(view_eq(*request_view_header(&view, "b"), "2"));
+    request_view_free(&view);
+
+    // only the first `len` bytes are looked at
+    assert(request_view_parse(contents, strlen("GET / HTTP/1.0"), &view));
+    assert(view_eq(view.http_version, "HTTP/1.0"));
+    assert(view.num_headers == 0);
+    request_view_free(&view);
+}
+
+void test_view_parse_many_headers() {
+    // more headers than fit inline spill onto the heap
+    const size_t NUM_HEADERS = 3 * REQUEST_VIEW_INLINE_HEADERS + 1;
+    char *contents = malloc(NUM_HEADERS * 16 + 32);
+    size_t len = sprintf(contents, "GET / HTTP/1.1\r\n");
+    for (size_t i = 0; i < NUM_HEADERS; i++) {
+        len += sprintf(contents + len, "h%zu: %zu\r\n", i, i);
+    }
+    len += sprintf(contents + len, "\r\n");
+    request_view_t view;
+    assert(request_view_parse(contents, len, &view));
+    assert(view.num_headers == NUM_HEADERS);
+    for (size_t i = 0; i < NUM_HEADERS; i++) {
+        char name[8], value[8];
+        snprintf(name, sizeof(name), "h%zu", i);
+        snprintf(value, sizeof(value), "%zu", i);
+        assert(view_eq(view.headers[i].name, name));
+        assert(view_eq(*request_view_header(&view, name), value));
+    }
+    request_view_free(&view);
+    free(contents);
+}
+
+void test_view_parse_invalid() {
+    const char *invalid[] = {
+        "",
+        "\r\n\r\n",
+        "GET\r\n\r\n",
+        "GET /\r\n\r\n",
+        "GET / \r\n\r\n",
+        " / HTTP/1.1\r\n\r\n",
+        "GET  HTTP/1.1\r\n\r\n",
+        "GET / HTTP/1.1 extra\r\n\r\n",
+        "GET / HTTP/1.1\r\nno colon\r\n\r\n",
+        "GET / HTTP/1.1\r\n: no name\r\n\r\n",
+        "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost : x\r\n\r\n",
+        "GET / HTTP/1.1\r\nX(Y): 1\r\n\r\n",
+        "GET / HTTP/1.1\r\nX-\x80: 1\r\n\r\n",
+        "G{T / HTTP/1.1\r\n\r\n",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        request_view_t view;
+        assert(!request_view_parse(invalid[i], strlen(invalid[i]), &view));
+        request_view_free(&view);
+        assert(request_parse(invalid[i]) == NULL);
+    }
+}
+
+void test_request_from_view() {
+    char *contents = strdup("GET /a HTTP/1.1\r\nX: first\r\nY: y\r\nX: second\r\n\r\n");
+    request_view_t view;
+    assert(request_view_parse(contents, strlen(contents), &view));
+    request_t *req = request_from_view(&view);
+    request_view_free(&view);
+    memset(contents, 0, strlen(contents));
+    free(contents);
+    assert_streq("GET", req->method);
+    assert_streq("/a", req->path);
+    assert_streq("HTTP/1.1", req->http_version);
+    assert_streq("second", request_header(req, "X"));
+    assert_streq("y", request_header(req, "Y"));
+    request_free(req);
+}
+
+void test_request_header() {
+    request_t *req = request_parse("GET / HTTP/1.1\r\n"
+                                   "Host: localhost\r\n"
+                                   "accept: text/html\r\n"
+                                   "Accept: image/png\r\n"
+                                   "\r\n");
+    assert_streq("localhost", request_header(req, "host"));
+    assert_streq("localhost", request_header(req, "HOST"));
+    assert_streq("image/png", request_header(req, "Accept"));
+    assert(request_header(req, "Connection") == NULL);
+    // both values are kept, in order
+    assert(header_map_count(req->headers, "ACCEPT") == 2);
+    size_t cursor = 0;
+    assert_streq("text/html", header_map_next_value(req->headers, "Accept", &cursor));
+    assert_streq("image/png", header_map_next_value(req->headers, "Accept", &cursor));
+    assert(header_map_next_value(req->headers, "Accept", &cursor) == NULL);
+    // known headers can also be found by ID
+    assert_streq("localhost", request_known_header(req, HEADER_HOST));
+    assert_streq("image/png", request_known_header(req, HEADER_ACCEPT));
+    assert(request_known_header(req, HEADER_CONNECTION) == NULL);
+    request_free(req);
+}
+
+void test_request_from_view_arena() {
+    const char *contents = "GET /a HTTP/1.1\r\nX: first\r\nY: y\r\nX: second\r\n\r\n";
+    arena_t *arena = arena_init(ARENA_DEFAULT_CHUNK_SIZE);
+    for (size_t round = 0; round < 3; round++) {
+        request_view_t view;
+        assert(request_view_parse(contents, strlen(contents), &view));
+        request_t *req = request_from_view_arena(&view, arena);
+        request_view_free(&view);
+        assert(req->arena == arena);
+        assert_streq("GET", req->method);
+        assert_streq("/a", req->path);
+        assert_streq("HTTP/1.1", req->http_version);
+        assert_streq("second", request_header(req, "X"));
+        assert_streq("y", request_header(req, "Y"));
+
+        // a response made in the same arena, released with the request
+        bytes_t body = { .len = 5, .data = "hello", .fd = -1 };
+        bytes_t *resp = response_type_format_arena(arena, HTTP_OK, MIME_PLAIN, &body);
+        assert(resp->arena == arena);
+        assert_streq("HTTP/1.1 200 OK\r\n"
+                     "Content-Type: text/plain\r\n" DATE_HEADERS
+                     "Content-Length: 5\r\n"
+                     "\r\n"
+                     "hello", resp->data);
+        bytes_free(resp);
+        request_free(req);
+        arena_reset(arena);
+    }
+    arena_free(arena);
+}
+
+/**
+ * Feeds `header` to a parser `step` bytes at a time, as though that many
+ * arrived per read, and returns the final status.
+ */
+void test_parse_query() {
+    request_t *req = request_parse("GET /search?q=a?b&x HTTP/1.1\r\n\r\n");
+    // only the first '?' splits the target
+    assert_streq("/search", req->path);
+    assert_streq("q=a?b&x", req->query);
+    request_free(req);
+
+    req = request_parse("GET /search? HTTP/1.1\r\n\r\n");
+    assert_streq("/search", req->path);
+    assert_streq("", req->query);
+    request_free(req);
+
+    req = request_parse("GET /search HTTP/1.1\r\n\r\n");
+    assert_streq("/search", req->path);
+    assert(req->query == NULL);
+    assert(request_query_param(req, "q") == NULL);
+    request_free(req);
+
+    req = request_init("GET", "/a?b=c", "HTTP/1.1");
+    assert_streq("/a", req->path);
+    assert_streq("c", request_query_param(req, "b"));
+    request_free(req);
+}
+
+void test_url_decode() {
+    char out[32];
+    const char *in = "a%20b%2Fc+d%7e";
+    ssize_t len = url_decode(out, in, strlen(in), false);
+    assert(len == 8 && memcmp(out, "a b/c+d~", 8) == 0);
+    len = url_decode(out, in, strlen(in), true);
+    assert(len == 8 && memcmp(out, "a b/c d~", 8) == 0);
+    // a '%' must be followed by two hex digits, and can't encode a null byte
+    const char *invalid[] = {"%", "a%2", "%zz", "%2g", "%00", "x%00y"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        assert(url_decode(out, invalid[i], strlen(invalid[i]), false) == -1);
+    }
+    assert(url_decode(out, "", 0, false) == 0);
+}
+
+void test_request_path() {
+    request_t *req = request_parse("GET /my%20file.txt?q=%20 HTTP/1.1\r\n\r\n");
+    assert_streq("/my%20file.txt", req->path);
+    assert_streq("/my file.txt", request_path(req));
+    // decoded once, then remembered
+    assert(request_path(req) == request_path(req));
+    request_free(req);
+
+    // nothing to decode, so nothing is copied
+    req = request_parse("GET /plain+path HTTP/1.1\r\n\r\n");
+    assert(request_path(req) == req->path);
+    request_free(req);
+
+    req = request_parse("GET /bad%2 HTTP/1.1\r\n\r\n");
+    assert(request_path(req) == NULL);
+    request_free(req);
+
+    // in an arena, the decoded path is too
+    arena_t *arena = arena_init(ARENA_DEFAULT_CHUNK_SIZE);
+    const char *header = "GET /%2e%2E/x HTTP/1.1\r\n\r\n";
+    request_view_t view;
+    assert(request_view_parse(header, strlen(header), &view));
+    req = request_from_view_arena(&view, arena);
+    request_view_free(&view);
+    assert_streq("/../x", request_path(req));
+    request_free(req);
+    arena_free(arena);
+}
+
+void test_query_params() {
+    request_t *req = request_init("GET", "/s?q=cat+pics&page=2&empty=&flag&a%26b=c%3Dd&q=dog&bad=%zz", "HTTP/1.1");
+    assert_streq("cat pics", request_query_param(req, "q"));
+    assert_streq("2", request_query_param(req, "page"));
+    assert_streq("", request_query_param(req, "empty"));
+    assert_streq("", request_query_param(req, "flag"));
+    // names are matched decoded, and exactly
+    assert_streq("c=d", request_query_param(req, "a&b"));
+    assert(request_query_param(req, "Page") == NULL);
+    assert(request_query_param(req, "pag") == NULL);
+    assert(request_query_param(req, "bad") == NULL);
+
+    size_t count = 0;
+    query_param_t *params = request_query_params(req, &count);
+    const char *expected[][2] = {
+        {"q", "cat pics"}, {"page", "2"}, {"empty", ""}, {"flag", ""}, {"a&b", "c=d"}, {"q", "dog"},
+    };
+    assert(count == 6);
+    for (size_t i = 0; i < count; i++) {
+        assert_streq(expected[i][0], params[i].name);
+        assert_streq(expected[i][1], params[i].value);
+    }
+    request_free(req);
+
+    // raw views, with empty parameters skipped
+    query_iter_t iter;
+    query_iter_init(&iter, "&a=1&&b=&c&");
+    str_view_t name, value;
+    assert(query_iter_next(&iter, &name, &value));
+    assert(view_eq(name, "a") && view_eq(value, "1"));
+    assert(query_iter_next(&iter, &name, &value));
+    assert(view_eq(name, "b") && view_eq(value, ""));
+    assert(query_iter_next(&iter, &name, &value));
+    assert(view_eq(name, "c") && view_eq(value, ""));
+    assert(!query_iter_next(&iter, &name, &value));
+    assert(!query_iter_next(&iter, &name, &value));
+    query_iter_init(&iter, NULL);
+    assert(!query_iter_next(&iter, &name, &value));
+}
+
+parse_status_t feed_in_steps(request_parser_t *parser, const char *header, size_t step) {
+    size_t len = strlen(header);
+    parse_status_t status = PARSE_INCOMPLETE;
+    for (size_t fed = 0; status == PARSE_INCOMPLETE && fed < len;) {
+        fed = fed + step < len ? fed + step : len;
+        status = request_parser_feed(parser, header, fed);
+    }
+    return status;
+}
+
+void test_parser_partial() {
+    const char *header = "POST /upload?x=1 HTTP/1.1\r\n"
+                         "Host: localhost\r\n"
+                         "Content-Length:5\r\n"
+                         "X-Empty:\r\n"
+                         "X-Spaces: \t padded value \t\r\n"
+                         "\r\n"
+                         "hello";
+    size_t header_len = strlen(header) - strlen("hello");
+    for (size_t step = 1; step <= strlen(header); step++) {
+        request_parser_t parser;
+        request_parser_init(&parser);
+        assert(feed_in_steps(&parser, header, step) == PARSE_COMPLETE);
+        // the body after the header is left alone
+        assert(request_parser_length(&parser) == header_len);
+
+        request_view_t view;
+        request_parser_view(&parser, header, &view);
+        assert(view.method.len == 4 && strncmp(view.method.ptr, "POST", 4) == 0);
+        // the query is split off the path, however the two were split up
+        assert(view.path.len == 7 && strncmp(view.path.ptr, "/upload", 7) == 0);
+        assert(view.query.len == 3 && strncmp(view.query.ptr, "x=1", 3) == 0);
+        assert(view.http_version.len == 8 && strncmp(view.http_version.ptr, "HTTP/1.1", 8) == 0);
+        assert(view.num_headers == 4);
+        assert(request_view_header(&view, "content-length")->len == 1);
+        assert(request_view_header(&view, "X-Empty")->len == 0);
+        const str_view_t *padded = request_view_header(&view, "X-Spaces");
+        assert(padded->len == 12 && strncmp(padded->ptr, "padded value", 12) == 0);
+        request_view_free(&view);
+        request_parser_free(&parser);
+    }
+}
+
+void test_parser_incomplete() {
+    const char *prefixes[] = {
+        "",
+        "GET",
+        "GET / HTTP/1.1",
+        "GET / HTTP/1.1\r",
+        "GET / HTTP/1.1\r\nHost: x",
+        "GET / HTTP/1.1\r\nHost: x\r\n",
+        "GET / HTTP/1.1\r\nHost: x\r\n\r",
+    };
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        request_parser_t parser;
+        request_parser_init(&parser);
+        assert(request_parser_feed(&parser, prefixes[i], strlen(prefixes[i])) == PARSE_INCOMPLETE);
+        request_parser_free(&parser);
+    }
+}
+
+void test_parser_moved_buffer() {
+    // the buffer may move between reads, e.g., when it grows
+    const char *header = "GET /moved HTTP/1.0\nA: 1\nB: 2\n\n";
+    size_t len = strlen(header);
+    request_parser_t parser;
+    request_parser_init(&parser);
+    char *first = strndup(header, 10);
+    assert(request_parser_feed(&parser, first, 10) == PARSE_INCOMPLETE);
+    free(first);
+    char *second = strdup(header);
+    assert(request_parser_feed(&parser, second, len) == PARSE_COMPLETE);
+    assert(request_parser_length(&parser) == len);
+    request_view_t view;
+    request_parser_view(&parser, second, &view);
+    assert(view.path.len == 6 && strncmp(view.path.ptr, "/moved", 6) == 0);
+    assert(view.num_headers == 2);
+    assert(request_view_header(&view, "B")->ptr[0] == '2');
+    request_view_free(&view);
+    request_parser_free(&parser);
+    free(second);
+}
+
+void test_parser_many_headers() {
+    // more headers than the parser or a view hold inline
+    const size_t num_headers = 100;
+    char *header = malloc(num_headers * 32 + 64);
+    size_t len = sprintf(header, "GET / HTTP/1.1\r\n");
+    for (size_t i = 0; i < num_headers; i++) {
+        len += sprintf(header + len, "Header-%zu: %zu\r\n", i, i * i);
+    }
+    len += sprintf(header + len, "\r\n");
+    request_parser_t parser;
+    request_parser_init(&parser);
+    assert(feed_in_steps(&parser, header, 7) == PARSE_COMPLETE);
+    assert(request_parser_length(&parser) == len);
+    request_view_t view;
+    request_parser_view(&parser, header, &view);
+    assert(view.num_headers == num_headers);
+    for (size_t i = 0; i < num_headers; i++) {
+        char name[32], value[32];
+        sprintf(name, "header-%zu", i);
+        sprintf(value, "%zu", i * i);
+        const str_view_t *found = request_view_header(&view, name);
+        assert(found->len == strlen(value) && strncmp(found->ptr, value, found->len) == 0);
+    }
+    request_view_free(&view);
+    request_parser_free(&parser);
+    free(header);
+}
+
+void test_parser_invalid() {
+    const char *invalid[] = {
+        "\r\n\r\n",
+        "GET\r\n\r\n",
+        "GET /\r\n\r\n",
+        "GET / \r\n\r\n",
+        " / HTTP/1.1\r\n\r\n",
+        "GET  HTTP/1.1\r\n\r\n",
+        "GET / HTTP/1.1 extra\r\n\r\n",
+        "GET / HTTP/1.1\rX\n\r\n",
+        "GET / HTTP/1.1\r\nno colon\r\n\r\n",
+        "GET / HTTP/1.1\r\n: no name\r\n\r\n",
+        "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost : x\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost: x\r\n folded\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost: a\x01z\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost: a\rz\r\n\r\n",
+        "GET /\x7f HTTP/1.1\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost: x\r\n\rX",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        for (size_t step = 1; step <= strlen(invalid[i]); step++) {
+            request_parser_t parser;
+            request_parser_init(&parser);
+            assert(feed_in_steps(&parser, invalid[i], step) == PARSE_ERROR);
+            assert(parser.error == HTTP_BAD_REQUEST);
+            request_parser_free(&parser);
+        }
+        request_view_t view;
+        assert(!request_view_parse(invalid[i], strlen(invalid[i]), &view));
+        request_view_free(&view);
+    }
+
+    // garbage is rejected as soon as it arrives, not once a header would end
+    request_parser_t parser;
+    request_parser_init(&parser);
+    assert(request_parser_feed(&parser, "GET / HTTP/1.1\r\nHost\x01", 21) == PARSE_ERROR);
+    request_parser_free(&parser);
+}
+
 void test_parse() {}
 
 void test_response_status() {
@@ -200,33 +638,33 @@ void test_response_status() {
 
 void test_response_headers() {
     char *resp1 = response_format(HTTP_OK, "");
-    char exp_resp1[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 0\r\n\r\n";
+    char exp_resp1[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n" DATE_HEADERS "Content-Length: 0\r\n\r\n";
     assert_streq(resp1, exp_resp1);
     free(resp1);
     char *resp2 = response_format(HTTP_BAD_REQUEST, "");
-    char exp_resp2[] = "HTTP/1.1 400 Bad Request\r\nContent-Type: text/html\r\nContent-Length: 0\r\n\r\n";
+    char exp_resp2[] = "HTTP/1.1 400 Bad Request\r\nContent-Type: text/html\r\n" DATE_HEADERS "Content-Length: 0\r\n\r\n";
     assert_streq(resp2, exp_resp2);
     free(resp2);
     char *resp3 = response_format(HTTP_FORBIDDEN, "");
-    char exp_resp3[] = "HTTP/1.1 403 Forbidden\r\nContent-Type: text/html\r\nContent-Length: 0\r\n\r\n";
+    char exp_resp3[] = "HTTP/1.1 403 Forbidden\r\nContent-Type: text/html\r\n" DATE_HEADERS "Content-Length: 0\r\n\r\n";
     assert_streq(resp3, exp_resp3);
     free(resp3);
     char *resp4 = response_format(HTTP_NOT_FOUND, "");
-    char exp_resp4[] = "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\nContent-Length: 0\r\n\r\n";
+    char exp_resp4[] = "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\n" DATE_HEADERS "Content-Length: 0\r\n\r\n";
     assert_streq(resp4, exp_resp4);
     free(resp4);
 }
 
 void test_response_null() {
     char *resp = response_format(HTTP_OK, NULL);
-    char exp_resp[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 0\r\n\r\n";
+    char exp_resp[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n" DATE_HEADERS "Content-Length: 0\r\n\r\n";
     assert_streq(resp, exp_resp);
     free(resp);
 }
 
 void test_response_body() {
     char *resp = response_format(HTTP_OK, "Hello, world!");
-    char exp_resp[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 13\r\n\r\nHello, world!";
+    char exp_resp[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n" DATE_HEADERS "Content-Length: 13\r\n\r\nHello, world!";
     assert_streq(resp, exp_resp);
     free(resp);
 }
@@ -236,7 +674,7 @@ void test_response_long_body() {
     char *body = malloc(BODY_LEN + 1);
     body[BODY_LEN] = 0;
     memset(body, 'a', BODY_LEN);
-    const char EXP_RESP_PREFIX[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 100000\r\n\r\n";
+    const char EXP_RESP_PREFIX[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n" DATE_HEADERS "Content-Length: 100000\r\n\r\n";
     const size_t EXP_RESP_LEN = BODY_LEN + sizeof(EXP_RESP_PREFIX) - 1;
     char *exp_resp = malloc(EXP_RESP_LEN + 1);
     strcpy(exp_resp, EXP_RESP_PREFIX);
@@ -259,6 +697,541 @@ void test_response_invalid_status() {
     assert(test_assert_fail(invalid_status, NULL));
 }
 
+void test_response_every_type() {
+    const struct { response_code_t code; const char *status; } statuses[] = {
+        {HTTP_OK, "200 OK"},
+        {HTTP_BAD_REQUEST, "400 Bad Request"},
+        {HTTP_FORBIDDEN, "403 Forbidden"},
+        {HTTP_NOT_FOUND, "404 Not Found"},
+        {HTTP_PAYLOAD_TOO_LARGE, "413 Payload Too Large"},
+        {HTTP_HEADER_FIELDS_TOO_LARGE, "431 Request Header Fields Too Large"},
+    };
+    const struct { mime_type_t type; const char *name; } types[] = {
+        {MIME_PLAIN, "text/plain"},
+        {MIME_HTML, "text/html"},
+        {MIME_JS, "text/javascript"},
+        {MIME_JSON, "text/json"},
+        {MIME_WASM, "application/wasm"},
+        {MIME_PNG, "image/png"},
+        {MIME_OCTET_STREAM, "application/octet-stream"},
+    };
+    const size_t lengths[] = {0, 9, 10, 99, 100, 65536, 1234567890123};
+    char exp_header[256];
+    for (size_t s = 0; s < sizeof(statuses) / sizeof(statuses[0]); s++) {
+        for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+            for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+                snprintf(exp_header, sizeof(exp_header), "HTTP/1.1 %s\r\nContent-Type: %s\r\n" DATE_HEADERS "Content-Length: %zu\r\n\r\n",
+                         statuses[s].status, types[t].name, lengths[l]);
+                bytes_t *body = bytes_init_arena(NULL, lengths[l], NULL);
+                bytes_t *resp = response_type_format_iov(statuses[s].code, types[t].type, body);
+                assert(resp->len == strlen(exp_header));
+                assert_streq(resp->data, exp_header);
+                bytes_free(resp);
+            }
+        }
+    }
+}
+
+/**
+ * Returns the Date header line of a response formatted on this thread.
+ */
+static char *format_date_line(void) {
+    bytes_t *resp = response_type_format_iov(HTTP_OK, MIME_PLAIN, NULL);
+    char *start = strstr(resp->data, "Date: ");
+    assert(start != NULL);
+    char *line = strndup(start, strstr(start, "\r\n") - start);
+    bytes_free(resp);
+    return line;
+}
+
+static void *format_unpinned_date(void *aux) {
+    (void) aux;
+    return format_date_line();
+}
+
+void test_response_date() {
+    response_date_refresh(0);
+    char *line = format_date_line();
+    assert_streq(line, "Date: Thu, 01 Jan 1970 00:00:00 GMT");
+    free(line);
+    // a leap day, and the last second before the year 2038 problem
+    response_date_refresh(951782400);
+    line = format_date_line();
+    assert_streq(line, "Date: Tue, 29 Feb 2000 00:00:00 GMT");
+    free(line);
+    response_date_refresh(2147483647);
+    line = format_date_line();
+    assert_streq(line, "Date: Tue, 19 Jan 2038 03:14:07 GMT");
+    free(line);
+    response_date_refresh(PINNED_DATE);
+
+    // a thread which is never refreshed reads the clock instead, and isn't
+    // affected by this one's pinned date
+    char before[64], after[64];
+    time_t now = time(NULL);
+    strftime(before, sizeof(before), "Date: %a, %d %b %Y %H:%M:%S GMT", gmtime(&now));
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, format_unpinned_date, NULL) == 0);
+    pthread_join(thread, (void **) &line);
+    now = time(NULL);
+    strftime(after, sizeof(after), "Date: %a, %d %b %Y %H:%M:%S GMT", gmtime(&now));
+    assert(strcmp(line, before) == 0 || strcmp(line, after) == 0);
+    free(line);
+    line = format_date_line();
+    assert_streq(line, "Date: Sun, 06 Nov 1994 08:49:37 GMT");
+    free(line);
+}
+
+void invalid_type(void *aux) {
+    (void) aux;
+    bytes_t *resp = response_type_format_iov(HTTP_OK, (mime_type_t) 99, NULL);
+    bytes_free(resp);
+}
+
+void test_response_invalid_type() {
+    assert(test_assert_fail(invalid_type, NULL));
+}
+
+void test_response_iov() {
+    char *data = strdup("Hello, world!");
+    bytes_t *body = bytes_init(strlen(data), data);
+    bytes_t *resp = response_type_format_iov(HTTP_OK, MIME_HTML, body);
+    char exp_header[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n" DATE_HEADERS "Content-Length: 13\r\n\r\n";
+    assert(resp->len == strlen(exp_header));
+    assert(strncmp(resp->data, exp_header, resp->len) == 0);
+    // the body is linked after the header rather than copied
+    assert(resp->next == body);
+    assert(resp->next->data == data);
+    bytes_free(resp);
+}
+
+void test_response_iov_null() {
+    bytes_t *resp = response_type_format_iov(HTTP_NOT_FOUND, MIME_PLAIN, NULL);
+    assert_streq(resp->data, "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\n" DATE_HEADERS "Content-Length: 0\r\n\r\n");
+    assert(resp->next == NULL);
+    bytes_free(resp);
+}
+
+void test_response_iov_file() {
+    int fd = open("/dev/null", O_RDONLY);
+    assert(fd >= 0);
+    bytes_t *body = bytes_init_file(fd, 7, 1234);
+    assert(body->fd == fd);
+    assert(body->offset == 7);
+    assert(body->data == NULL);
+    bytes_t *resp = response_type_format_iov(HTTP_OK, MIME_WASM, body);
+    char exp_header[] = "HTTP/1.1 200 OK\r\nContent-Type: application/wasm\r\n" DATE_HEADERS "Content-Length: 1234\r\n\r\n";
+    assert(resp->len == strlen(exp_header));
+    assert(strncmp(resp->data, exp_header, resp->len) == 0);
+    assert(resp->fd == -1);
+    assert(resp->next == body);
+    bytes_free(resp);
+    // the file is closed along with the response
+    assert(fcntl(fd, F_GETFD) == -1);
+}
+
+char *read_body(request_body_t *body, size_t read_size) {
+    char *data = malloc(request_body_length(body) + 1);
+    size_t len = 0;
+    ssize_t tried_read = 0;
+    while ((tried_read = request_body_read(body, data + len, read_size)) > 0) {
+        len += tried_read;
+    }
+    assert(tried_read == 0);
+    assert(len == request_body_length(body));
+    data[len] = '\0';
+    return data;
+}
+
+void test_body_content_length() {
+    request_body_t *body = request_body_init(false, 5, 100, 100);
+    const char *data = "helloGET / HTTP/1.1";
+    size_t consumed = 0;
+    assert(request_body_feed(body, data, 3, &consumed) == BODY_INCOMPLETE);
+    assert(consumed == 3);
+    // stops at the end of the body, leaving the next request alone
+    assert(request_body_feed(body, data + 3, strlen(data) - 3, &consumed) == BODY_COMPLETE);
+    assert(consumed == 2);
+    assert(!request_body_spilled(body));
+    char *read = read_body(body, 2);
+    assert_streq(read, "hello");
+    free(read);
+    request_body_free(body);
+}
+
+void test_body_chunked() {
+    const char *data = "5;name=value\r\nhello\r\n7\r\n, world\r\n0\r\nTrailer: x\r\n\r\nnext";
+    size_t data_len = strlen(data) - strlen("next");
+    // feeding the body in pieces of every size gives the same result
+    for (size_t step = 1; step <= strlen(data); step++) {
+        request_body_t *body = request_body_init(true, 0, 100, 100);
+        size_t fed = 0;
+        body_status_t status = BODY_INCOMPLETE;
+        while (status == BODY_INCOMPLETE) {
+            size_t len = fed + step < strlen(data) ? step : strlen(data) - fed;
+            size_t consumed = 0;
+            status = request_body_feed(body, data + fed, len, &consumed);
+            fed += consumed;
+        }
+        assert(status == BODY_COMPLETE);
+        assert(fed == data_len);
+        char *read = read_body(body, 3);
+        assert_streq(read, "hello, world");
+        free(read);
+        request_body_free(body);
+    }
+}
+
+void test_body_chunked_invalid() {
+    const char *bad[] = {"zz\r\n", "\r\n", "5\r\nhelloXX", "5\rhello", "0\r\n\rX"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        request_body_t *body = request_body_init(true, 0, 100, 100);
+        size_t consumed = 0;
+        assert(request_body_feed(body, bad[i], strlen(bad[i]), &consumed) == BODY_INVALID);
+        request_body_free(body);
+    }
+}
+
+void test_body_too_large() {
+    size_t consumed = 0;
+    request_body_t *body = request_body_init(false, 11, 10, 100);
+    assert(request_body_feed(body, "hello world", 11, &consumed) == BODY_TOO_LARGE);
+    request_body_free(body);
+
+    // chunked bodies are caught as soon as a chunk size goes over
+    body = request_body_init(true, 0, 10, 100);
+    assert(request_body_feed(body, "6\r\nhello \r\n5\r\n", 16, &consumed) == BODY_TOO_LARGE);
+    request_body_free(body);
+    body = request_body_init(true, 0, 10, 100);
+    assert(request_body_feed(body, "fffffffffffffffffffff", 21, &consumed) == BODY_TOO_LARGE);
+    request_body_free(body);
+
+    // so are endless chunk extensions and trailers, which aren't stored
+    size_t len = 100000;
+    char *data = malloc(len);
+    memset(data, 'x', len);
+    memcpy(data, "1;", 2);
+    body = request_body_init(true, 0, 10, 100);
+    assert(request_body_feed(body, data, len, &consumed) == BODY_TOO_LARGE);
+    assert(consumed < len);
+    request_body_free(body);
+    memset(data, '\n', len);
+    memcpy(data, "0\r\n", 3);
+    body = request_body_init(true, 0, 10, 100);
+    assert(request_body_feed(body, data, len, &consumed) == BODY_TOO_LARGE);
+    assert(consumed < len);
+    request_body_free(body);
+    free(data);
+}
+
+void test_body_spill() {
+    size_t len = 100000;
+    char *data = malloc(len);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = 'a' + i % 26;
+    }
+    request_body_t *body = request_body_init(false, len, len, 1000);
+    size_t consumed = 0;
+    assert(request_body_feed(body, data, 500, &consumed) == BODY_INCOMPLETE);
+    assert(!request_body_spilled(body));
+    assert(request_body_feed(body, data + 500, len - 500, &consumed) == BODY_COMPLETE);
+    assert(request_body_spilled(body));
+    char *read = read_body(body, 4096);
+    assert(memcmp(read, data, len) == 0);
+    free(read);
+    free(data);
+    request_body_free(body);
+}
+
+void test_request_body_freed() {
+    request_t *req = request_init("POST", "/upload", "HTTP/1.1");
+    assert(req->body == NULL);
+    req->body = request_body_init(false, 3, 10, 10);
+    size_t consumed = 0;
+    assert(request_body_feed(req->body, "abc", 3, &consumed) == BODY_COMPLETE);
+    request_free(req);
+}
+
+typedef struct {
+    size_t calls;
+    bool *freed;
+} stream_state_t;
+
+bool stream_producer(response_stream_t *stream, void *state) {
+    stream_state_t *st = state;
+    st->calls++;
+    if (st->calls == 1) {
+        response_stream_write(stream, "hello", 5);
+        response_stream_write(stream, ", ", 2);
+    } else if (st->calls == 2) {
+        // empty writes would end a chunked body, so they are skipped
+        response_stream_write(stream, "", 0);
+    } else {
+        char big[300];
+        memset(big, 'x', sizeof(big));
+        response_stream_write(stream, big, sizeof(big));
+    }
+    return st->calls < 3;
+}
+
+void stream_state_free(void *state) {
+    stream_state_t *st = state;
+    *st->freed = true;
+    free(st);
+}
+
+char *stream_collect(bytes_t *resp, bool chunked) {
+    bytes_t *header = response_stream_header(resp->stream, chunked);
+    size_t len = header->len;
+    char *out = malloc(len + 1);
+    memcpy(out, header->data, len);
+    bytes_free(header);
+    bool done = false;
+    while (!done) {
+        bytes_t *piece = response_stream_next(resp->stream, &done);
+        out = realloc(out, len + piece->len + 1);
+        // an empty piece has no data to copy
+        if (piece->len > 0) {
+            memcpy(out + len, piece->data, piece->len);
+        }
+        len += piece->len;
+        bytes_free(piece);
+    }
+    out[len] = '\0';
+    return out;
+}
+
+/**
+ * Copies the segments of a serialized response into one string, for
+ * comparison (file-backed segments become their length in brackets).
+ */
+char *response_flatten(bytes_t *resp) {
+    size_t len = 0;
+    for (bytes_t *segment = resp; segment != NULL; segment = segment->next) {
+        len += segment->fd >= 0 ? 32 : segment->len;
+    }
+    char *flat = calloc(len + 1, 1);
+    assert(flat);
+    char *end = flat;
+    for (bytes_t *segment = resp; segment != NULL; segment = segment->next) {
+        if (segment->fd >= 0) {
+            end += sprintf(end, "[%zu]", segment->len);
+        } else {
+            memcpy(end, segment->data, segment->len);
+            end += segment->len;
+        }
+    }
+    return flat;
+}
+
+void test_response_builder() {
+    const char *greeting = "Hello, ";
+    response_t *resp = response_init(NULL, HTTP_OK, MIME_PLAIN);
+    assert(response_add_header(resp, "Cache-Control", "max-age=60"));
+    assert(response_add_header(resp, "X-Empty", ""));
+    response_add_body_borrowed(resp, greeting, strlen(greeting));
+    char name[] = "world";
+    response_add_body_copy(resp, name, strlen(name));
+    response_add_body(resp, bytes_init(1, strdup("!")));
+    assert(response_body_length(resp) == 13);
+
+    bytes_t *finished = response_finish(resp);
+    assert(finished->len == 0 && finished->response == resp);
+    // the copy is the response's, not the caller's
+    name[0] = 'W';
+    // headers can still be added until it is serialized
+    assert(response_add_header(finished->response, "Connection", "close"));
+    bytes_t *serialized = response_serialize(finished);
+    assert(serialized->response == NULL);
+    // the borrowed body is sent as is, not copied
+    assert(serialized->next->data == greeting);
+    assert(serialized->next->kind == BYTES_BORROWED);
+    char *flat = response_flatten(serialized);
+    assert_streq(flat,
+                 "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: text/plain\r\n" DATE_HEADERS
+                 "Content-Length: 13\r\n"
+                 "Cache-Control: max-age=60\r\n"
+                 "X-Empty: \r\n"
+                 "Connection: close\r\n"
+                 "\r\n"
+                 "Hello, world!");
+    free(flat);
+    bytes_free(serialized);
+}
+
+void test_response_builder_arena() {
+    arena_t *arena = arena_init(ARENA_DEFAULT_CHUNK_SIZE);
+    int fd = open("/dev/null", O_RDONLY);
+    assert(fd >= 0);
+    response_t *resp = response_init(arena, HTTP_NOT_FOUND, MIME_HTML);
+    response_add_body_copy(resp, "<p>", 3);
+    response_add_body_file(resp, fd, 10, 1000);
+    response_add_body_borrowed(resp, "</p>", 4);
+    bytes_t *serialized = response_serialize(response_finish(resp));
+    assert(serialized->arena == arena);
+    char *flat = response_flatten(serialized);
+    assert_streq(flat, "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\n" DATE_HEADERS "Content-Length: 1007\r\n\r\n<p>[1000]</p>");
+    free(flat);
+    assert(serialized->next->next->kind == BYTES_FILE);
+    assert(serialized->next->next->offset == 10);
+    bytes_free(serialized);
+    // the file is closed along with the response, and the rest goes with the
+    // arena
+    assert(fcntl(fd, F_GETFD) == -1);
+    arena_free(arena);
+}
+
+void test_response_builder_empty() {
+    bytes_t *serialized = response_serialize(response_finish(response_init(NULL, HTTP_BAD_REQUEST, MIME_PLAIN)));
+    assert(serialized->next == NULL);
+    assert_streq(serialized->data, "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\n" DATE_HEADERS "Content-Length: 0\r\n\r\n");
+    bytes_free(serialized);
+}
+
+void test_response_builder_invalid_header() {
+    response_t *resp = response_init(NULL, HTTP_OK, MIME_PLAIN);
+    assert(!response_add_header(resp, "", "x"));
+    assert(!response_add_header(resp, "Bad Name", "x"));
+    assert(!response_add_header(resp, "Bad:Name", "x"));
+    assert(!response_add_header(resp, "X-Split", "a\r\nSet-Cookie: evil=1"));
+    assert(!response_add_header(resp, "X-Split", "a\nb"));
+    bytes_t *serialized = response_serialize(response_finish(resp));
+    assert_streq(serialized->data, "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n" DATE_HEADERS "Content-Length: 0\r\n\r\n");
+    bytes_free(serialized);
+}
+
+void test_response_builder_unsent() {
+    // a response that is never sent is freed along with its bytes, body and
+    // all
+    response_t *resp = response_init(NULL, HTTP_OK, MIME_PLAIN);
+    response_add_header(resp, "X-Unsent", "1");
+    response_add_body(resp, bytes_init(3, strdup("abc")));
+    bytes_free(response_finish(resp));
+    resp = response_init(NULL, HTTP_OK, MIME_PLAIN);
+    response_add_body_copy(resp, "abc", 3);
+    response_free(resp);
+}
+
+void test_response_serialize_formatted() {
+    // responses which are already formatted are sent as they are
+    bytes_t *resp = response_type_format_iov(HTTP_OK, MIME_PLAIN, NULL);
+    assert(response_serialize(resp) == resp);
+    bytes_free(resp);
+}
+
+void count_release(void *aux) {
+    (*(int *) aux)++;
+}
+
+void test_bytes_shared() {
+    int releases = 0;
+    const char *shared = "shared";
+    response_t *resp = response_init(NULL, HTTP_OK, MIME_PLAIN);
+    response_add_body(resp, bytes_init_shared(NULL, 6, shared, NULL, count_release, &releases));
+    response_add_body(resp, bytes_init_shared(NULL, 6, shared, NULL, count_release, &releases));
+    bytes_t *serialized = response_serialize(response_finish(resp));
+    assert(serialized->next->data == shared && serialized->next->next->data == shared);
+    assert(releases == 0);
+    bytes_free(serialized);
+    assert(releases == 2);
+}
+
+void test_response_body_buffer() {
+    buffer_t *cached = buffer_copy("cached body", 11);
+    // one buffer serves several responses at once, each with a reference
+    bytes_t *serialized[3];
+    for (size_t i = 0; i < 3; i++) {
+        response_t *resp = response_init(NULL, HTTP_OK, MIME_PLAIN);
+        response_add_body_buffer(resp, cached);
+        serialized[i] = response_serialize(response_finish(resp));
+        assert(serialized[i]->next->data == buffer_data(cached));
+        assert(serialized[i]->next->kind == BYTES_SHARED);
+        assert(serialized[i]->next->retain != NULL);
+    }
+    // the cache lets go of the buffer while the responses are in flight
+    buffer_release(cached);
+    for (size_t i = 0; i < 3; i++) {
+        char *flat = response_flatten(serialized[i]);
+        assert_streq(flat, "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n" DATE_HEADERS "Content-Length: 11\r\n\r\ncached body");
+        free(flat);
+        bytes_free(serialized[i]);
+    }
+}
+
+void test_bytes_borrowed() {
+    // a borrowed literal on the heap is never freed
+    bytes_t *borrowed = bytes_init_borrowed(NULL, 5, "hello");
+    assert(borrowed->kind == BYTES_BORROWED && borrowed->arena == NULL);
+    bytes_free(borrowed);
+    // bytes made the old ways keep their meaning
+    bytes_t *owned = bytes_init(5, strdup("hello"));
+    assert(owned->kind == BYTES_OWNED);
+    bytes_free(owned);
+    arena_t *arena = arena_init(ARENA_DEFAULT_CHUNK_SIZE);
+    assert(bytes_init_arena(arena, 5, "hello")->kind == BYTES_BORROWED);
+    arena_free(arena);
+}
+
+void test_response_stream() {
+    char big[301];
+    memset(big, 'x', 300);
+    big[300] = '\0';
+    for (int chunked = 0; chunked <= 1; chunked++) {
+        bool freed = false;
+        stream_state_t *state = calloc(1, sizeof(stream_state_t));
+        state->freed = &freed;
+        bytes_t *resp = response_type_format_stream(HTTP_OK, MIME_PLAIN, stream_producer, state, stream_state_free);
+        assert(resp->stream != NULL);
+        assert(resp->len == 0);
+        char *out = stream_collect(resp, chunked);
+        char *expected = malloc(1024);
+        if (chunked) {
+            snprintf(expected, 1024,
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/plain\r\n" DATE_HEADERS
+                "Transfer-Encoding: chunked\r\n"
+                "\r\n"
+                "5\r\nhello\r\n"
+                "2\r\n, \r\n"
+                "12c\r\n%s\r\n"
+                "0\r\n\r\n", big);
+        } else {
+            snprintf(expected, 1024,
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/plain\r\n" DATE_HEADERS
+                "Connection: close\r\n"
+                "\r\n"
+                "hello, %s", big);
+        }
+        assert_streq(out, expected);
+        assert(state->calls == 3);
+        assert(!freed);
+        bytes_free(resp);
+        assert(freed);
+        free(out);
+        free(expected);
+    }
+}
+
+void test_response_stream_unfinished() {
+    // a stream abandoned part way (e.g., the client hung up) still frees its
+    // state
+    bool freed = false;
+    stream_state_t *state = calloc(1, sizeof(stream_state_t));
+    state->freed = &freed;
+    bytes_t *resp = response_type_format_stream(HTTP_NOT_FOUND, MIME_HTML, stream_producer, state, stream_state_free);
+    bytes_t *header = response_stream_header(resp->stream, true);
+    bool done = false;
+    bytes_t *piece = response_stream_next(resp->stream, &done);
+    assert(!done);
+    assert(piece->len == strlen("5\r\nhello\r\n2\r\n, \r\n"));
+    bytes_free(piece);
+    bytes_free(header);
+    bytes_free(resp);
+    assert(freed);
+}
+
 void test_response() {}
 
 // TODO: Test parsing more rigorously
@@ -267,6 +1240,7 @@ int main(int argc, char *argv[]) {
     // Run all tests? True if there are no command-line arguments
     bool all_tests = argc == 1;
     char **testnames = argv + 1;
+    response_date_refresh(PINNED_DATE);
 
     DO_TEST(test_init_simple)
     DO_TEST(test_init_copy)
@@ -276,6 +1250,22 @@ int main(int argc, char *argv[]) {
     DO_TEST(test_parse_no_headers)
     DO_TEST(test_parse_many_headers)
     DO_TEST(test_parse_long_prefix)
+    DO_TEST(test_view_parse)
+    DO_TEST(test_view_parse_line_endings)
+    DO_TEST(test_view_parse_many_headers)
+    DO_TEST(test_view_parse_invalid)
+    DO_TEST(test_request_from_view)
+    DO_TEST(test_request_from_view_arena)
+    DO_TEST(test_request_header)
+    DO_TEST(test_parse_query)
+    DO_TEST(test_url_decode)
+    DO_TEST(test_request_path)
+    DO_TEST(test_query_params)
+    DO_TEST(test_parser_partial)
+    DO_TEST(test_parser_incomplete)
+    DO_TEST(test_parser_moved_buffer)
+    DO_TEST(test_parser_many_headers)
+    DO_TEST(test_parser_invalid)
     DO_TEST(test_parse)
     DO_TEST(test_response_status)
     DO_TEST(test_response_headers)
@@ -283,6 +1273,29 @@ int main(int argc, char *argv[]) {
     DO_TEST(test_response_body)
     DO_TEST(test_response_long_body)
     DO_TEST(test_response_invalid_status)
+    DO_TEST(test_response_every_type)
+    DO_TEST(test_response_invalid_type)
+    DO_TEST(test_response_date)
+    DO_TEST(test_response_iov)
+    DO_TEST(test_response_iov_null)
+    DO_TEST(test_response_iov_file)
+    DO_TEST(test_response_builder)
+    DO_TEST(test_response_builder_arena)
+    DO_TEST(test_response_builder_empty)
+    DO_TEST(test_response_builder_invalid_header)
+    DO_TEST(test_response_builder_unsent)
+    DO_TEST(test_response_serialize_formatted)
+    DO_TEST(test_bytes_shared)
+    DO_TEST(test_bytes_borrowed)
+    DO_TEST(test_response_body_buffer)
+    DO_TEST(test_body_content_length)
+    DO_TEST(test_body_chunked)
+    DO_TEST(test_body_chunked_invalid)
+    DO_TEST(test_body_too_large)
+    DO_TEST(test_body_spill)
+    DO_TEST(test_request_body_freed)
+    DO_TEST(test_response_stream)
+    DO_TEST(test_response_stream_unfinished)
     DO_TEST(test_response)
     puts("test_http PASS");
 
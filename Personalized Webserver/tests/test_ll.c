@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdio.h>
 #include "test_util.h"
 #include "ll.h"
 
@@ -252,6 +253,7 @@ void test_ll_large() {
     strarray_t *exp = malloc(sizeof(strarray_t));
     exp->data = expected;
     exp->length = LARGE_SIZE;
+    exp->contiguous = false;
     strarray_free(exp);
 
     strarray_free(keys);
@@ -294,6 +296,26 @@ void test_ll_empty() {
     ll_free(headers);
 }
 
+void test_ll_arena() {
+    arena_t *arena = arena_init(256);
+    ll_map_t *headers = ll_init_arena(arena);
+    for (size_t i = 0; i < 100; i++) {
+        char key[16];
+        int len = snprintf(key, sizeof(key), "key%zu", i % 10);
+        char *value = arena_strndup(arena, key, len);
+        char *old = ll_put(headers, arena_strndup(arena, key, len), value);
+        // the old value is the arena's, and isn't freed
+        assert(i < 10 ? old == NULL : strcmp(old, key) == 0);
+    }
+    assert_streq("key3", ll_get(headers, "key3"));
+    assert(ll_get(headers, "key10") == NULL);
+    strarray_t *keys = ll_get_keys(headers);
+    assert(keys->length == 10);
+    strarray_free(keys);
+    ll_free(headers);
+    arena_free(arena);
+}
+
 // void test_ll_null_input() {
 //     header_ll_t *headers = ll_init();
 //     ll_put_lit(headers, "key", NULL);
@@ -319,6 +341,7 @@ int main(int argc, char *argv[]) {
     DO_TEST(test_ll_large)
     DO_TEST(test_ll_singleton)
     DO_TEST(test_ll_empty)
+    DO_TEST(test_ll_arena)
     // DO_TEST(test_ll_null_input)
     puts("test_ll PASS");
 }
@@ -85,6 +85,20 @@ void test_register_one() {
     router_free(r);
 }
 
+void test_dispatch_decoded_path() {
+    // routes match the decoded path, without the query
+    router_t *r = router_init(1, hello_world_handler);
+    router_register(r, "/cat", cat_handler);
+    const char *paths[] = {"/cat?x=1", "/c%61t", "/%63at?", "/cat%3F", "/cat%zz"};
+    const char *expected[] = {"Cat", "Cat", "Cat", "Hello, world!", "Hello, world!"};
+    for (size_t i = 0; i < 5; i++) {
+        bytes_t *response = router_dispatch(r, request_init("GET", paths[i], "HTTP/1.1"));
+        assert_streq(response->data, expected[i]);
+        bytes_free(response);
+    }
+    router_free(r);
+}
+
 void test_register_several() {
     router_t *r = router_init(3, hello_world_handler);
     router_register(r, "cat", cat_handler);
@@ -133,6 +147,53 @@ void test_register_max() {
     router_free(r);
 }
 
+void test_copy() {
+    router_t *r = router_init(2, hello_world_handler);
+    router_register(r, "cat", cat_handler);
+    router_t *copy = router_copy(r);
+    // the copy is independent of the original
+    router_register(r, "cat", puppy_handler);
+    router_free(r);
+    test_router_t *tr = (test_router_t *) copy;
+    assert(tr->fallback == hello_world_handler);
+    assert(tr->max_routes == 2);
+    assert(tr->num_routes == 1);
+    request_t *request = request_init("A", "C", "B");
+    request_t *cat_request = request_init("A", "cat", "B");
+    bytes_t *response = router_dispatch(copy, request);
+    bytes_t *cat_response = router_dispatch(copy, cat_request);
+    assert_streq(response->data, "Hello, world!");
+    assert_streq(cat_response->data, "Cat");
+    bytes_free(response);
+    bytes_free(cat_response);
+    router_free(copy);
+}
+
+void test_max_body() {
+    router_t *r = router_init(2, hello_world_handler);
+    router_register(r, "cat", cat_handler);
+    router_register(r, "upload", hello_world_handler);
+    assert(router_max_body(r, "cat") == ROUTER_DEFAULT_MAX_BODY);
+    assert(router_max_body(r, "nope") == ROUTER_DEFAULT_MAX_BODY);
+    router_set_max_body(r, "upload", 1 << 30);
+    router_set_max_body(r, NULL, 0);
+    // unregistered routes get the fallback's limit
+    router_set_max_body(r, "nope", 7);
+    assert(router_max_body(r, "upload") == 1 << 30);
+    assert(router_max_body(r, "cat") == ROUTER_DEFAULT_MAX_BODY);
+    assert(router_max_body(r, "nope") == 0);
+    // limits carry over to copies, and registering again keeps them
+    router_t *copy = router_copy(r);
+    router_register(r, "upload", cat_handler);
+    assert(router_max_body(r, "upload") == 1 << 30);
+    router_free(r);
+    assert(router_max_body(copy, "upload") == 1 << 30);
+    assert(router_max_body(copy, "nope") == 0);
+    test_router_t *tr = (test_router_t *) copy;
+    assert(tr->num_routes == 2);
+    assert_streq(tr->routes[1].path, "upload");
+    router_free(copy);
+}
 
 int main(int argc, char *argv[]) {
     // Run all tests? True if there are no command-line arguments
@@ -143,7 +204,10 @@ int main(int argc, char *argv[]) {
     DO_TEST(test_fallback)
     DO_TEST(test_register_one)
     DO_TEST(test_register_several)
+    DO_TEST(test_dispatch_decoded_path)
     DO_TEST(test_register_replace)
     DO_TEST(test_register_max)
+    DO_TEST(test_copy)
+    DO_TEST(test_max_body)
     puts("test_router PASS");
 }
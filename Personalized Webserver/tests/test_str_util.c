@@ -2,6 +2,8 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
 #include "strarray.h"
 #include "mystr.h"
 
@@ -223,6 +225,222 @@ void test_split_long_string(){
 
 void test_strsplit() {}
 
+void test_strarray_contiguous() {
+    char *storage = NULL;
+    strarray_t *arr = strarray_init_contiguous(3, 9, &storage);
+    assert(arr->length == 3);
+    for (size_t i = 0; i < 3; i++) {
+        assert(arr->data[i] == NULL);
+    }
+    memcpy(storage, "ab\0cd\0ef", 9);
+    for (size_t i = 0; i < 3; i++) {
+        arr->data[i] = storage + 3 * i;
+    }
+    assert_strarray_matches(arr, {"ab", "cd", "ef"});
+    strarray_free(arr);
+
+    arr = strarray_init_contiguous(0, 0, &storage);
+    assert(arr->length == 0);
+    strarray_free(arr);
+}
+
+void test_split_header_block() {
+    // a header block's worth of lines, all split out in one allocation
+    const size_t NUM_LINES = 64;
+    char block[NUM_LINES * 16 + 1];
+    size_t len = 0;
+    for (size_t i = 0; i < NUM_LINES; i++) {
+        len += snprintf(block + len, sizeof(block) - len, "Header-%02zu: %03zu\n", i, i);
+    }
+    strarray_t *arr = mystr_split(block, '\n');
+    assert(arr->length == NUM_LINES);
+    char expected[16];
+    for (size_t i = 0; i < NUM_LINES; i++) {
+        snprintf(expected, sizeof(expected), "Header-%02zu: %03zu", i, i);
+        assert(strcmp(expected, arr->data[i]) == 0);
+        // the pieces are stored one after another
+        if (i > 0) {
+            assert(arr->data[i] == arr->data[i - 1] + strlen(arr->data[i - 1]) + 1);
+        }
+    }
+    strarray_free(arr);
+}
+
+void test_tokenizer() {
+    mystr_tokenizer_t tok;
+    const char *token = NULL;
+    size_t len = 0;
+    const char *string = "--a---bc-d-";
+    mystr_tokenizer_init(&tok, string, '-');
+    assert(mystr_next_token(&tok, &token, &len) && token == string + 2 && len == 1);
+    assert(mystr_next_token(&tok, &token, &len) && token == string + 6 && len == 2);
+    assert(mystr_next_token(&tok, &token, &len) && token == string + 9 && len == 1);
+    assert(!mystr_next_token(&tok, &token, &len));
+    assert(!mystr_next_token(&tok, &token, &len));
+
+    const char *empty[] = {"", "----"};
+    for (size_t i = 0; i < 2; i++) {
+        mystr_tokenizer_init(&tok, empty[i], '-');
+        assert(!mystr_next_token(&tok, &token, &len));
+    }
+
+    // finds the same pieces as mystr_split
+    const char *sentence = "  to be or  not to be ";
+    strarray_t *arr = mystr_split(sentence, ' ');
+    mystr_tokenizer_init(&tok, sentence, ' ');
+    for (size_t i = 0; i < arr->length; i++) {
+        assert(mystr_next_token(&tok, &token, &len));
+        assert(len == strlen(arr->data[i]) && strncmp(token, arr->data[i], len) == 0);
+    }
+    assert(!mystr_next_token(&tok, &token, &len));
+    strarray_free(arr);
+}
+
+void test_utoa() {
+    char buf[MYSTR_UTOA_MAX + 1];
+    char expected[MYSTR_UTOA_MAX + 1];
+    // every number of digits, and either side of each power of ten
+    for (uint64_t power = 1;; power *= 10) {
+        for (uint64_t n = power - (power > 1); n <= power + 1; n++) {
+            snprintf(expected, sizeof(expected), "%" PRIu64, n);
+            size_t len = mystr_utoa(buf, n);
+            buf[len] = '\0';
+            assert(len == strlen(expected) && len == mystr_utoa_length(n));
+            assert(strcmp(buf, expected) == 0);
+        }
+        if (power > UINT64_MAX / 10) {
+            break;
+        }
+    }
+    assert(mystr_utoa(buf, 0) == 1 && buf[0] == '0');
+    buf[mystr_utoa(buf, UINT64_MAX)] = '\0';
+    assert(strcmp(buf, "18446744073709551615") == 0);
+    // nothing is written past the digits
+    memset(buf, 'x', sizeof(buf));
+    assert(mystr_utoa(buf, 4242) == 4);
+    assert(strncmp(buf, "4242x", 5) == 0);
+}
+
+const char *IMPLS[] = {"scalar", "sse2", "avx2"};
+#define NUM_IMPLS (sizeof(IMPLS) / sizeof(IMPLS[0]))
+
+// the reference the kernels are checked against
+bool ref_is_tchar(unsigned char c) {
+    return c > ' ' && c < 0x7f && strchr("\"(),/:;<=>?@[\\]{}", c) == NULL;
+}
+
+char ref_fold(char c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+void test_kernels_find_any() {
+    const char *original = mystr_impl();
+    char buf[100];
+    // mostly letters, with separators scattered about
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = i % 37 == 36 ? ';' : i % 23 == 22 ? '&' : 'a' + i % 26;
+    }
+    for (size_t impl = 0; impl < NUM_IMPLS; impl++) {
+        if (!mystr_set_impl(IMPLS[impl])) {
+            continue;
+        }
+        for (size_t start = 0; start < sizeof(buf); start++) {
+            for (size_t len = 0; start + len <= sizeof(buf); len++) {
+                size_t expected = 0;
+                while (expected < len && buf[start + expected] != ';' && buf[start + expected] != '&') {
+                    expected++;
+                }
+                assert(mystr_find_any(buf + start, len, "&;") == expected);
+                assert(mystr_find_any(buf + start, len, "xyz&;-+") <= expected);
+            }
+        }
+        assert(mystr_find_any(buf, sizeof(buf), "#") == sizeof(buf));
+    }
+    assert(mystr_set_impl(original));
+}
+
+void test_kernels_equal_nocase() {
+    const char *original = mystr_impl();
+    char a[80], b[80];
+    for (size_t impl = 0; impl < NUM_IMPLS; impl++) {
+        if (!mystr_set_impl(IMPLS[impl])) {
+            continue;
+        }
+        // every pair of bytes, at a position in each part of a block
+        const size_t positions[] = {0, 17, 40, 70};
+        for (size_t p = 0; p < 4; p++) {
+            for (int x = 0; x < 256; x++) {
+                for (int y = 0; y < 256; y++) {
+                    memset(a, 'q', sizeof(a));
+                    memset(b, 'Q', sizeof(b));
+                    a[positions[p]] = x;
+                    b[positions[p]] = y;
+                    bool expected = ref_fold(x) == ref_fold(y);
+                    assert(mystr_equal_nocase(a, b, sizeof(a)) == expected);
+                }
+            }
+        }
+        // only the first `len` bytes count
+        memset(a, 'x', sizeof(a));
+        memset(b, 'X', sizeof(b));
+        b[sizeof(b) - 1] = 'y';
+        for (size_t len = 0; len < sizeof(a); len++) {
+            assert(mystr_equal_nocase(a, b, len));
+        }
+        assert(!mystr_equal_nocase(a, b, sizeof(a)));
+    }
+    assert(mystr_set_impl(original));
+}
+
+void test_kernels_token_length() {
+    const char *original = mystr_impl();
+    char buf[80];
+    for (size_t impl = 0; impl < NUM_IMPLS; impl++) {
+        if (!mystr_set_impl(IMPLS[impl])) {
+            continue;
+        }
+        for (size_t pos = 0; pos < sizeof(buf); pos++) {
+            for (int c = 0; c < 256; c++) {
+                memset(buf, 'a', sizeof(buf));
+                buf[pos] = c;
+                size_t expected = ref_is_tchar(c) ? sizeof(buf) : pos;
+                assert(mystr_token_length(buf, sizeof(buf)) == expected);
+                // the byte isn't looked at if it's past the end
+                assert(mystr_token_length(buf, pos) == pos);
+            }
+        }
+        const char *tchars = "!#$%&'*+-.^_`|~0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        assert(mystr_token_length(tchars, strlen(tchars)) == strlen(tchars));
+    }
+    assert(mystr_set_impl(original));
+}
+
+void test_kernels_dispatch() {
+    // the dispatcher picks the fastest supported implementation
+    const char *best = "scalar";
+    for (size_t impl = 0; impl < NUM_IMPLS; impl++) {
+        if (mystr_impl_supported(IMPLS[impl])) {
+            best = IMPLS[impl];
+        }
+    }
+    assert(strcmp(mystr_impl(), best) == 0);
+    assert(!mystr_set_impl("avx512"));
+    assert(strcmp(mystr_impl(), best) == 0);
+}
+
+void test_tokenizer_any() {
+    mystr_tokenizer_t tok;
+    const char *token = NULL;
+    size_t len = 0;
+    mystr_tokenizer_init_any(&tok, " keep-alive,\tUpgrade ,, close", ", \t");
+    const char *expected[] = {"keep-alive", "Upgrade", "close"};
+    for (size_t i = 0; i < 3; i++) {
+        assert(mystr_next_token(&tok, &token, &len));
+        assert(len == strlen(expected[i]) && strncmp(token, expected[i], len) == 0);
+    }
+    assert(!mystr_next_token(&tok, &token, &len));
+}
+
 int main(int argc, char *argv[]) {
     // Run all tests? True if there are no command-line arguments
     bool all_tests = argc == 1;
@@ -247,6 +465,15 @@ int main(int argc, char *argv[]) {
     DO_TEST(test_split_lots_of_spaces)
     DO_TEST(test_split_long_string)
     DO_TEST(test_strsplit)
+    DO_TEST(test_strarray_contiguous)
+    DO_TEST(test_split_header_block)
+    DO_TEST(test_tokenizer)
+    DO_TEST(test_tokenizer_any)
+    DO_TEST(test_utoa)
+    DO_TEST(test_kernels_dispatch)
+    DO_TEST(test_kernels_find_any)
+    DO_TEST(test_kernels_equal_nocase)
+    DO_TEST(test_kernels_token_length)
     puts("test_str_util PASS");
 }
 
@@ -0,0 +1,227 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "test_util.h"
+#include "timer_wheel.h"
+
+/**
+ * A timer which records when, and how many times, it fired.
+ */
+typedef struct {
+    wheel_timer_t timer;
+    timer_wheel_t *wheel;
+    size_t fired;
+    uint64_t fired_at;
+    // if nonzero, the timer schedules itself again this far out
+    uint64_t period;
+} test_timer_t;
+
+// the order timers fired in, for checking it
+test_timer_t *fire_order[16];
+size_t num_fired = 0;
+
+void on_fire(wheel_timer_t *timer, void *aux) {
+    test_timer_t *t = aux;
+    assert(&t->timer == timer);
+    assert(!wheel_timer_pending(timer));
+    t->fired++;
+    t->fired_at = timer_wheel_now(t->wheel);
+    if (num_fired < sizeof(fire_order) / sizeof(fire_order[0])) {
+        fire_order[num_fired] = t;
+    }
+    num_fired++;
+    if (t->period != 0) {
+        timer_wheel_schedule(t->wheel, timer, t->fired_at + t->period);
+    }
+}
+
+void test_timer_init(test_timer_t *t, timer_wheel_t *wheel) {
+    wheel_timer_init(&t->timer, on_fire, t);
+    t->wheel = wheel;
+    t->fired = 0;
+    t->fired_at = 0;
+    t->period = 0;
+}
+
+void test_fires_at_deadline() {
+    // deadlines on every level, right around their block boundaries
+    const uint64_t delays[] = {
+        1, 2, 63, 64, 65, 127, 128, 4095, 4096, 4097, 100000, 262143, 262144,
+        262145, 5000000, 16777215, 16777216, 16777217, 50000000,
+    };
+    for (size_t i = 0; i < sizeof(delays) / sizeof(delays[0]); i++) {
+        for (uint64_t start = 0; start < 200; start += 37) {
+            timer_wheel_t *wheel = timer_wheel_init(start);
+            test_timer_t t;
+            test_timer_init(&t, wheel);
+            uint64_t deadline = start + delays[i];
+            timer_wheel_schedule(wheel, &t.timer, deadline);
+            assert(wheel_timer_pending(&t.timer));
+
+            // following timer_wheel_next, as an event loop would, never
+            // oversleeps and gets there in a few wakeups
+            size_t wakeups = 0;
+            while (t.fired == 0) {
+                uint64_t next = timer_wheel_next(wheel);
+                assert(next > timer_wheel_now(wheel));
+                assert(next <= deadline);
+                timer_wheel_advance(wheel, next);
+                wakeups++;
+            }
+            assert(t.fired == 1);
+            assert(t.fired_at == deadline);
+            assert(wakeups <= 8);
+            assert(!wheel_timer_pending(&t.timer));
+            assert(timer_wheel_next(wheel) == UINT64_MAX);
+            timer_wheel_free(wheel);
+        }
+    }
+}
+
+void test_not_early() {
+    timer_wheel_t *wheel = timer_wheel_init(1000);
+    test_timer_t t;
+    test_timer_init(&t, wheel);
+    timer_wheel_schedule(wheel, &t.timer, 6000);
+    timer_wheel_advance(wheel, 5999);
+    assert(t.fired == 0);
+    timer_wheel_advance(wheel, 5999);
+    assert(t.fired == 0);
+    // a big jump fires it, late, but once
+    timer_wheel_advance(wheel, 100000);
+    assert(t.fired == 1);
+    assert(t.fired_at == 6000);
+    timer_wheel_free(wheel);
+}
+
+void test_past_deadline() {
+    timer_wheel_t *wheel = timer_wheel_init(500);
+    test_timer_t t;
+    test_timer_init(&t, wheel);
+    timer_wheel_schedule(wheel, &t.timer, 100);
+    assert(timer_wheel_next(wheel) == 501);
+    timer_wheel_advance(wheel, 501);
+    assert(t.fired == 1);
+    timer_wheel_free(wheel);
+}
+
+void test_cancel_and_move() {
+    timer_wheel_t *wheel = timer_wheel_init(0);
+    test_timer_t a, b, c;
+    test_timer_init(&a, wheel);
+    test_timer_init(&b, wheel);
+    test_timer_init(&c, wheel);
+    timer_wheel_schedule(wheel, &a.timer, 10);
+    timer_wheel_schedule(wheel, &b.timer, 10);
+    timer_wheel_schedule(wheel, &c.timer, 5000);
+    timer_wheel_cancel(wheel, &a.timer);
+    assert(!wheel_timer_pending(&a.timer));
+    // cancelling twice is harmless
+    timer_wheel_cancel(wheel, &a.timer);
+    // moving a timer replaces its old deadline
+    timer_wheel_schedule(wheel, &c.timer, 20);
+    timer_wheel_schedule(wheel, &b.timer, 30);
+    timer_wheel_advance(wheel, 25);
+    assert(a.fired == 0);
+    assert(b.fired == 0);
+    assert(c.fired == 1 && c.fired_at == 20);
+    timer_wheel_advance(wheel, 10000);
+    assert(a.fired == 0);
+    assert(b.fired == 1 && b.fired_at == 30);
+    assert(c.fired == 1);
+    timer_wheel_free(wheel);
+}
+
+void test_order() {
+    timer_wheel_t *wheel = timer_wheel_init(0);
+    const uint64_t deadlines[] = {70000, 3, 64, 5000, 63, 300000, 4096, 65};
+    const size_t num_timers = sizeof(deadlines) / sizeof(deadlines[0]);
+    test_timer_t timers[num_timers];
+    for (size_t i = 0; i < num_timers; i++) {
+        test_timer_init(&timers[i], wheel);
+        timer_wheel_schedule(wheel, &timers[i].timer, deadlines[i]);
+    }
+    num_fired = 0;
+    timer_wheel_advance(wheel, 1000000);
+    assert(num_fired == num_timers);
+    for (size_t i = 0; i < num_timers; i++) {
+        assert(timers[i].fired_at == deadlines[i]);
+        if (i > 0) {
+            assert(fire_order[i - 1]->fired_at < fire_order[i]->fired_at);
+        }
+    }
+    timer_wheel_free(wheel);
+}
+
+void test_periodic() {
+    timer_wheel_t *wheel = timer_wheel_init(0);
+    test_timer_t t;
+    test_timer_init(&t, wheel);
+    t.period = 1000;
+    timer_wheel_schedule(wheel, &t.timer, 1000);
+    timer_wheel_advance(wheel, 10500);
+    assert(t.fired == 10);
+    assert(t.fired_at == 10000);
+    assert(wheel_timer_pending(&t.timer));
+    timer_wheel_free(wheel);
+    assert(!wheel_timer_pending(&t.timer));
+}
+
+void test_random() {
+    // random schedules, cancels and advances, checked against the deadlines
+    // themselves
+    const size_t num_timers = 200;
+    test_timer_t *timers = malloc(num_timers * sizeof(test_timer_t));
+    uint64_t *deadlines = malloc(num_timers * sizeof(uint64_t));
+    timer_wheel_t *wheel = timer_wheel_init(12345);
+    for (size_t i = 0; i < num_timers; i++) {
+        test_timer_init(&timers[i], wheel);
+    }
+    srand(7);
+    uint64_t now = 12345;
+    for (size_t round = 0; round < 5000; round++) {
+        size_t i = rand() % num_timers;
+        int op = rand() % 4;
+        if (op == 0) {
+            timer_wheel_cancel(wheel, &timers[i].timer);
+        } else if (op == 1) {
+            uint64_t range = (uint64_t) 1 << (rand() % 26);
+            deadlines[i] = now + rand() % range;
+            timers[i].fired = 0;
+            timer_wheel_schedule(wheel, &timers[i].timer, deadlines[i]);
+        } else {
+            uint64_t step = rand() % (op == 2 ? 100 : 100000);
+            uint64_t next = timer_wheel_next(wheel);
+            now += step;
+            timer_wheel_advance(wheel, now);
+            for (size_t j = 0; j < num_timers; j++) {
+                if (wheel_timer_pending(&timers[j].timer)) {
+                    assert(deadlines[j] > now);
+                    assert(next <= deadlines[j]);
+                } else if (timers[j].fired > 0) {
+                    assert(timers[j].fired == 1);
+                    assert(timers[j].fired_at >= deadlines[j]);
+                    assert(timers[j].fired_at <= now);
+                }
+            }
+        }
+    }
+    timer_wheel_free(wheel);
+    free(deadlines);
+    free(timers);
+}
+
+int main(int argc, char *argv[]) {
+    // Run all tests? True if there are no command-line arguments
+    bool all_tests = argc == 1;
+    char **testnames = argv + 1;
+
+    DO_TEST(test_fires_at_deadline)
+    DO_TEST(test_not_early)
+    DO_TEST(test_past_deadline)
+    DO_TEST(test_cancel_and_move)
+    DO_TEST(test_order)
+    DO_TEST(test_periodic)
+    DO_TEST(test_random)
+    puts("test_timer_wheel PASS");
+}